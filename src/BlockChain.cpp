@@ -1,77 +1,476 @@
 #include "BlockChain.h"
 
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <deque>
+
 #include "check.h"
+#include "log.h"
+#include "convertStrings.h"
+
+#include "utils/MappedFile.h"
+#include "utils/FileSystem.h"
+#include "utils/Epoch.h"
 
 using namespace common;
 
 namespace torrent_node_lib {
 
-BlockChain::BlockChain() {
-    initialize();
+const static char SNAPSHOT_MAGIC[8] = {'T', 'N', 'C', 'H', 'A', 'I', 'N', 'S'};
+const static uint32_t SNAPSHOT_VERSION = 1;
+
+const static size_t HASH_SIZE = 32;
+
+//c Формат снимка: заголовок, затем записи фиксированной длины по номерам блоков начиная с 1,
+//c затем таблица имен файлов и область с данными переменной длины (подписи)
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t countBlocks;
+    uint64_t filesOffset;
+    uint64_t filesSize;
+    uint64_t extraOffset;
+    uint64_t extraSize;
+};
+
+struct SnapshotRecord {
+    unsigned char hash[HASH_SIZE];
+    unsigned char prevHash[HASH_SIZE];
+    unsigned char txsHash[HASH_SIZE];
+    uint64_t timestamp;
+    uint64_t blockSize;
+    uint64_t blockType;
+    uint64_t countTxs;
+    uint64_t filePos;
+    uint64_t extraOffset;
+    uint32_t fileIndex;
+    uint16_t signatureSize;
+    uint16_t senderSignSize;
+    uint16_t senderPubkeySize;
+    uint16_t senderAddressSize;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 56, "Incorrect snapshot header size");
+static_assert(sizeof(SnapshotRecord) == 160, "Incorrect snapshot record size");
+
+template<typename T>
+static void writePod(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+//c 2^16 сегментов по 2^14 заголовков
+const static size_t SEGMENT_BITS = 14;
+const static size_t SEGMENT_SIZE = size_t(1) << SEGMENT_BITS;
+const static size_t MAX_SEGMENTS = size_t(1) << 16;
+
+//c Подписи блоков складываются в куски такого размера
+const static size_t EXTRA_CHUNK_SIZE = 1024 * 1024;
+
+//c Больше максимального запроса get-blocks, чтобы весь запрос помещался в кэш
+const static size_t HEADERS_CACHE_SIZE = 4096;
+
+const static uint8_t COMPACT_HAS_PREV_HASH = 1;
+const static uint8_t COMPACT_HAS_TXS_HASH = 2;
+const static uint8_t COMPACT_HAS_COUNT_TXS = 4;
+
+//c Заголовок в цепочке: только поля фиксированного размера, хэши в бинарном виде.
+//c Подписи лежат в extra поколения, имя файла в его таблице имен. BlockHeader собирается только при чтении
+struct BlockChain::CompactHeader {
+    BlockHashIndex::Hash hash;
+    BlockHashIndex::Hash prevHash;
+    BlockHashIndex::Hash txsHash;
+    uint64_t timestamp;
+    uint64_t blockSize;
+    uint64_t blockType;
+    uint64_t countTxs;
+    uint64_t filePos;
+    const std::string *fileName;
+    const unsigned char *extra;
+    uint16_t signatureSize;
+    uint16_t senderSignSize;
+    uint16_t senderPubkeySize;
+    uint16_t senderAddressSize;
+    uint8_t flags;
+};
+
+struct BlockChain::HeadersSegment {
+    std::array<CompactHeader, SEGMENT_SIZE> headers;
+};
+
+struct BlockChain::Generation {
+    
+    Generation()
+        : segments(std::make_unique<std::atomic<HeadersSegment*>[]>(MAX_SEGMENTS))
+        , id(nextId++)
+    {}
+    
+    ~Generation() {
+        for (size_t i = 0; i < MAX_SEGMENTS; i++) {
+            delete segments[i].load(std::memory_order_relaxed);
+        }
+    }
+    
+    std::unique_ptr<std::atomic<HeadersSegment*>[]> segments;
+    //c Публикуется после записи заголовка в сегмент
+    std::atomic<size_t> countHeaders{0};
+    BlockHashIndex hashIndex;
+    
+    //c Куски не переезжают, поэтому CompactHeader держит указатель на свои байты. Дописывает только писатель
+    std::vector<std::unique_ptr<unsigned char[]>> extraChunks;
+    unsigned char *extraPos = nullptr;
+    size_t extraFree = 0;
+    
+    //c Элементы deque не переезжают при добавлении в конец
+    std::deque<std::string> fileNames;
+    std::unordered_map<std::string, const std::string*> fileNamesIndex;
+    
+    //c Адрес поколения может достаться следующему, поэтому кэш заголовков сверяет поколение по id
+    const uint64_t id;
+    
+    inline static std::atomic<uint64_t> nextId{1};
+};
+
+//c Опубликованный заголовок не меняется, поэтому собранный BlockHeader верен, пока живо его поколение
+struct BlockChain::CachedHeader {
+    std::mutex mut;
+    uint64_t generationId = 0;
+    size_t blockNumber = 0;
+    std::shared_ptr<const BlockHeader> header;
+};
+
+static size_t hashIndexSlot(const BlockHashIndex::Hash &hash, size_t mask) {
+    uint64_t words[4];
+    std::memcpy(words, hash.data(), sizeof(words));
+    uint64_t h = words[0] ^ words[1] ^ words[2] ^ words[3];
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h & mask;
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else {
+        return -1;
+    }
+}
+
+bool BlockHashIndex::parseHash(const std::string &hexHash, Hash &hash) {
+    if (hexHash.size() != hash.size() * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < hash.size(); i++) {
+        const int high = hexDigit(hexHash[2 * i]);
+        const int low = hexDigit(hexHash[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        hash[i] = (unsigned char)(high * 16 + low);
+    }
+    return true;
 }
 
-void BlockChain::initialize() {
-    BlockHeader genesisBlock;
+BlockHashIndex::Table::Table(size_t capacity)
+    : mask(capacity - 1)
+    , slots(std::make_unique<Slot[]>(capacity))
+{}
+
+BlockHashIndex::BlockHashIndex()
+    : table(new Table(16))
+{}
+
+BlockHashIndex::~BlockHashIndex() {
+    delete table.load(std::memory_order_relaxed);
+}
+
+void BlockHashIndex::insertImpl(Table &table, const Hash &hash, uint64_t blockNumberInc) {
+    for (size_t i = hashIndexSlot(hash, table.mask);; i = (i + 1) & table.mask) {
+        Slot &slot = table.slots[i];
+        if (slot.blockNumberInc.load(std::memory_order_relaxed) == 0) {
+            slot.hash = hash;
+            slot.blockNumberInc.store(blockNumberInc, std::memory_order_release);
+            return;
+        }
+        CHECK(slot.hash != hash, "Hash already exist in index");
+    }
+}
+
+void BlockHashIndex::rehash(size_t newCapacity) {
+    Table *oldTable = table.load(std::memory_order_relaxed);
+    Table *newTable = new Table(newCapacity);
+    for (size_t i = 0; i <= oldTable->mask; i++) {
+        const Slot &slot = oldTable->slots[i];
+        const uint64_t blockNumberInc = slot.blockNumberInc.load(std::memory_order_relaxed);
+        if (blockNumberInc != 0) {
+            insertImpl(*newTable, slot.hash, blockNumberInc);
+        }
+    }
+    table.store(newTable, std::memory_order_release);
+    retireObject(oldTable);
+}
+
+void BlockHashIndex::reserve(size_t newCount) {
+    size_t capacity = 16;
+    //c Заполненность таблицы держим не выше половины
+    while (capacity < newCount * 2) {
+        capacity *= 2;
+    }
+    if (capacity > table.load(std::memory_order_relaxed)->mask + 1) {
+        rehash(capacity);
+    }
+}
+
+void BlockHashIndex::insert(const Hash &hash, size_t blockNumber) {
+    reserve(count + 1);
+    insertImpl(*table.load(std::memory_order_relaxed), hash, blockNumber + 1);
+    count++;
+}
+
+std::optional<size_t> BlockHashIndex::find(const Hash &hash) const {
+    const Table &t = *table.load(std::memory_order_acquire);
+    for (size_t i = hashIndexSlot(hash, t.mask);; i = (i + 1) & t.mask) {
+        const Slot &slot = t.slots[i];
+        const uint64_t blockNumberInc = slot.blockNumberInc.load(std::memory_order_acquire);
+        if (blockNumberInc == 0) {
+            return std::nullopt;
+        }
+        if (slot.hash == hash) {
+            return blockNumberInc - 1;
+        }
+    }
+}
+
+BlockChain::BlockChain()
+    : current(makeGeneration().release())
+    , headersCache(std::make_unique<CachedHeader[]>(HEADERS_CACHE_SIZE))
+{}
+
+BlockChain::~BlockChain() {
+    delete current.load(std::memory_order_relaxed);
+}
+
+std::unique_ptr<BlockChain::Generation> BlockChain::makeGeneration() {
+    std::unique_ptr<Generation> generation = std::make_unique<Generation>();
+    
+    BlockHeader genesisBlock{};
     const std::string GENESIS_BLOCK_HASH = "0000000000000000000000000000000000000000000000000000000000000000";
     genesisBlock.hash = GENESIS_BLOCK_HASH;
     genesisBlock.blockNumber = 0;
     
-    blocks[GENESIS_BLOCK_HASH] = genesisBlock;
-    hashes.push_back(GENESIS_BLOCK_HASH);
+    BlockHashIndex::Hash hash;
+    CHECK(BlockHashIndex::parseHash(GENESIS_BLOCK_HASH, hash), "Incorrect genesis hash");
+    appendBlock(*generation, genesisBlock, hash);
+    return generation;
+}
+
+void BlockChain::publishGeneration(std::unique_ptr<Generation> generation) {
+    Generation *old = current.exchange(generation.release(), std::memory_order_acq_rel);
+    retireObject(old);
+    notifyCountBlocks();
+}
+
+void BlockChain::notifyCountBlocks() {
+    //c Пустой захват мьютекса: ожидающий либо еще не проверил количество и увидит новое, либо уже ждет и получит notify
+    {
+        std::lock_guard<std::mutex> lock(countBlocksMut);
+    }
+    countBlocksCond.notify_all();
+}
+
+unsigned char* BlockChain::allocExtra(Generation &generation, size_t size) {
+    if (size > generation.extraFree) {
+        const size_t chunkSize = std::max(size, EXTRA_CHUNK_SIZE);
+        generation.extraChunks.emplace_back(std::make_unique<unsigned char[]>(chunkSize));
+        generation.extraPos = generation.extraChunks.back().get();
+        generation.extraFree = chunkSize;
+    }
+    unsigned char *extra = generation.extraPos;
+    generation.extraPos += size;
+    generation.extraFree -= size;
+    return extra;
+}
+
+const std::string* BlockChain::storeFileName(Generation &generation, const std::string &fileName) {
+    const auto found = generation.fileNamesIndex.find(fileName);
+    if (found != generation.fileNamesIndex.end()) {
+        return found->second;
+    }
+    const std::string *stored = &generation.fileNames.emplace_back(fileName);
+    generation.fileNamesIndex.emplace(fileName, stored);
+    return stored;
+}
+
+BlockChain::CompactHeader BlockChain::makeCompactHeader(Generation &generation, const BlockHeader &block, const BlockHashIndex::Hash &hash) {
+    CHECK(block.signature.size() <= UINT16_MAX && block.senderSign.size() <= UINT16_MAX && block.senderPubkey.size() <= UINT16_MAX && block.senderAddress.size() <= UINT16_MAX, "Too big block signature");
+    CompactHeader compact{};
+    compact.hash = hash;
+    if (!block.prevHash.empty()) {
+        CHECK(BlockHashIndex::parseHash(block.prevHash, compact.prevHash), "Incorrect block hash " + block.prevHash);
+        compact.flags |= COMPACT_HAS_PREV_HASH;
+    }
+    if (!block.txsHash.empty()) {
+        CHECK(BlockHashIndex::parseHash(block.txsHash, compact.txsHash), "Incorrect txs hash " + block.txsHash);
+        compact.flags |= COMPACT_HAS_TXS_HASH;
+    }
+    if (block.countTxs.has_value()) {
+        compact.countTxs = block.countTxs.value();
+        compact.flags |= COMPACT_HAS_COUNT_TXS;
+    }
+    compact.timestamp = block.timestamp;
+    compact.blockSize = block.blockSize;
+    compact.blockType = block.blockType;
+    compact.filePos = block.filePos.pos;
+    compact.fileName = storeFileName(generation, block.filePos.fileName);
+    compact.signatureSize = block.signature.size();
+    compact.senderSignSize = block.senderSign.size();
+    compact.senderPubkeySize = block.senderPubkey.size();
+    compact.senderAddressSize = block.senderAddress.size();
+    const size_t extraSize = block.signature.size() + block.senderSign.size() + block.senderPubkey.size() + block.senderAddress.size();
+    if (extraSize != 0) {
+        unsigned char *pos = allocExtra(generation, extraSize);
+        compact.extra = pos;
+        pos = std::copy(block.signature.begin(), block.signature.end(), pos);
+        pos = std::copy(block.senderSign.begin(), block.senderSign.end(), pos);
+        pos = std::copy(block.senderPubkey.begin(), block.senderPubkey.end(), pos);
+        std::copy(block.senderAddress.begin(), block.senderAddress.end(), pos);
+    }
+    return compact;
+}
+
+BlockHeader BlockChain::makeBlockHeader(const CompactHeader &compact, size_t blockNumber) {
+    BlockHeader bh;
+    bh.hash = toHex(compact.hash.begin(), compact.hash.end());
+    if (compact.flags & COMPACT_HAS_PREV_HASH) {
+        bh.prevHash = toHex(compact.prevHash.begin(), compact.prevHash.end());
+    }
+    if (compact.flags & COMPACT_HAS_TXS_HASH) {
+        bh.txsHash = toHex(compact.txsHash.begin(), compact.txsHash.end());
+    }
+    if (compact.flags & COMPACT_HAS_COUNT_TXS) {
+        bh.countTxs = compact.countTxs;
+    }
+    bh.timestamp = compact.timestamp;
+    bh.blockSize = compact.blockSize;
+    bh.blockType = compact.blockType;
+    bh.filePos.fileName = *compact.fileName;
+    bh.filePos.pos = compact.filePos;
+    bh.blockNumber = blockNumber;
+    
+    const unsigned char *e = compact.extra;
+    if (e != nullptr) {
+        bh.signature.assign(e, e + compact.signatureSize);
+        e += compact.signatureSize;
+        bh.senderSign.assign(e, e + compact.senderSignSize);
+        e += compact.senderSignSize;
+        bh.senderPubkey.assign(e, e + compact.senderPubkeySize);
+        e += compact.senderPubkeySize;
+        bh.senderAddress.assign(e, e + compact.senderAddressSize);
+    }
+    return bh;
+}
+
+void BlockChain::appendCompact(Generation &generation, const CompactHeader &compact) {
+    const size_t blockNumber = generation.countHeaders.load(std::memory_order_relaxed);
+    const size_t segmentIndex = blockNumber >> SEGMENT_BITS;
+    CHECK(segmentIndex < MAX_SEGMENTS, "Too many blocks");
+    
+    HeadersSegment *segment = generation.segments[segmentIndex].load(std::memory_order_relaxed);
+    if (segment == nullptr) {
+        segment = new HeadersSegment();
+        generation.segments[segmentIndex].store(segment, std::memory_order_release);
+    }
+    segment->headers[blockNumber & (SEGMENT_SIZE - 1)] = compact;
+    //c В индекс по хэшу блок попадает до публикации количества: getCompactImpl отсекает еще не опубликованные номера,
+    //c а после публикации блок сразу находится и по номеру, и по хэшу
+    generation.hashIndex.insert(compact.hash, blockNumber);
+    generation.countHeaders.store(blockNumber + 1, std::memory_order_release);
+}
+
+void BlockChain::appendBlock(Generation &generation, const BlockHeader &block, const BlockHashIndex::Hash &hash) {
+    const size_t blockNumber = generation.countHeaders.load(std::memory_order_relaxed);
+    CHECK(block.blockNumber.has_value() && block.blockNumber.value() == blockNumber, "Incorrect block number");
+    appendCompact(generation, makeCompactHeader(generation, block, hash));
 }
 
 bool BlockChain::addWithoutCalc(const BlockHeader& block) {
     CHECK(!block.hash.empty(), "Empty block hash");
-    std::lock_guard<std::shared_mutex> lock(mut);
-    const bool exist = blocks.find(block.hash) != blocks.end();
+    BlockHashIndex::Hash hash;
+    CHECK(BlockHashIndex::parseHash(block.hash, hash), "Incorrect block hash " + block.hash);
+    std::lock_guard<std::mutex> lock(writeMut);
+    if (current.load(std::memory_order_relaxed)->hashIndex.find(hash).has_value()) {
+        return true;
+    }
+    const bool exist = pendingBlocks.find(block.hash) != pendingBlocks.end();
     if (!exist) {
-        blocks[block.hash] = block;
+        pendingBlocks.emplace(block.hash, block);
     }
     return exist;
 }
 
 void BlockChain::removeBlock(const BlockHeader& block) {
     CHECK(!block.hash.empty(), "Empty block hash");
-    std::lock_guard<std::shared_mutex> lock(mut);
-    blocks.erase(block.hash);
+    std::lock_guard<std::mutex> lock(writeMut);
+    pendingBlocks.erase(block.hash);
 }
 
 size_t BlockChain::calcBlockchain(const std::string& lastHash) {
     CHECK(!lastHash.empty(), "Empty block hash");
-    std::lock_guard<std::shared_mutex> lock(mut);
-    
-    std::vector<std::reference_wrapper<BlockHeader>> processedBlocks;
-    CHECK(blocks.find(lastHash) != blocks.end(), "Hash " + lastHash + " dont append to blockchain");
-    std::reference_wrapper<BlockHeader> bh = blocks.at(lastHash);
-    size_t currNum = 0;
-    while (!bh.get().blockNumber.has_value()) {
-        bh.get().blockNumber = currNum;
-        processedBlocks.push_back(bh);
-        currNum++;
-        const std::string &prevHash = bh.get().prevHash;
+    BlockHashIndex::Hash hash;
+    CHECK(BlockHashIndex::parseHash(lastHash, hash), "Incorrect block hash " + lastHash);
+    std::lock_guard<std::mutex> lock(writeMut);
+    //c Поколение меняется только под writeMut, поэтому писателю EpochGuard не нужен
+    Generation &generation = *current.load(std::memory_order_relaxed);
+    
+    const std::optional<size_t> foundLast = generation.hashIndex.find(hash);
+    if (foundLast.has_value()) {
+        return foundLast.value();
+    }
+    
+    CHECK(pendingBlocks.find(lastHash) != pendingBlocks.end(), "Hash " + lastHash + " dont append to blockchain");
+    std::vector<std::unordered_map<std::string, BlockHeader>::iterator> processedBlocks;
+    std::string currHash = lastHash;
+    std::optional<size_t> parentNumber;
+    while (true) {
+        const auto found = pendingBlocks.find(currHash);
+        if (found == pendingBlocks.end()) {
+            break;
+        }
+        processedBlocks.emplace_back(found);
+        const std::string &prevHash = found->second.prevHash;
         CHECK(!prevHash.empty(), "Empty block hash");
-        const auto found = blocks.find(prevHash);
-        if (found == blocks.end()) {
+        CHECK(BlockHashIndex::parseHash(prevHash, hash), "Incorrect block hash " + prevHash);
+        parentNumber = generation.hashIndex.find(hash);
+        if (parentNumber.has_value()) {
             break;
         }
-        bh = found->second;
+        currHash = prevHash;
     }
     
-    if (bh.get().blockNumber.has_value()) {
-        const size_t allNum = currNum + bh.get().blockNumber.value();
-        for (auto iter = processedBlocks.rbegin(); iter != processedBlocks.rend(); iter++) {
-            BlockHeader &bh = *iter;
-            bh.blockNumber = allNum - bh.blockNumber.value();
-            CHECK(bh.blockNumber.value() == hashes.size(), "Ups");
-            hashes.emplace_back(iter->get().hash);
-        }
-        return allNum;
-    } else {
-        for (BlockHeader &block: processedBlocks) {
-            block.blockNumber.reset();
-        }
+    if (!parentNumber.has_value()) {
         return 0;
     }
+    
+    size_t countHeaders = generation.countHeaders.load(std::memory_order_relaxed);
+    CHECK(parentNumber.value() + 1 == countHeaders, "Ups");
+    for (auto iter = processedBlocks.rbegin(); iter != processedBlocks.rend(); iter++) {
+        BlockHeader &bh = (*iter)->second;
+        bh.blockNumber = countHeaders;
+        CHECK(BlockHashIndex::parseHash(bh.hash, hash), "Incorrect block hash " + bh.hash);
+        appendBlock(generation, bh, hash);
+        pendingBlocks.erase(*iter);
+        countHeaders++;
+    }
+    notifyCountBlocks();
+    return countHeaders - 1;
 }
 
 size_t BlockChain::addBlock(const BlockHeader& block) {
@@ -86,48 +485,254 @@ size_t BlockChain::addBlock(const BlockHeader& block) {
     }
 }
 
-BlockHeader BlockChain::getBlockImpl(const std::string& hash) const {   
-    const auto found = blocks.find(hash);
-    if (found == blocks.end()) {
-        return BlockHeader();
-    } else {
-        return found->second;
+const BlockChain::CompactHeader* BlockChain::getCompactImpl(const Generation &generation, size_t blockNumber) {
+    if (generation.countHeaders.load(std::memory_order_acquire) <= blockNumber) {
+        return nullptr;
     }
+    const HeadersSegment *segment = generation.segments[blockNumber >> SEGMENT_BITS].load(std::memory_order_acquire);
+    return &segment->headers[blockNumber & (SEGMENT_SIZE - 1)];
 }
 
-BlockHeader BlockChain::getBlock(const std::string& hash) const {
-    CHECK(!hash.empty(), "Empty block hash");
-    std::shared_lock<std::shared_mutex> lock(mut);
-    return getBlockImpl(hash);
+std::shared_ptr<const BlockHeader> BlockChain::getBlockImpl(const Generation &generation, size_t blockNumber) const {
+    const CompactHeader *compact = getCompactImpl(generation, blockNumber);
+    if (compact == nullptr) {
+        return nullptr;
+    }
+    
+    CachedHeader &cached = headersCache[blockNumber % HEADERS_CACHE_SIZE];
+    {
+        std::lock_guard<std::mutex> lock(cached.mut);
+        if (cached.header != nullptr && cached.generationId == generation.id && cached.blockNumber == blockNumber) {
+            return cached.header;
+        }
+    }
+    
+    //c Собирается без блокировки слота. Если два читателя соберут один заголовок, в слоте останется любой из них
+    std::shared_ptr<const BlockHeader> header = std::make_shared<const BlockHeader>(makeBlockHeader(*compact, blockNumber));
+    std::lock_guard<std::mutex> lock(cached.mut);
+    cached.generationId = generation.id;
+    cached.blockNumber = blockNumber;
+    cached.header = header;
+    return header;
 }
 
-BlockHeader BlockChain::getBlockImpl(size_t blockNumber) const {
-    if (hashes.size() <= blockNumber) {
-        return BlockHeader();
-    } else {
-        return getBlockImpl(hashes[blockNumber]);
+std::shared_ptr<const BlockHeader> BlockChain::getBlock(const std::string& hash) const {
+    CHECK(!hash.empty(), "Empty block hash");
+    BlockHashIndex::Hash binHash;
+    if (!BlockHashIndex::parseHash(hash, binHash)) {
+        return nullptr;
+    }
+    EpochGuard guard;
+    const Generation &generation = *current.load(std::memory_order_acquire);
+    const std::optional<size_t> blockNumber = generation.hashIndex.find(binHash);
+    if (!blockNumber.has_value()) {
+        return nullptr;
     }
+    return getBlockImpl(generation, blockNumber.value());
 }
 
-BlockHeader BlockChain::getBlock(size_t blockNumber) const {
-    std::shared_lock<std::shared_mutex> lock(mut);
-    return getBlockImpl(blockNumber);
+std::shared_ptr<const BlockHeader> BlockChain::getBlock(size_t blockNumber) const {
+    EpochGuard guard;
+    return getBlockImpl(*current.load(std::memory_order_acquire), blockNumber);
 }
 
-BlockHeader BlockChain::getLastBlock() const {
-    std::shared_lock<std::shared_mutex> lock(mut);
-    return getBlockImpl(hashes.size() - 1);
+std::shared_ptr<const BlockHeader> BlockChain::getLastBlock() const {
+    EpochGuard guard;
+    const Generation &generation = *current.load(std::memory_order_acquire);
+    return getBlockImpl(generation, generation.countHeaders.load(std::memory_order_acquire) - 1);
 }
 
 size_t BlockChain::countBlocks() const {
-    return hashes.size() - 1;
+    EpochGuard guard;
+    return current.load(std::memory_order_acquire)->countHeaders.load(std::memory_order_acquire) - 1;
 }
 
-void BlockChain::clear() {
-    blocks.clear();
-    hashes.clear();
+size_t BlockChain::waitCountBlocks(size_t countBlocks, const milliseconds &timeout) const {
+    std::unique_lock<std::mutex> lock(countBlocksMut);
+    countBlocksCond.wait_for(lock, timeout, [this, countBlocks] {
+        return this->countBlocks() > countBlocks;
+    });
+    return this->countBlocks();
+}
+
+void BlockChain::saveSnapshot(const std::string &fileName) const {
+    const std::string tmpFileName = fileName + ".tmp";
+    EpochGuard guard;
+    const Generation &generation = *current.load(std::memory_order_acquire);
+    
+    const size_t countBlocks = generation.countHeaders.load(std::memory_order_acquire) - 1;
+    
+    std::vector<std::string> files;
+    std::unordered_map<std::string, uint32_t> filesIndexes;
+    std::string extra;
+    
+    {
+        std::ofstream file(tmpFileName, std::ios::binary | std::ios::trunc);
+        CHECK(file.is_open(), "Dont open file " + tmpFileName);
+        
+        SnapshotHeader header{};
+        writePod(file, header);
+        
+        for (size_t i = 1; i <= countBlocks; i++) {
+            const CompactHeader &compact = *getCompactImpl(generation, i);
+            
+            SnapshotRecord record{};
+            CHECK((compact.flags & COMPACT_HAS_PREV_HASH) && (compact.flags & COMPACT_HAS_TXS_HASH), "Block hashes not set");
+            std::copy(compact.hash.begin(), compact.hash.end(), record.hash);
+            std::copy(compact.prevHash.begin(), compact.prevHash.end(), record.prevHash);
+            std::copy(compact.txsHash.begin(), compact.txsHash.end(), record.txsHash);
+            record.timestamp = compact.timestamp;
+            record.blockSize = compact.blockSize;
+            record.blockType = compact.blockType;
+            CHECK(compact.flags & COMPACT_HAS_COUNT_TXS, "Count txs not set");
+            record.countTxs = compact.countTxs;
+            record.filePos = compact.filePos;
+            
+            const auto foundFile = filesIndexes.find(*compact.fileName);
+            if (foundFile == filesIndexes.end()) {
+                record.fileIndex = files.size();
+                filesIndexes.emplace(*compact.fileName, record.fileIndex);
+                files.emplace_back(*compact.fileName);
+            } else {
+                record.fileIndex = foundFile->second;
+            }
+            
+            record.extraOffset = extra.size();
+            record.signatureSize = compact.signatureSize;
+            record.senderSignSize = compact.senderSignSize;
+            record.senderPubkeySize = compact.senderPubkeySize;
+            record.senderAddressSize = compact.senderAddressSize;
+            const size_t extraSize = size_t(compact.signatureSize) + compact.senderSignSize + compact.senderPubkeySize + compact.senderAddressSize;
+            if (extraSize != 0) {
+                extra.append(reinterpret_cast<const char*>(compact.extra), extraSize);
+            }
+            
+            writePod(file, record);
+        }
+        
+        std::string filesTable;
+        for (const std::string &f: files) {
+            const uint32_t size = f.size();
+            filesTable.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            filesTable += f;
+        }
+        
+        header.filesOffset = sizeof(SnapshotHeader) + countBlocks * sizeof(SnapshotRecord);
+        header.filesSize = files.size();
+        header.extraOffset = header.filesOffset + filesTable.size();
+        header.extraSize = extra.size();
+        file.write(filesTable.data(), filesTable.size());
+        file.write(extra.data(), extra.size());
+        
+        //c Заголовок пишется последним, чтобы недописанный файл не считался корректным
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.recordSize = sizeof(SnapshotRecord);
+        header.countBlocks = countBlocks;
+        file.seekp(0);
+        writePod(file, header);
+        
+        file.close();
+        CHECK(!file.fail(), "Error write snapshot to " + tmpFileName);
+    }
     
-    initialize();
+    CHECK(std::rename(tmpFileName.c_str(), fileName.c_str()) == 0, "Dont rename file " + tmpFileName);
+}
+
+size_t BlockChain::loadSnapshot(const std::string &fileName) {
+    if (!isFileExist(fileName)) {
+        return 0;
+    }
+    try {
+        const MappedFile file(fileName);
+        const char *data = file.data();
+        CHECK(file.size() >= sizeof(SnapshotHeader), "Incorrect snapshot size");
+        
+        SnapshotHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        CHECK(std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0, "Incorrect snapshot magic");
+        CHECK(header.version == SNAPSHOT_VERSION, "Incorrect snapshot version " + std::to_string(header.version));
+        CHECK(header.recordSize == sizeof(SnapshotRecord), "Incorrect snapshot record size");
+        CHECK(header.filesOffset == sizeof(SnapshotHeader) + header.countBlocks * sizeof(SnapshotRecord), "Incorrect snapshot files offset");
+        CHECK(header.extraOffset >= header.filesOffset && header.extraOffset + header.extraSize == file.size(), "Incorrect snapshot size");
+        
+        std::vector<std::string> files;
+        files.reserve(header.filesSize);
+        size_t pos = header.filesOffset;
+        for (size_t i = 0; i < header.filesSize; i++) {
+            uint32_t size;
+            CHECK(pos + sizeof(size) <= header.extraOffset, "Incorrect snapshot files table");
+            std::memcpy(&size, data + pos, sizeof(size));
+            pos += sizeof(size);
+            CHECK(pos + size <= header.extraOffset, "Incorrect snapshot files table");
+            files.emplace_back(data + pos, size);
+            pos += size;
+        }
+        
+        const unsigned char *extra = reinterpret_cast<const unsigned char*>(data + header.extraOffset);
+        
+        //c Поколение собирается целиком и публикуется в конце, читатели не видят частично загруженную цепочку
+        std::unique_ptr<Generation> generation = makeGeneration();
+        generation->hashIndex.reserve(header.countBlocks + 1);
+        BlockHashIndex::Hash prevHash = getCompactImpl(*generation, 0)->hash;
+        std::vector<const std::string*> storedFiles;
+        storedFiles.reserve(files.size());
+        for (const std::string &f: files) {
+            storedFiles.emplace_back(storeFileName(*generation, f));
+        }
+        for (size_t i = 0; i < header.countBlocks; i++) {
+            SnapshotRecord record;
+            std::memcpy(&record, data + sizeof(SnapshotHeader) + i * sizeof(SnapshotRecord), sizeof(record));
+            
+            CompactHeader compact{};
+            std::copy(record.hash, record.hash + HASH_SIZE, compact.hash.begin());
+            std::copy(record.prevHash, record.prevHash + HASH_SIZE, compact.prevHash.begin());
+            std::copy(record.txsHash, record.txsHash + HASH_SIZE, compact.txsHash.begin());
+            compact.flags = COMPACT_HAS_PREV_HASH | COMPACT_HAS_TXS_HASH | COMPACT_HAS_COUNT_TXS;
+            compact.timestamp = record.timestamp;
+            compact.blockSize = record.blockSize;
+            compact.blockType = record.blockType;
+            compact.countTxs = record.countTxs;
+            CHECK(record.fileIndex < files.size(), "Incorrect snapshot file index");
+            compact.fileName = storedFiles[record.fileIndex];
+            compact.filePos = record.filePos;
+            
+            const size_t extraSize = size_t(record.signatureSize) + record.senderSignSize + record.senderPubkeySize + record.senderAddressSize;
+            CHECK(record.extraOffset + extraSize <= header.extraSize, "Incorrect snapshot extra offset");
+            compact.signatureSize = record.signatureSize;
+            compact.senderSignSize = record.senderSignSize;
+            compact.senderPubkeySize = record.senderPubkeySize;
+            compact.senderAddressSize = record.senderAddressSize;
+            if (extraSize != 0) {
+                //c Данные снимка отображены только на время загрузки, подписи копируются в поколение
+                unsigned char *e = allocExtra(*generation, extraSize);
+                std::copy(extra + record.extraOffset, extra + record.extraOffset + extraSize, e);
+                compact.extra = e;
+            }
+            
+            CHECK(compact.prevHash == prevHash, "Incorrect snapshot: block " + toHex(compact.hash.begin(), compact.hash.end()) + " not linked with previous");
+            prevHash = compact.hash;
+            appendCompact(*generation, compact);
+        }
+        
+        std::lock_guard<std::mutex> lock(writeMut);
+        CHECK(current.load(std::memory_order_relaxed)->countHeaders.load(std::memory_order_relaxed) == 1 && pendingBlocks.empty(), "Blockchain not empty");
+        publishGeneration(std::move(generation));
+        
+        return header.countBlocks;
+    } catch (const exception &e) {
+        LOGWARN << "Dont load blockchain snapshot " << fileName << ": " << e;
+    } catch (const std::exception &e) {
+        LOGWARN << "Dont load blockchain snapshot " << fileName << ": " << e.what();
+    }
+    
+    return 0;
+}
+
+void BlockChain::clear() {
+    std::lock_guard<std::mutex> lock(writeMut);
+    pendingBlocks.clear();
+    publishGeneration(makeGeneration());
 }
 
 }
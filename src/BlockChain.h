@@ -4,7 +4,12 @@
 #include "BlockInfo.h"
 
 #include <unordered_map>
-#include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <array>
+#include <optional>
 
 #include "OopUtils.h"
 
@@ -12,45 +17,136 @@
 
 namespace torrent_node_lib {
 
+//c Таблица с открытой адресацией: бинарный хэш блока -> номер блока.
+//c Вставляет только писатель, find можно вызывать параллельно под EpochGuard
+class BlockHashIndex {
+public:
+    
+    using Hash = std::array<unsigned char, 32>;
+    
+    static bool parseHash(const std::string &hexHash, Hash &hash);
+    
+    BlockHashIndex();
+    
+    ~BlockHashIndex();
+    
+    void insert(const Hash &hash, size_t blockNumber);
+    
+    std::optional<size_t> find(const Hash &hash) const;
+    
+    void reserve(size_t count);
+    
+private:
+    
+    struct Slot {
+        Hash hash;
+        //c 0 - пустая ячейка. Хэш записывается до публикации номера
+        std::atomic<uint64_t> blockNumberInc{0};
+    };
+    
+    struct Table {
+        explicit Table(size_t capacity);
+        
+        const size_t mask;
+        std::unique_ptr<Slot[]> slots;
+    };
+    
+    static void insertImpl(Table &table, const Hash &hash, uint64_t blockNumberInc);
+    
+    void rehash(size_t newCapacity);
+    
+private:
+    
+    std::atomic<Table*> table;
+    size_t count = 0;
+};
+
+//c Читатели не берут блокировок: текущее поколение цепочки публикуется атомарным указателем,
+//c заголовки лежат в сегментах, которые только дописываются, а количество блоков публикуется последним.
+//c В сегментах заголовки хранятся в компактном бинарном виде, BlockHeader собирается при чтении
+//c и запоминается в небольшом кэше, так что повторное чтение тех же блоков его не пересобирает.
+//c Писатели (поток синхронизации) упорядочены мьютексом
 class BlockChain : public BlockChainReadInterface {
 public:
     
     BlockChain();
     
+    ~BlockChain() override;
+    
     bool addWithoutCalc(const BlockHeader &block);
     
     size_t calcBlockchain(const std::string &lastHash);
     
     size_t addBlock(const BlockHeader &block);
     
-    BlockHeader getBlock(const std::string &hash) const override;
+    //c Возвращают собранную копию заголовка или nullptr
+    std::shared_ptr<const BlockHeader> getBlock(const std::string &hash) const override;
     
-    BlockHeader getBlock(size_t blockNumber) const override;
+    std::shared_ptr<const BlockHeader> getBlock(size_t blockNumber) const override;
     
-    BlockHeader getLastBlock() const override;
+    std::shared_ptr<const BlockHeader> getLastBlock() const override;
     
     size_t countBlocks() const override;
     
+    size_t waitCountBlocks(size_t countBlocks, const milliseconds &timeout) const override;
+    
     void clear();
     
+    //c Записывает плоский снимок индекса (номер -> заголовок) в файл. Запись идет во временный файл с последующим переименованием
+    void saveSnapshot(const std::string &fileName) const;
+    
+    //c Загружает снимок индекса, отображая файл в память. Возвращает количество загруженных блоков, 0 если снимка нет или он не подходит
+    size_t loadSnapshot(const std::string &fileName);
+    
 private:
     
+    struct CompactHeader;
+    
+    struct HeadersSegment;
+    
+    struct Generation;
+    
+    struct CachedHeader;
+    
     void removeBlock(const BlockHeader &block);
     
-    BlockHeader getBlockImpl(const std::string &hash) const;
+    static unsigned char* allocExtra(Generation &generation, size_t size);
     
-    BlockHeader getBlockImpl(size_t blockNumber) const;
+    static const std::string* storeFileName(Generation &generation, const std::string &fileName);
     
-private:
+    static CompactHeader makeCompactHeader(Generation &generation, const BlockHeader &block, const BlockHashIndex::Hash &hash);
+    
+    static BlockHeader makeBlockHeader(const CompactHeader &compact, size_t blockNumber);
     
-    void initialize();
+    static void appendCompact(Generation &generation, const CompactHeader &compact);
+    
+    static void appendBlock(Generation &generation, const BlockHeader &block, const BlockHashIndex::Hash &hash);
+    
+    static const CompactHeader* getCompactImpl(const Generation &generation, size_t blockNumber);
+    
+    std::shared_ptr<const BlockHeader> getBlockImpl(const Generation &generation, size_t blockNumber) const;
+    
+    static std::unique_ptr<Generation> makeGeneration();
+    
+    void publishGeneration(std::unique_ptr<Generation> generation);
+    
+    void notifyCountBlocks();
     
 private:
     
-    std::unordered_map<std::string, BlockHeader> blocks;
-    std::vector<std::string> hashes;
+    std::atomic<Generation*> current;
+    
+    //c Собранные заголовки недавно читавшихся блоков. Слот выбирается по номеру блока, поэтому блоки одного запроса get-blocks не вытесняют друг друга
+    std::unique_ptr<CachedHeader[]> headersCache;
+    
+    //c Блоки, добавленные через addWithoutCalc и еще не привязанные к цепочке
+    std::unordered_map<std::string, BlockHeader> pendingBlocks;
+    
+    std::mutex writeMut;
     
-    mutable std::shared_mutex mut;
+    //c Только для ожидающих waitCountBlocks, читатели countBlocks его не берут
+    mutable std::mutex countBlocksMut;
+    mutable std::condition_variable countBlocksCond;
 };
 
 }
@@ -1,7 +1,11 @@
 #ifndef BLOCKCHAIN_READ_INTERFACE_H_
 #define BLOCKCHAIN_READ_INTERFACE_H_
 
+#include <memory>
+#include <string>
+
 #include "OopUtils.h"
+#include "duration.h"
 
 namespace torrent_node_lib {
 
@@ -10,14 +14,18 @@ struct BlockHeader;
 class BlockChainReadInterface : public common::no_copyable, common::no_moveable {
 public:
     
-    virtual BlockHeader getBlock(const std::string &hash) const = 0;
+    //c Возвращают nullptr, если блок не найден
+    virtual std::shared_ptr<const BlockHeader> getBlock(const std::string &hash) const = 0;
     
-    virtual BlockHeader getBlock(size_t blockNumber) const = 0;
+    virtual std::shared_ptr<const BlockHeader> getBlock(size_t blockNumber) const = 0;
     
-    virtual BlockHeader getLastBlock() const = 0;
+    virtual std::shared_ptr<const BlockHeader> getLastBlock() const = 0;
     
     virtual size_t countBlocks() const = 0;
     
+    //c Ждет, пока блоков станет больше countBlocks, но не дольше timeout. Возвращает текущее количество блоков
+    virtual size_t waitCountBlocks(size_t countBlocks, const milliseconds &timeout) const = 0;
+    
     virtual ~BlockChainReadInterface() = default;
 
 };
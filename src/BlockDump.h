@@ -0,0 +1,41 @@
+#ifndef BLOCK_DUMP_H_
+#define BLOCK_DUMP_H_
+
+#include <string>
+#include <string_view>
+
+#include "utils/MappedFilesStore.h"
+
+namespace torrent_node_lib {
+
+/**
+ *c Дамп блока. Блок из сети или прочитанный через pread лежит в buffer,
+ *c а блок, прочитанный через отображение файла, остается в отображении и не копируется
+ */
+struct BlockDump {
+    std::string buffer;
+    
+    MappedFileView mapped;
+    
+    std::string_view view() const {
+        if (mapped.file != nullptr) {
+            return mapped.data;
+        } else {
+            return buffer;
+        }
+    }
+    
+    size_t size() const {
+        return view().size();
+    }
+    
+    //c Память buffer остается для следующего блока
+    void clear() {
+        buffer.clear();
+        mapped = MappedFileView();
+    }
+};
+
+}
+
+#endif // BLOCK_DUMP_H_
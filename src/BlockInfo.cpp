@@ -81,6 +81,11 @@ void TransactionInfo::serialize(std::vector<char>& buffer) const {
     serializeInt<size_t>(blockNumber, buffer);
 }
 
+std::string_view DumpSpan::view(std::string_view dump) const {
+    CHECK(offset + size <= dump.size(), "Span out of the dump");
+    return dump.substr(offset, size);
+}
+
 void TransactionInfo::calcRealFee() {
     CHECK(sizeRawTx > 0, "Size raw tx not set");
     realFees = sizeRawTx > 255 ? sizeRawTx - 255 : 0;
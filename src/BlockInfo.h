@@ -2,11 +2,13 @@
 #define BLOCK_INFO_H_
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 #include <variant>
 #include <set>
 #include <unordered_map>
+#include <memory_resource>
 
 #include "duration.h"
 
@@ -118,6 +120,36 @@ private:
     void tryParse(const std::string &raw, size_t &fromPos, size_t number);
 };
 
+/**
+ *c Кусок дампа блока, из которого разобрана транзакция: смещение от начала дампа и длина.
+ *c Байты не копируются, дамп хранится отдельно и передается воркерам вместе с BlockInfo
+ */
+struct DumpSpan {
+    size_t offset = 0;
+    size_t size = 0;
+    
+    DumpSpan() = default;
+    
+    DumpSpan(const char *dumpBegin, const char *begin, const char *end)
+        : offset(begin - dumpBegin)
+        , size(end - begin)
+    {}
+    
+    bool empty() const {
+        return size == 0;
+    }
+    
+    std::string_view view(const char *dumpBegin) const {
+        return std::string_view(dumpBegin + offset, size);
+    }
+    
+    std::string_view view(std::string_view dump) const;
+    
+    std::string toString(std::string_view dump) const {
+        return std::string(view(dump));
+    }
+};
+
 struct TransactionInfo {
     struct DelegateInfo {
         int64_t value;
@@ -125,10 +157,18 @@ struct TransactionInfo {
     };
     
     struct ScriptInfo {
-        std::string txRaw;
+        DumpSpan txRaw;
         bool isInitializeScript;
     };
     
+    //c Метод и нужные воркерам параметры из json в data. Заполняется, если data - корректный json со строковым полем method
+    struct DataMethod {
+        std::string method;
+        std::optional<std::string> value;
+        std::optional<std::string> host;
+        std::optional<std::string> name;
+    };
+    
     std::string hash;
     Address fromAddress;
     Address toAddress;
@@ -143,12 +183,13 @@ struct TransactionInfo {
         
     std::optional<uint64_t> intStatus;
     
-    std::vector<char> sign;
-    std::vector<unsigned char> pubKey;
+    DumpSpan sign;
+    DumpSpan pubKey;
     
     std::vector<unsigned char> data;
     
-    std::string allRawTx;
+    //c Заполняется только при isSaveAllTx
+    DumpSpan allRawTx;
     
     std::optional<int64_t> realFees;
     
@@ -156,6 +197,8 @@ struct TransactionInfo {
     
     std::optional<ScriptInfo> scriptInfo;
     
+    std::optional<DataMethod> dataMethod;
+    
     FilePosition filePos;
     
     std::optional<TransactionStatus> status;
@@ -164,6 +207,9 @@ struct TransactionInfo {
     
     bool isInitialized = false;
     
+    //c Заполнены ли fromAddress, dataMethod, delegate и scriptInfo->isInitializeScript. См. readTransactionDetails
+    bool isDetailsRead = false;
+    
     void serialize(std::vector<char> &buffer) const;
     
     static TransactionInfo deserialize(const std::string &raw);
@@ -247,7 +293,14 @@ struct BlockInfo {
     
     BlockTimes times;
     
-    std::vector<TransactionInfo> txs;
+    std::pmr::vector<TransactionInfo> txs;
+    
+    BlockInfo() = default;
+    
+    //c Массив txs берет память из resource, поля самих транзакций - из общей кучи. См. BlockPool
+    explicit BlockInfo(std::pmr::memory_resource *resource)
+        : txs(resource)
+    {}
 
     std::vector<TransactionInfo> getBlockSignatures() const;
 };
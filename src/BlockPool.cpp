@@ -0,0 +1,121 @@
+#include "BlockPool.h"
+
+#include <memory_resource>
+#include <optional>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+#include "BlockInfo.h"
+#include "BlockDump.h"
+
+namespace torrent_node_lib {
+
+//c Буферы больше этого в пул не возвращаются, чтобы один огромный блок не держал память навсегда
+const static size_t MAX_ARENA_BUFFER_SIZE = 64 * 1024 * 1024;
+const static size_t MAX_DUMP_CAPACITY = 64 * 1024 * 1024;
+
+const static size_t INITIAL_ARENA_BUFFER_SIZE = 64 * 1024;
+
+struct BlockPool::Arena {
+    std::unique_ptr<char[]> buffer;
+    size_t bufferSize = 0;
+
+    std::optional<std::pmr::monotonic_buffer_resource> resource;
+
+    std::optional<BlockInfo> bi;
+};
+
+struct BlockPool::Pools {
+    const size_t maxFreeBlocks;
+    const size_t maxFreeDumps;
+
+    std::mutex mut;
+    std::vector<std::unique_ptr<Arena>> freeArenas;
+    std::vector<std::unique_ptr<BlockDump>> freeDumps;
+
+    Pools(size_t maxFreeBlocks, size_t maxFreeDumps)
+        : maxFreeBlocks(maxFreeBlocks)
+        , maxFreeDumps(maxFreeDumps)
+    {}
+};
+
+BlockPool::BlockPool(size_t maxFreeBlocks, size_t maxFreeDumps)
+    : pools(std::make_shared<Pools>(maxFreeBlocks, maxFreeDumps))
+{}
+
+void BlockPool::releaseArena(const std::shared_ptr<Pools> &pools, std::unique_ptr<Arena> arena) {
+    const BlockInfo &bi = arena->bi.value();
+    const size_t usedSize = bi.txs.capacity() * sizeof(TransactionInfo) + alignof(std::max_align_t);
+
+    //c Сначала разрушаются транзакции (их строки возвращаются в общую кучу), потом арена отдает память массива txs разом
+    arena->bi.reset();
+    arena->resource.reset();
+
+    if (usedSize > arena->bufferSize) {
+        //c Следующий блок такого же размера поместится в буфер целиком
+        const size_t newSize = std::min(usedSize + usedSize / 8, MAX_ARENA_BUFFER_SIZE);
+        if (newSize > arena->bufferSize) {
+            arena->buffer = std::make_unique<char[]>(newSize);
+            arena->bufferSize = newSize;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(pools->mut);
+    if (pools->freeArenas.size() < pools->maxFreeBlocks) {
+        pools->freeArenas.emplace_back(std::move(arena));
+    }
+}
+
+std::shared_ptr<BlockInfo> BlockPool::getBlockInfo() {
+    std::unique_ptr<Arena> arena;
+    {
+        std::lock_guard<std::mutex> lock(pools->mut);
+        if (!pools->freeArenas.empty()) {
+            arena = std::move(pools->freeArenas.back());
+            pools->freeArenas.pop_back();
+        }
+    }
+    if (arena == nullptr) {
+        arena = std::make_unique<Arena>();
+        arena->buffer = std::make_unique<char[]>(INITIAL_ARENA_BUFFER_SIZE);
+        arena->bufferSize = INITIAL_ARENA_BUFFER_SIZE;
+    }
+
+    arena->resource.emplace(arena->buffer.get(), arena->bufferSize);
+    arena->bi.emplace(&arena->resource.value());
+
+    BlockInfo *bi = &arena->bi.value();
+    return std::shared_ptr<BlockInfo>(bi, [pools=pools, arena=arena.release()](BlockInfo*) {
+        releaseArena(pools, std::unique_ptr<Arena>(arena));
+    });
+}
+
+std::shared_ptr<BlockDump> BlockPool::getDump() {
+    std::unique_ptr<BlockDump> dump;
+    {
+        std::lock_guard<std::mutex> lock(pools->mut);
+        if (!pools->freeDumps.empty()) {
+            dump = std::move(pools->freeDumps.back());
+            pools->freeDumps.pop_back();
+        }
+    }
+    if (dump == nullptr) {
+        dump = std::make_unique<BlockDump>();
+    }
+
+    return std::shared_ptr<BlockDump>(dump.release(), [pools=pools](BlockDump *dump) {
+        std::unique_ptr<BlockDump> holder(dump);
+        if (holder->buffer.capacity() > MAX_DUMP_CAPACITY) {
+            return;
+        }
+        holder->clear();
+
+        std::lock_guard<std::mutex> lock(pools->mut);
+        if (pools->freeDumps.size() < pools->maxFreeDumps) {
+            pools->freeDumps.emplace_back(std::move(holder));
+        }
+    });
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef BLOCK_POOL_H_
+#define BLOCK_POOL_H_
+
+#include <memory>
+#include <string>
+
+namespace torrent_node_lib {
+
+struct BlockInfo;
+struct BlockDump;
+
+/**
+ *c Переиспользуемые BlockInfo и буферы дампов для цикла синхронизации.
+ *c Массив транзакций каждого BlockInfo (txs) лежит в своей монотонной арене, которая освобождается целиком, когда отпускается последняя ссылка на блок.
+ *c Строки и векторы внутри TransactionInfo (hash, адреса, data, dataMethod, имя файла) и заголовок блока арена не покрывает, они по-прежнему в общей куче.
+ *c После освобождения арена и дамп возвращаются в пул вместе с уже выделенной памятью, так что массив транзакций и буфер дампа следующего блока обычно не ходят в общий аллокатор.
+ *c Возвращенные объекты переживают сам пул. Копии пула делят одни и те же свободные объекты
+ */
+class BlockPool {
+public:
+
+    BlockPool(size_t maxFreeBlocks, size_t maxFreeDumps);
+
+    std::shared_ptr<BlockInfo> getBlockInfo();
+
+    std::shared_ptr<BlockDump> getDump();
+
+private:
+
+    struct Arena;
+
+    struct Pools;
+
+    static void releaseArena(const std::shared_ptr<Pools> &pools, std::unique_ptr<Arena> arena);
+
+private:
+
+    std::shared_ptr<Pools> pools;
+};
+
+}
+
+#endif // BLOCK_POOL_H_
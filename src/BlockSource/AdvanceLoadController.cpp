@@ -0,0 +1,106 @@
+#include "AdvanceLoadController.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace torrent_node_lib {
+
+const static size_t MIN_INFLIGHT_BYTES = 1 * 1024 * 1024;
+const static size_t MAX_INFLIGHT_BYTES = 64 * 1024 * 1024;
+
+const static size_t MIN_REQUEST_BYTES = 100 * 1000;
+const static size_t MAX_REQUEST_BYTES = 16 * 1024 * 1024;
+
+//c Сервер отдает не больше 1000 блоков за запрос
+const static size_t MAX_ADVANCE_BLOCKS = 1000;
+
+//c Чтобы запросы пачки расходились по нескольким серверам
+const static size_t MIN_PARALLEL_REQUESTS = 4;
+
+const static double PROBE_GAIN = 2.;
+
+//c Коэффициенты забывания максимума скорости и минимума задержки за одно измерение.
+//c Время запроса включает и передачу, поэтому минимум задержки берется в основном с первых запросов маленьким окном и забывается медленно
+const static double BANDWIDTH_DECAY = 0.98;
+const static double LATENCY_DECAY = 1.001;
+
+const static double BLOCK_SIZE_EWMA = 0.1;
+
+AdvanceLoadController::AdvanceLoadController(size_t initialAdvanceBlocks, size_t initialBatchBlocks)
+    : advanceBlocks(std::max<size_t>(initialAdvanceBlocks, 1))
+    , batchBlocks(std::max<size_t>(initialBatchBlocks, 1))
+    , maxBlockSizeWithoutAdvance(MIN_REQUEST_BYTES)
+{}
+
+void AdvanceLoadController::addMeasure(size_t bytes, size_t countParts, size_t countServers, const milliseconds &elapsed) {
+    if (bytes == 0 || countParts == 0) {
+        return;
+    }
+    const double elapsedMs = std::max<double>(elapsed.count(), 1.);
+    const double bytesPerSecond = bytes * 1000. / elapsedMs;
+    //c Части распределяются по серверам, на каждом сервере выполняются по очереди
+    const double rounds = std::ceil(double(countParts) / std::max<size_t>(countServers, 1));
+    const double latencyMs = elapsedMs / rounds;
+    
+    std::lock_guard<std::mutex> lock(mut);
+    maxBytesPerSecond = std::max(bytesPerSecond, maxBytesPerSecond * BANDWIDTH_DECAY);
+    if (minLatencyMs == 0) {
+        minLatencyMs = latencyMs;
+    } else {
+        minLatencyMs = std::min(latencyMs, minLatencyMs * LATENCY_DECAY);
+    }
+    recalc();
+}
+
+void AdvanceLoadController::addBlockSize(size_t blockSize) {
+    std::lock_guard<std::mutex> lock(mut);
+    if (avgBlockSize == 0) {
+        avgBlockSize = blockSize;
+    } else {
+        avgBlockSize += (blockSize - avgBlockSize) * BLOCK_SIZE_EWMA;
+    }
+}
+
+void AdvanceLoadController::recalc() {
+    if (maxBytesPerSecond == 0 || minLatencyMs == 0 || avgBlockSize == 0) {
+        return;
+    }
+    const double bdp = maxBytesPerSecond * minLatencyMs / 1000.;
+    const double inflightBytes = std::clamp(PROBE_GAIN * bdp, double(MIN_INFLIGHT_BYTES), double(MAX_INFLIGHT_BYTES));
+    const double requestBytes = std::clamp(bdp, double(MIN_REQUEST_BYTES), double(MAX_REQUEST_BYTES));
+    
+    advanceBlocks = std::clamp<size_t>(inflightBytes / avgBlockSize, 1, MAX_ADVANCE_BLOCKS);
+    const size_t batchByBytes = std::max<size_t>(requestBytes / avgBlockSize, 1);
+    const size_t batchByParallel = (advanceBlocks + MIN_PARALLEL_REQUESTS - 1) / MIN_PARALLEL_REQUESTS;
+    batchBlocks = std::min(batchByBytes, batchByParallel);
+    maxBlockSizeWithoutAdvance = requestBytes;
+}
+
+size_t AdvanceLoadController::getAdvanceBlocks() const {
+    std::lock_guard<std::mutex> lock(mut);
+    return advanceBlocks;
+}
+
+size_t AdvanceLoadController::getBatchBlocks() const {
+    std::lock_guard<std::mutex> lock(mut);
+    return batchBlocks;
+}
+
+size_t AdvanceLoadController::getMaxBlockSizeWithoutAdvance() const {
+    std::lock_guard<std::mutex> lock(mut);
+    return maxBlockSizeWithoutAdvance;
+}
+
+AdvanceLoadStatistic AdvanceLoadController::getStatistic() const {
+    std::lock_guard<std::mutex> lock(mut);
+    AdvanceLoadStatistic stat;
+    stat.advanceBlocks = advanceBlocks;
+    stat.batchBlocks = batchBlocks;
+    stat.maxBlockSizeWithoutAdvance = maxBlockSizeWithoutAdvance;
+    stat.bytesPerSecond = maxBytesPerSecond;
+    stat.latencyMs = minLatencyMs;
+    stat.avgBlockSize = avgBlockSize;
+    return stat;
+}
+
+}
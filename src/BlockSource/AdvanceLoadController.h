@@ -0,0 +1,72 @@
+#ifndef ADVANCE_LOAD_CONTROLLER_H_
+#define ADVANCE_LOAD_CONTROLLER_H_
+
+#include <mutex>
+#include <vector>
+
+#include "duration.h"
+
+#include "P2P/P2P.h"
+
+namespace torrent_node_lib {
+
+struct AdvanceLoadStatistic {
+    size_t windowBlocks = 0;
+    size_t advanceBlocks = 0;
+    size_t batchBlocks = 0;
+    size_t maxBlockSizeWithoutAdvance = 0;
+    size_t bytesPerSecond = 0;
+    size_t latencyMs = 0;
+    size_t avgBlockSize = 0;
+    
+    std::vector<PeerStatistic> peers;
+};
+
+/**
+ *c Подбирает глубину предзагрузки, размер пачки блоков в одном запросе и порог размера блока для отдельной загрузки.
+ *c Как окно TCP: в полете держится около PROBE_GAIN * bandwidth * latency байт.
+ *c bandwidth - максимум измеренной скорости, latency - минимум измеренной задержки, оба медленно забываются.
+ *c Пока измерений нет, используются значения из конфига
+ */
+class AdvanceLoadController {
+public:
+    
+    AdvanceLoadController(size_t initialAdvanceBlocks, size_t initialBatchBlocks);
+    
+    //c Один параллельный запрос пачки: bytes получено за elapsed, частей countParts, серверов countServers
+    void addMeasure(size_t bytes, size_t countParts, size_t countServers, const milliseconds &elapsed);
+    
+    void addBlockSize(size_t blockSize);
+    
+    size_t getAdvanceBlocks() const;
+    
+    size_t getBatchBlocks() const;
+    
+    size_t getMaxBlockSizeWithoutAdvance() const;
+    
+    AdvanceLoadStatistic getStatistic() const;
+    
+private:
+    
+    void recalc();
+    
+private:
+    
+    mutable std::mutex mut;
+    
+    double maxBytesPerSecond = 0;
+    
+    double minLatencyMs = 0;
+    
+    double avgBlockSize = 0;
+    
+    size_t advanceBlocks;
+    
+    size_t batchBlocks;
+    
+    size_t maxBlockSizeWithoutAdvance;
+};
+
+}
+
+#endif // ADVANCE_LOAD_CONTROLLER_H_
@@ -2,11 +2,18 @@
 #define BLOCK_SOURCE_H_
 
 #include <string>
+#include <optional>
+#include <memory>
+
+#include "AdvanceLoadController.h"
+#include "Modules.h"
+#include "duration.h"
 
 namespace torrent_node_lib {
 
 struct BlockInfo;
 struct BlockHeader;
+struct BlockDump;
 
 class BlockSource {
 public:
@@ -17,12 +24,30 @@ public:
     
     virtual size_t knownBlock() = 0;
     
-    virtual bool process(BlockInfo &bi, std::string &binaryDump) = 0;
+    //c bi и binaryDump взяты из BlockPool. Источник заполняет их или подменяет своими, уже разобранными объектами из того же пула
+    virtual bool process(std::shared_ptr<BlockInfo> &bi, std::shared_ptr<BlockDump> &binaryDump) = 0;
+    
+    virtual void getExistingBlock(const BlockHeader &bh, BlockInfo &bi, BlockDump &blockDump) const = 0;
+    
+    //c Пауза между вызовами doProcess. Источник может закончить ее раньше, если узнал о новом блоке
+    virtual void waitNewBlocks(size_t countBlocks, const milliseconds &pending) {
+        sleepMs(pending);
+    }
     
-    virtual void getExistingBlock(const BlockHeader &bh, BlockInfo &bi, std::string &blockDump) const = 0;
+    //c Параметры предзагрузки блоков из сети для статистики. У источников без сети их нет
+    virtual std::optional<AdvanceLoadStatistic> getAdvanceLoadStatistic() const {
+        return std::nullopt;
+    }
     
     virtual ~BlockSource() = default;
     
+protected:
+    
+    //c Адрес отправителя и json из data нужны только при проверке блока и модулям users и node_test, остальным хватает облегченного разбора
+    static bool isReadTxsDetails(bool isValidate) {
+        return isValidate || modules[MODULE_USERS] || modules[MODULE_NODE_TEST];
+    }
+    
 };
 
 }
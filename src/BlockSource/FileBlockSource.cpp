@@ -1,6 +1,8 @@
 #include "FileBlockSource.h"
 
 #include "BlockchainRead.h"
+#include "BlockDump.h"
+#include "utils/ReadOnlyFile.h"
 #include "LevelDb.h"
 
 #include "log.h"
@@ -28,18 +30,27 @@ size_t FileBlockSource::knownBlock() {
     return 0;
 }
 
-bool FileBlockSource::process(BlockInfo &bi, std::string &binaryDump) {
+bool FileBlockSource::process(std::shared_ptr<BlockInfo> &biPtr, std::shared_ptr<BlockDump> &binaryDumpPtr) {
+    BlockInfo &bi = *biPtr;
+    BlockDump &binaryDump = *binaryDumpPtr;
     if (fileName.empty()) {
         const FileInfo fi = getNextFile(allFiles, folderPath);
         fileName = fi.filePos.fileName;
         if (fileName.empty()) {
             return false;
         }
-        openFile(file, fileName);
+        if (!isMappedBlockFiles()) {
+            openFile(file, fileName);
+        }
         currPos = fi.filePos.pos;
         LOGINFO << "Open next file " << fileName << " " << currPos;
     }
-    const size_t nextCurrPos = readNextBlockInfo(file, currPos, bi, binaryDump, isValidate, false, 0, 0);
+    size_t nextCurrPos;
+    if (isMappedBlockFiles()) {
+        nextCurrPos = readNextBlockInfo(fileName, FileAccessPattern::Sequential, currPos, bi, binaryDump.mapped, isValidate, false, 0, 0, isReadTxsDetails(isValidate));
+    } else {
+        nextCurrPos = readNextBlockInfo(file, currPos, bi, binaryDump.buffer, isValidate, false, 0, 0, isReadTxsDetails(isValidate));
+    }
     if (currPos == nextCurrPos) {
         closeFile(file);
         fileName.clear();
@@ -58,11 +69,16 @@ bool FileBlockSource::process(BlockInfo &bi, std::string &binaryDump) {
     return true;
 }
 
-void FileBlockSource::getExistingBlockS(const BlockHeader& bh, BlockInfo& bi, std::string &blockDump, bool isValidate) {
+void FileBlockSource::getExistingBlockS(const BlockHeader& bh, BlockInfo& bi, BlockDump &blockDump, bool isValidate) {
     CHECK(!bh.filePos.fileName.empty(), "Incorrect file name");
-    std::ifstream file;
-    openFile(file, bh.filePos.fileName);
-    const size_t nextCurrPos = readNextBlockInfo(file, bh.filePos.pos, bi, blockDump, isValidate, false, 0, 0);
+    size_t nextCurrPos;
+    if (isMappedBlockFiles()) {
+        //c Используется при повторном проходе по блокам подряд
+        nextCurrPos = readNextBlockInfo(bh.filePos.fileName, FileAccessPattern::Sequential, bh.filePos.pos, bi, blockDump.mapped, isValidate, false, 0, 0, isReadTxsDetails(isValidate));
+    } else {
+        const std::shared_ptr<const ReadOnlyFile> file = getReadOnlyFile(bh.filePos.fileName);
+        nextCurrPos = readNextBlockInfo(*file, bh.filePos.pos, bi, blockDump.buffer, isValidate, false, 0, 0, isReadTxsDetails(isValidate));
+    }
     CHECK(nextCurrPos != bh.filePos.pos, "File incorrect");
     bi.header.filePos.fileName = bh.filePos.fileName;
     for (auto &tx : bi.txs) {
@@ -72,7 +88,7 @@ void FileBlockSource::getExistingBlockS(const BlockHeader& bh, BlockInfo& bi, st
     bi.header.blockNumber = bh.blockNumber;
 }
 
-void FileBlockSource::getExistingBlock(const BlockHeader& bh, BlockInfo& bi, std::string &blockDump) const {
+void FileBlockSource::getExistingBlock(const BlockHeader& bh, BlockInfo& bi, BlockDump &blockDump) const {
     getExistingBlockS(bh, bi, blockDump, isValidate);
 }
 
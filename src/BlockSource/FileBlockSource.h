@@ -27,11 +27,11 @@ public:
     
     size_t knownBlock() override;
     
-    bool process(BlockInfo &bi, std::string &binaryDump) override;
+    bool process(std::shared_ptr<BlockInfo> &biPtr, std::shared_ptr<BlockDump> &binaryDumpPtr) override;
     
-    static void getExistingBlockS(const BlockHeader &bh, BlockInfo &bi, std::string &blockDump, bool isValidate);
+    static void getExistingBlockS(const BlockHeader &bh, BlockInfo &bi, BlockDump &blockDump, bool isValidate);
     
-    void getExistingBlock(const BlockHeader &bh, BlockInfo &bi, std::string &blockDump) const override;
+    void getExistingBlock(const BlockHeader &bh, BlockInfo &bi, BlockDump &blockDump) const override;
     
     ~FileBlockSource() override = default;
     
@@ -12,6 +12,7 @@ using namespace std::placeholders;
 #include "check.h"
 #include "log.h"
 #include "jsonUtils.h"
+#include "duration.h"
 
 using namespace common;
 
@@ -19,7 +20,20 @@ namespace torrent_node_lib {
 
 const static size_t ESTIMATE_SIZE_SIGNATURE = 250;
 
-const static size_t MAX_BLOCK_SIZE_WITHOUT_ADVANCE = 100 * 1000;
+//c Сервер отдает не больше 1000 заголовков в одном get-blocks
+const static size_t HEADERS_BATCH_BLOCKS = 500;
+
+size_t GetNewBlocksFromServer::parseCountBlocksResponse(const std::string &result) {
+    rapidjson::Document doc;
+    const rapidjson::ParseResult pr = doc.Parse(result.c_str());
+    CHECK(pr, "rapidjson parse error. Data: " + result);
+    
+    CHECK(!doc.HasMember("error") || doc["error"].IsNull(), jsonToString(doc["error"], false));
+    CHECK(doc.HasMember("result") && doc["result"].IsObject(), "result field not found");
+    const auto &resultJson = doc["result"];
+    CHECK(resultJson.HasMember("count_blocks") && resultJson["count_blocks"].IsInt(), "count_blocks field not found");
+    return resultJson["count_blocks"].GetInt();
+}
 
 GetNewBlocksFromServer::LastBlockResponse GetNewBlocksFromServer::getLastBlock() const {
     std::optional<size_t> lastBlock;
@@ -34,15 +48,7 @@ GetNewBlocksFromServer::LastBlockResponse GetNewBlocksFromServer::getLastBlock()
         }
         
         try {
-            rapidjson::Document doc;
-            const rapidjson::ParseResult pr = doc.Parse(result.c_str());
-            CHECK(pr, "rapidjson parse error. Data: " + result);
-            
-            CHECK(!doc.HasMember("error") || doc["error"].IsNull(), jsonToString(doc["error"], false));
-            CHECK(doc.HasMember("result") && doc["result"].IsObject(), "result field not found");
-            const auto &resultJson = doc["result"];
-            CHECK(resultJson.HasMember("count_blocks") && resultJson["count_blocks"].IsInt(), "count_blocks field not found");
-            const size_t countBlocks = resultJson["count_blocks"].GetInt();
+            const size_t countBlocks = parseCountBlocksResponse(result);
             
             std::lock_guard<std::mutex> lock(mut);
             if (!lastBlock.has_value()) {
@@ -73,11 +79,39 @@ GetNewBlocksFromServer::LastBlockResponse GetNewBlocksFromServer::getLastBlock()
     return response;
 }
 
+size_t GetNewBlocksFromServer::waitCountBlocks(const std::string &server, size_t after, const milliseconds &timeout) const {
+    const std::string response = p2p.runLongPollRequest(server, "wait-count-blocks", "{\"id\": 1, \"params\": {\"after\": " + std::to_string(after) + ", \"timeout\": " + std::to_string(timeout.count()) + "}}", "");
+    return parseCountBlocksResponse(response);
+}
+
 void GetNewBlocksFromServer::clearAdvanced() {
     advancedLoadsBlocksHeaders.clear();
     advancedLoadsBlocksDumps.clear();
 }
 
+size_t GetNewBlocksFromServer::getAdvanceBlocks() const {
+    return advanceLoadController.getAdvanceBlocks();
+}
+
+AdvanceLoadStatistic GetNewBlocksFromServer::getAdvanceLoadStatistic() const {
+    AdvanceLoadStatistic stat = advanceLoadController.getStatistic();
+    stat.peers = p2p.getPeersStatistic();
+    return stat;
+}
+
+std::string GetNewBlocksFromServer::getBestServer(const std::vector<std::string> &servers) const {
+    return p2p.getBestServer(servers);
+}
+
+template<typename Answers>
+static size_t sizeAnswers(const Answers &answers) {
+    size_t size = 0;
+    for (const auto &answer: answers) {
+        size += answer.size();
+    }
+    return size;
+}
+
 MinimumBlockHeader GetNewBlocksFromServer::getBlockHeader(size_t blockNum, size_t maxBlockNum, const std::string &server) const {
     const auto foundBlock = std::find_if(advancedLoadsBlocksHeaders.begin(), advancedLoadsBlocksHeaders.end(), [blockNum](const auto &pair) {
         return pair.first == blockNum;
@@ -88,26 +122,31 @@ MinimumBlockHeader GetNewBlocksFromServer::getBlockHeader(size_t blockNum, size_
     
     advancedLoadsBlocksHeaders.clear();
     
+    const size_t maxAdvancedLoadBlocks = advanceLoadController.getAdvanceBlocks();
+    const size_t countBlocksInBatch = advanceLoadController.getBatchBlocks();
     const size_t countBlocks = std::min(maxBlockNum - blockNum + 1, maxAdvancedLoadBlocks);
     const size_t countParts = (countBlocks + countBlocksInBatch - 1) / countBlocksInBatch;
     CHECK(countBlocks != 0 && countParts != 0, "Incorrect count blocks");
-    const auto makeQsAndPost = [blockNum, countBlocksInBatch=this->countBlocksInBatch, maxCountBlocks=countBlocks](size_t number) {
+    const auto makeQsAndPost = [blockNum, countBlocksInBatch, maxCountBlocks=countBlocks](size_t number) {
         const size_t beginBlock = blockNum + number * countBlocksInBatch;
         const size_t countBlocks = std::min(countBlocksInBatch, maxCountBlocks - number * countBlocksInBatch);
         if (countBlocks != 1) {
             return std::make_pair("get-blocks", "{\"id\":1,\"params\":{\"beginBlock\": " + std::to_string(beginBlock) + ", \"countBlocks\": " + std::to_string(countBlocks) + ", \"type\": \"forP2P\", \"direction\": \"forward\"}}");
         } else {
-            return std::make_pair("get-block-by-number", "{\"id\":1,\"params\":{\"number\": " + std::to_string(blockNum + number) + ", \"type\": \"forP2P\"}}");
+            return std::make_pair("get-block-by-number", "{\"id\":1,\"params\":{\"number\": " + std::to_string(beginBlock) + ", \"type\": \"forP2P\"}}");
         }
     };
     
-    const std::vector<std::string> answer = p2p.requests(countParts, makeQsAndPost, "", [](const std::string &result) {
+    Timer tt;
+    const std::vector<std::string> answer = p2p.requests(countParts, countBlocksInBatch, makeQsAndPost, "", [](const std::string &result) {
         ResponseParse r;
         r.response = result;
         return r;
     }, {server});
+    tt.stop();
     
     CHECK(answer.size() == countParts, "Incorrect answer");
+    advanceLoadController.addMeasure(sizeAnswers(answer), countParts, 1, tt.count());
     
     for (size_t i = 0; i < answer.size(); i++) {
         const size_t currBlockNum = blockNum + i * countBlocksInBatch;
@@ -123,6 +162,9 @@ MinimumBlockHeader GetNewBlocksFromServer::getBlockHeader(size_t blockNum, size_
             advancedLoadsBlocksHeaders.emplace_back(currBlockNum, parseBlockHeader(answer[i]));
         }
     }
+    for (const auto &pair: advancedLoadsBlocksHeaders) {
+        advanceLoadController.addBlockSize(pair.second.blockSize);
+    }
     
     return advancedLoadsBlocksHeaders.front().second;
 }
@@ -181,37 +223,16 @@ std::string GetNewBlocksFromServer::getBlockDumpWithoutAdvancedLoad(const std::s
     }
 }
 
-std::string GetNewBlocksFromServer::getBlockDump(const std::string& blockHash, size_t blockSize, const std::vector<std::string> &hintsServers, bool isSign) const {
-    const auto foundDump = advancedLoadsBlocksDumps.find(blockHash);
-    if (foundDump != advancedLoadsBlocksDumps.end()) {
-        return foundDump->second;
-    }
-       
-    if (blockSize > MAX_BLOCK_SIZE_WITHOUT_ADVANCE) {
-        return getBlockDumpWithoutAdvancedLoad(blockHash, blockSize, hintsServers, isSign);
-    }
-    
-    advancedLoadsBlocksDumps.clear();
-    
-    const auto foundHeader = std::find_if(advancedLoadsBlocksHeaders.begin(), advancedLoadsBlocksHeaders.end(), [&blockHash](const auto &pair) {
-        return pair.second.hash == blockHash;
-    });
-   
-    std::vector<std::string> blocksHashs;
-    for (auto iterHeader = foundHeader ; iterHeader != advancedLoadsBlocksHeaders.end() && iterHeader->second.blockSize <= MAX_BLOCK_SIZE_WITHOUT_ADVANCE; iterHeader++) {
-        blocksHashs.emplace_back(iterHeader->second.hash);
-    }
-    
-    CHECK(!blocksHashs.empty(), "advanced blocks not loaded");
-    
+std::vector<std::string> GetNewBlocksFromServer::requestDumps(const std::vector<std::string> &blocksHashs, const std::vector<std::string> &hintsServers, bool isSign) const {
+    const size_t countBlocksInBatch = advanceLoadController.getBatchBlocks();
     const size_t countParts = (blocksHashs.size() + countBlocksInBatch - 1) / countBlocksInBatch;
     
-    const auto makeQsAndPost = [&blocksHashs, isSign, countBlocksInBatch=this->countBlocksInBatch, isCompress=this->isCompress](size_t number) {
+    const auto makeQsAndPost = [&blocksHashs, isSign, countBlocksInBatch, isCompress=this->isCompress](size_t number) {
         CHECK(blocksHashs.size() > number * countBlocksInBatch, "Incorrect number");
         const size_t beginBlock = number * countBlocksInBatch;
         const size_t countBlocks = std::min(countBlocksInBatch, blocksHashs.size() - number * countBlocksInBatch);
         if (countBlocks == 1) {
-            return std::make_pair("get-dump-block-by-hash", "{\"id\":1,\"params\":{\"hash\": \"" + blocksHashs[number] + "\" , \"isHex\": false, " + 
+            return std::make_pair("get-dump-block-by-hash", "{\"id\":1,\"params\":{\"hash\": \"" + blocksHashs[beginBlock] + "\" , \"isHex\": false, " + 
                 "\"isSign\": " + (isSign ? "true" : "false") + 
                 ", \"compress\": " + (isCompress ? "true" : "false") + 
                 "}}");
@@ -228,34 +249,131 @@ std::string GetNewBlocksFromServer::getBlockDump(const std::string& blockHash, s
                 
                 isFirst = false;
             }
+            //c Новые серверы при compressStream сжимают ответ потоково, старые его не знают и сжимают через compress. parseDumpBlocksBinary различает оба формата
             r += std::string("], \"isSign\": ") + (isSign ? "true" : "false") + 
             ", \"compress\": " + (isCompress ? "true" : "false") + 
+            ", \"compressStream\": " + (isCompress ? "true" : "false") + 
             "}}";
             
             return std::make_pair("get-dumps-blocks-by-hash", r);
         }
     };
     
-    const std::vector<std::string> responses = p2p.requests(countParts, makeQsAndPost, "", parseDumpBlockResponse, hintsServers);
+    Timer tt;
+    const std::vector<std::string> responses = p2p.requests(countParts, countBlocksInBatch, makeQsAndPost, "", parseDumpBlockResponse, hintsServers);
+    tt.stop();
     CHECK(responses.size() == countParts, "Incorrect responses");
+    advanceLoadController.addMeasure(sizeAnswers(responses), countParts, hintsServers.size(), tt.count());
     
+    std::vector<std::string> dumps;
+    dumps.reserve(blocksHashs.size());
     for (size_t i = 0; i < responses.size(); i++) {
         const size_t beginBlock = i * countBlocksInBatch;
         const size_t blocksInPart = std::min(countBlocksInBatch, blocksHashs.size() - i * countBlocksInBatch);
         
         if (blocksInPart == 1) {
-            advancedLoadsBlocksDumps[blocksHashs[i]] = parseDumpBlockBinary(responses[i], isCompress);
+            dumps.emplace_back(parseDumpBlockBinary(responses[i], isCompress));
         } else {
-            const std::vector<std::string> blocks = parseDumpBlocksBinary(responses[i], isCompress);
+            std::vector<std::string> blocks = parseDumpBlocksBinary(responses[i], isCompress);
             CHECK(blocks.size() == blocksInPart, "Incorrect answer");
             CHECK(beginBlock + blocks.size() <= blocksHashs.size(), "Incorrect answer");
-            for (size_t j = 0; j < blocks.size(); j++) {
-                advancedLoadsBlocksDumps[blocksHashs[beginBlock + j]] = blocks[j];
+            for (std::string &block: blocks) {
+                dumps.emplace_back(std::move(block));
             }
         }
     }
+    return dumps;
+}
+
+std::string GetNewBlocksFromServer::getBlockDump(const std::string& blockHash, size_t blockSize, const std::vector<std::string> &hintsServers, bool isSign) const {
+    const auto foundDump = advancedLoadsBlocksDumps.find(blockHash);
+    if (foundDump != advancedLoadsBlocksDumps.end()) {
+        return foundDump->second;
+    }
+       
+    const size_t maxBlockSizeWithoutAdvance = advanceLoadController.getMaxBlockSizeWithoutAdvance();
+    if (blockSize > maxBlockSizeWithoutAdvance) {
+        return getBlockDumpWithoutAdvancedLoad(blockHash, blockSize, hintsServers, isSign);
+    }
+    
+    advancedLoadsBlocksDumps.clear();
+    
+    const auto foundHeader = std::find_if(advancedLoadsBlocksHeaders.begin(), advancedLoadsBlocksHeaders.end(), [&blockHash](const auto &pair) {
+        return pair.second.hash == blockHash;
+    });
+   
+    std::vector<std::string> blocksHashs;
+    for (auto iterHeader = foundHeader ; iterHeader != advancedLoadsBlocksHeaders.end() && iterHeader->second.blockSize <= maxBlockSizeWithoutAdvance; iterHeader++) {
+        blocksHashs.emplace_back(iterHeader->second.hash);
+    }
+    
+    CHECK(!blocksHashs.empty(), "advanced blocks not loaded");
+    
+    const std::vector<std::string> dumps = requestDumps(blocksHashs, hintsServers, isSign);
+    for (size_t i = 0; i < dumps.size(); i++) {
+        advancedLoadsBlocksDumps[blocksHashs[i]] = dumps[i];
+    }
     
     return advancedLoadsBlocksDumps[blockHash];
 }
 
+std::vector<MinimumBlockHeader> GetNewBlocksFromServer::getBlocksHeaders(size_t fromBlock, size_t countBlocks, const std::vector<std::string> &hintsServers) const {
+    CHECK(countBlocks != 0, "Incorrect count blocks");
+    const size_t countParts = (countBlocks + HEADERS_BATCH_BLOCKS - 1) / HEADERS_BATCH_BLOCKS;
+    const auto makeQsAndPost = [fromBlock, maxCountBlocks=countBlocks](size_t number) {
+        const size_t beginBlock = fromBlock + number * HEADERS_BATCH_BLOCKS;
+        const size_t countBlocks = std::min(HEADERS_BATCH_BLOCKS, maxCountBlocks - number * HEADERS_BATCH_BLOCKS);
+        return std::make_pair("get-blocks", "{\"id\":1,\"params\":{\"beginBlock\": " + std::to_string(beginBlock) + ", \"countBlocks\": " + std::to_string(countBlocks) + ", \"type\": \"forP2P\", \"direction\": \"forward\"}}");
+    };
+    
+    Timer tt;
+    const std::vector<std::string> answers = p2p.requests(countParts, HEADERS_BATCH_BLOCKS, makeQsAndPost, "", [](const std::string &result) {
+        ResponseParse r;
+        r.response = result;
+        return r;
+    }, hintsServers);
+    tt.stop();
+    CHECK(answers.size() == countParts, "Incorrect answer");
+    advanceLoadController.addMeasure(sizeAnswers(answers), countParts, hintsServers.size(), tt.count());
+    
+    std::vector<MinimumBlockHeader> headers;
+    headers.reserve(countBlocks);
+    for (size_t i = 0; i < answers.size(); i++) {
+        const size_t blocksInPart = std::min(HEADERS_BATCH_BLOCKS, countBlocks - i * HEADERS_BATCH_BLOCKS);
+        std::vector<MinimumBlockHeader> blocks = parseBlocksHeader(answers[i]);
+        CHECK(blocks.size() == blocksInPart, "Incorrect answers");
+        for (MinimumBlockHeader &block: blocks) {
+            CHECK(block.number == fromBlock + headers.size(), "Incorrect block number in answer: " + std::to_string(block.number) + " " + std::to_string(fromBlock + headers.size()));
+            advanceLoadController.addBlockSize(block.blockSize);
+            headers.emplace_back(std::move(block));
+        }
+    }
+    return headers;
+}
+
+std::vector<std::string> GetNewBlocksFromServer::getBlocksDumps(const std::vector<MinimumBlockHeader> &headers, const std::vector<std::string> &hintsServers, bool isSign) const {
+    const size_t maxBlockSizeWithoutAdvance = advanceLoadController.getMaxBlockSizeWithoutAdvance();
+    
+    std::vector<std::string> dumps(headers.size());
+    std::vector<std::string> smallBlocksHashs;
+    std::vector<size_t> smallBlocksPositions;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (headers[i].blockSize > maxBlockSizeWithoutAdvance) {
+            dumps[i] = getBlockDumpWithoutAdvancedLoad(headers[i].hash, headers[i].blockSize, hintsServers, isSign);
+        } else {
+            smallBlocksHashs.emplace_back(headers[i].hash);
+            smallBlocksPositions.emplace_back(i);
+        }
+    }
+    
+    if (!smallBlocksHashs.empty()) {
+        std::vector<std::string> smallDumps = requestDumps(smallBlocksHashs, hintsServers, isSign);
+        CHECK(smallDumps.size() == smallBlocksPositions.size(), "Incorrect answer");
+        for (size_t i = 0; i < smallDumps.size(); i++) {
+            dumps[smallBlocksPositions[i]] = std::move(smallDumps[i]);
+        }
+    }
+    return dumps;
+}
+
 }
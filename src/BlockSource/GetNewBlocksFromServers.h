@@ -3,6 +3,8 @@
 
 #include "P2P/P2P.h"
 
+#include "AdvanceLoadController.h"
+
 namespace torrent_node_lib {
 
 struct MinimumBlockHeader;
@@ -24,16 +26,21 @@ public:
     
     static ResponseParse parseDumpBlockResponse(const std::string &result);
     
+    static size_t parseCountBlocksResponse(const std::string &result);
+    
 public:
     
+    //c maxAdvancedLoadBlocks и countBlocksInBatch - начальные значения, дальше их подбирает advanceLoadController
     GetNewBlocksFromServer(size_t maxAdvancedLoadBlocks, size_t countBlocksInBatch, const P2P &p2p, bool isCompress)
-        : maxAdvancedLoadBlocks(maxAdvancedLoadBlocks)
-        , countBlocksInBatch(countBlocksInBatch)
-        , p2p(p2p)
+        : p2p(p2p)
         , isCompress(isCompress)
+        , advanceLoadController(maxAdvancedLoadBlocks, countBlocksInBatch)
     {}
         
     LastBlockResponse getLastBlock() const;
+    
+    //c Long poll одного сервера: ответ приходит, когда у него блоков станет больше after, или через timeout
+    size_t waitCountBlocks(const std::string &server, size_t after, const milliseconds &timeout) const;
         
     MinimumBlockHeader getBlockHeader(size_t blockNum, size_t maxBlockNum, const std::string &server) const;
     
@@ -43,18 +50,37 @@ public:
     
     std::string getBlockDumpWithoutAdvancedLoad(const std::string &blockHash, size_t blockSize, const std::vector<std::string> &hintsServers, bool isSign) const;
     
+    /**
+     *c Для headers-first: заголовки блоков [fromBlock, fromBlock + countBlocks) и дампы по известным заголовкам.
+     *c Запросы идут параллельно ко всем hintsServers. Кэши предзагрузки не трогают, поэтому их можно вызывать из нескольких потоков
+     */
+    std::vector<MinimumBlockHeader> getBlocksHeaders(size_t fromBlock, size_t countBlocks, const std::vector<std::string> &hintsServers) const;
+    
+    //c Дампы в порядке headers
+    std::vector<std::string> getBlocksDumps(const std::vector<MinimumBlockHeader> &headers, const std::vector<std::string> &hintsServers, bool isSign) const;
+    
     void clearAdvanced();
     
+    size_t getAdvanceBlocks() const;
+    
+    AdvanceLoadStatistic getAdvanceLoadStatistic() const;
+    
+    //c Сервер с лучшей оценкой P2P, для запросов, которые идут на один сервер
+    std::string getBestServer(const std::vector<std::string> &servers) const;
+    
 private:
     
-    const size_t maxAdvancedLoadBlocks;
+    //c Маленькие блоки пачками по getBatchBlocks параллельно со всех hintsServers. Дампы в порядке blocksHashs
+    std::vector<std::string> requestDumps(const std::vector<std::string> &blocksHashs, const std::vector<std::string> &hintsServers, bool isSign) const;
     
-    const size_t countBlocksInBatch;
+private:
     
     const P2P &p2p;
     
     const bool isCompress;
     
+    mutable AdvanceLoadController advanceLoadController;
+    
     mutable std::vector<std::pair<size_t, MinimumBlockHeader>> advancedLoadsBlocksHeaders;
     
     mutable std::unordered_map<std::string, std::string> advancedLoadsBlocksDumps;
@@ -7,113 +7,535 @@
 #include "PrivateKey.h"
 #include "BlockchainRead.h"
 #include "BlockInfo.h"
-#include "parallel_for.h"
+#include "BlockDump.h"
+
+#include <algorithm>
+#include <set>
 
 using namespace common;
 
 namespace torrent_node_lib {
 
+//c Минимальный размер окна скачивания
 const static size_t COUNT_ADVANCED_BLOCKS = 8;
+
+const static size_t COUNT_PARSE_THREADS = 8;
+
+//c Тела качает один поток большими пачками. Пачка сама делится на запросы ко всем серверам сразу, а параллельные пачки
+//c только ждали бы друг друга: задача P2P::requests занимает поток соединения с сервером, пока не закончится вся пачка
+const static size_t BODIES_BATCH_MULTIPLIER = 4;
+
+//c Насколько заголовки забегают вперед записанных блоков. Заголовки маленькие, в памяти их можно держать много
+const static size_t HEADERS_AHEAD = 20000;
+
+const static size_t MAX_SUBSCRIBERS = 4;
+
+//c Меньше таймаута запроса в P2P
+const static milliseconds WAIT_COUNT_BLOCKS_TIMEOUT = 3s;
+
+const static milliseconds SUBSCRIBE_RETRY_PERIOD = 5s;
+
+//c Опрос всех серверов на случай потерянного уведомления, когда подписки работают
+const static milliseconds SUBSCRIBED_POLL_PERIOD = 3s;
     
-NetworkBlockSource::NetworkBlockSource(const std::string &folderPath, size_t maxAdvancedLoadBlocks, size_t countBlocksInBatch, bool isCompress, P2P &p2p, bool saveAllTx, bool isValidate, bool isVerifySign) 
+NetworkBlockSource::NetworkBlockSource(const std::string &folderPath, size_t maxAdvancedLoadBlocks, size_t countBlocksInBatch, bool isCompress, P2P &p2p, bool saveAllTx, bool isValidate, bool isVerifySign, bool isHeadersFirst, const BlockPool &blockPool) 
     : getterBlocks(maxAdvancedLoadBlocks, countBlocksInBatch, p2p, isCompress)
     , folderPath(folderPath)
     , saveAllTx(saveAllTx)
     , isValidate(isValidate)
     , isVerifySign(isVerifySign)
+    , isHeadersFirst(isHeadersFirst)
+    , blockPool(blockPool)
 {}
 
+NetworkBlockSource::~NetworkBlockSource() {
+    stopPipeline();
+    stopSubscribers();
+}
 
 void NetworkBlockSource::initialize() {
     createDirectories(folderPath);
 }
 
 std::pair<bool, size_t> NetworkBlockSource::doProcess(size_t countBlocks, const std::string &lastBlockHash) {
+    stopPipeline();
+    
     nextBlockToRead = countBlocks + 1;
+    //c У первого блока родителя в базе нет
+    lastHeaderHash = countBlocks != 0 ? lastBlockHash : "";
     const GetNewBlocksFromServer::LastBlockResponse lastBlock = getterBlocks.getLastBlock();
     CHECK(!lastBlock.error.has_value(), lastBlock.error.value());
     lastBlockInBlockchain = lastBlock.lastBlock;
     servers = lastBlock.servers;
-
-    advancedBlocks.clear();
-    getterBlocks.clearAdvanced();
     
-    return std::make_pair(lastBlockInBlockchain >= nextBlockToRead, lastBlockInBlockchain);
+    subscribe(servers);
+    
+    const bool isContinue = lastBlockInBlockchain >= nextBlockToRead;
+    if (isContinue) {
+        CHECK(!servers.empty(), "Servers empty");
+        startPipeline();
+    }
+    
+    return std::make_pair(isContinue, lastBlockInBlockchain);
 }
 
 size_t NetworkBlockSource::knownBlock() {
     return lastBlockInBlockchain;
 }
 
-bool NetworkBlockSource::process(BlockInfo &bi, std::string &binaryDump) {
-    const bool isContinue = lastBlockInBlockchain >= nextBlockToRead;
-    if (!isContinue) {
+size_t NetworkBlockSource::getWindowSize() const {
+    return getWindowSize(getterBlocks.getAdvanceBlocks());
+}
+
+size_t NetworkBlockSource::getWindowSize(size_t advanceBlocks) const {
+    //c Окно в две пачки предзагрузки, чтобы следующая пачка качалась, пока разбирается и пишется текущая.
+    //c В headers-first пачка тел в BODIES_BATCH_MULTIPLIER раз больше
+    const size_t countBatches = isHeadersFirst ? 2 * BODIES_BATCH_MULTIPLIER : 2;
+    return std::max(COUNT_ADVANCED_BLOCKS, countBatches * advanceBlocks);
+}
+
+std::optional<AdvanceLoadStatistic> NetworkBlockSource::getAdvanceLoadStatistic() const {
+    AdvanceLoadStatistic stat = getterBlocks.getAdvanceLoadStatistic();
+    stat.windowBlocks = getWindowSize();
+    return stat;
+}
+
+void NetworkBlockSource::subscribe(const std::vector<std::string> &servers) {
+    joinStoppedSubscribers(false);
+    
+    std::lock_guard<std::mutex> lock(subscribeMut);
+    knownCountBlocks = std::max(knownCountBlocks, lastBlockInBlockchain);
+    
+    std::set<std::string> droppedServers;
+    const auto stopSubscriber = [this, &droppedServers](const std::string &server) {
+        const auto found = subscribers.find(server);
+        found->second->isStop = true;
+        stoppedSubscribers.emplace_back(std::move(found->second));
+        subscribers.erase(found);
+        droppedServers.insert(server);
+        subscribeCond.notify_all();
+    };
+    //c Серверы без подписки берутся по кругу, начиная с места, где остановился прошлый поиск
+    const auto startNextSubscriber = [this, &servers, &droppedServers]() {
+        for (size_t i = 0; i < servers.size(); i++) {
+            const size_t index = (subscribeRotation + i) % servers.size();
+            const std::string &server = servers[index];
+            if (subscribers.find(server) == subscribers.end() && droppedServers.find(server) == droppedServers.end()) {
+                std::unique_ptr<Subscriber> subscriber = std::make_unique<Subscriber>();
+                subscriber->thread = Thread(&NetworkBlockSource::subscribeWork, this, server, subscriber.get());
+                subscribers.emplace(server, std::move(subscriber));
+                subscribeRotation = index + 1;
+                return true;
+            }
+        }
         return false;
+    };
+    
+    std::vector<std::string> failedServers;
+    std::vector<std::string> unknownServers;
+    for (const auto &[server, subscriber]: subscribers) {
+        if (std::find(servers.begin(), servers.end(), server) == servers.end()) {
+            unknownServers.push_back(server);
+        } else if (subscriber->isFailed) {
+            failedServers.push_back(server);
+        }
+    }
+    for (const std::string &server: unknownServers) {
+        stopSubscriber(server);
+    }
+    //c Не отвечающий сервер меняется, только если есть на что. Иначе его подписка сама повторяет запрос раз в SUBSCRIBE_RETRY_PERIOD
+    for (const std::string &server: failedServers) {
+        if (!startNextSubscriber()) {
+            break;
+        }
+        stopSubscriber(server);
+    }
+    while (subscribers.size() < MAX_SUBSCRIBERS) {
+        if (!startNextSubscriber()) {
+            break;
+        }
+    }
+}
+
+void NetworkBlockSource::joinStoppedSubscribers(bool isWaitAll) {
+    std::vector<std::unique_ptr<Subscriber>> finished;
+    {
+        std::lock_guard<std::mutex> lock(subscribeMut);
+        for (auto iter = stoppedSubscribers.begin(); iter != stoppedSubscribers.end();) {
+            if (isWaitAll || (*iter)->isFinished) {
+                finished.emplace_back(std::move(*iter));
+                iter = stoppedSubscribers.erase(iter);
+            } else {
+                iter++;
+            }
+        }
     }
     
-    const auto processAdvanced = [&bi, &binaryDump, this](const AdvancedBlock &advanced) {
-        if (advanced.exception) {
-            std::rethrow_exception(advanced.exception);
+    for (std::unique_ptr<Subscriber> &subscriber: finished) {
+        subscriber->thread.join();
+    }
+}
+
+void NetworkBlockSource::stopSubscribers() {
+    {
+        std::lock_guard<std::mutex> lock(subscribeMut);
+        isStopSubscribers = true;
+    }
+    subscribeCond.notify_all();
+    
+    for (auto &[server, subscriber]: subscribers) {
+        subscriber->thread.join();
+    }
+    subscribers.clear();
+    joinStoppedSubscribers(true);
+}
+
+void NetworkBlockSource::subscribeWork(const std::string &server, Subscriber *subscriber) {
+    while (true) {
+        size_t after;
+        {
+            std::lock_guard<std::mutex> lock(subscribeMut);
+            if (isStopSubscribers || subscriber->isStop) {
+                break;
+            }
+            after = std::max(knownCountBlocks, notifiedCountBlocks);
         }
-        bi = advanced.bi;
-        binaryDump = advanced.dump;
         
-        nextBlockToRead++;
-    };
+        try {
+            const size_t countBlocks = getterBlocks.waitCountBlocks(server, after, WAIT_COUNT_BLOCKS_TIMEOUT);
+            
+            std::lock_guard<std::mutex> lock(subscribeMut);
+            subscriber->isFailed = false;
+            if (!subscriber->isAlive) {
+                subscriber->isAlive = true;
+                countAliveSubscribers++;
+            }
+            if (countBlocks > notifiedCountBlocks) {
+                notifiedCountBlocks = countBlocks;
+                subscribeCond.notify_all();
+            }
+            continue;
+        } catch (const exception &e) {
+            LOGDEBUG << "Subscribe to " << server << " error " << e;
+        } catch (const std::exception &e) {
+            LOGDEBUG << "Subscribe to " << server << " error " << e.what();
+        }
+        
+        //c Сервер недоступен или не знает wait-count-blocks. Пока не ответит, waitNewBlocks на него не рассчитывает, а subscribe заменит его другим
+        std::unique_lock<std::mutex> lock(subscribeMut);
+        subscriber->isFailed = true;
+        if (subscriber->isAlive) {
+            subscriber->isAlive = false;
+            countAliveSubscribers--;
+        }
+        subscribeCond.wait_for(lock, SUBSCRIBE_RETRY_PERIOD, [this, subscriber] {
+            return isStopSubscribers || subscriber->isStop;
+        });
+    }
     
-    const auto foundBlock = advancedBlocks.find(nextBlockToRead);
-    if (foundBlock != advancedBlocks.end()) {
-        processAdvanced(foundBlock->second);
-        return true;
+    std::lock_guard<std::mutex> lock(subscribeMut);
+    if (subscriber->isAlive) {
+        countAliveSubscribers--;
     }
+    subscriber->isFinished = true;
+}
+
+void NetworkBlockSource::waitNewBlocks(size_t countBlocks, const milliseconds &pending) {
+    std::unique_lock<std::mutex> lock(subscribeMut);
+    knownCountBlocks = std::max(knownCountBlocks, countBlocks);
+    const size_t waitAfter = std::max(countBlocks, consumedCountBlocks);
+    const milliseconds maxWait = countAliveSubscribers != 0 ? SUBSCRIBED_POLL_PERIOD : pending;
+    subscribeCond.wait_for(lock, maxWait, [this, waitAfter] {
+        return isStopSubscribers || notifiedCountBlocks > waitAfter;
+    });
+    consumedCountBlocks = std::max(consumedCountBlocks, notifiedCountBlocks);
+}
+
+void NetworkBlockSource::startPipeline() {
+    isStopPipeline = false;
+    nextBlockToDownload = nextBlockToRead;
     
-    advancedBlocks.clear();
+    if (isHeadersFirst) {
+        nextHeaderToDownload = nextBlockToRead;
+        knownHeaders.clear();
+        headersThread = Thread(&NetworkBlockSource::headersWork, this);
+        bodiesThread = Thread(&NetworkBlockSource::bodiesWork, this);
+    } else {
+        downloadThread = Thread(&NetworkBlockSource::downloadWork, this);
+    }
+    for (size_t i = 0; i < COUNT_PARSE_THREADS; i++) {
+        parseThreads.emplace_back(&NetworkBlockSource::parseWork, this);
+    }
+    isPipelineStarted = true;
+}
+
+void NetworkBlockSource::stopPipeline() {
+    if (!isPipelineStarted) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pipelineMut);
+        isStopPipeline = true;
+    }
+    pipelineCond.notify_all();
     
-    const size_t countAdvanced = std::min(COUNT_ADVANCED_BLOCKS, lastBlockInBlockchain - nextBlockToRead + 1);
+    if (isHeadersFirst) {
+        headersThread.join();
+        bodiesThread.join();
+        knownHeaders.clear();
+    } else {
+        downloadThread.join();
+    }
+    for (Thread &thread: parseThreads) {
+        thread.join();
+    }
+    parseThreads.clear();
     
-    //LOGDEBUG << "Get block " << nextBlockToRead;
-    CHECK(!servers.empty(), "Servers empty");
-    for (size_t i = 0; i < countAdvanced; i++) {
-        const size_t currBlock = nextBlockToRead + i;
+    advancedBlocks.clear();
+    blocksToParse.clear();
+    getterBlocks.clearAdvanced();
+    isPipelineStarted = false;
+}
+
+void NetworkBlockSource::downloadWork() {
+    while (true) {
+        size_t blockNumber;
+        {
+            std::unique_lock<std::mutex> lock(pipelineMut);
+            conditionWait(pipelineCond, lock, [this] {
+                return isStopPipeline || (nextBlockToDownload <= lastBlockInBlockchain && nextBlockToDownload < nextBlockToRead + getWindowSize());
+            });
+            if (isStopPipeline) {
+                return;
+            }
+            blockNumber = nextBlockToDownload;
+            nextBlockToDownload++;
+        }
+        
         AdvancedBlock advanced;
         try {
-            advanced.header = getterBlocks.getBlockHeader(currBlock, lastBlockInBlockchain, servers[0]);
-            advanced.dump = getterBlocks.getBlockDump(advanced.header.hash, advanced.header.blockSize, servers, isVerifySign);
+            advanced.header = getterBlocks.getBlockHeader(blockNumber, lastBlockInBlockchain, getterBlocks.getBestServer(servers));
+            advanced.bi = blockPool.getBlockInfo();
+            advanced.dump = blockPool.getDump();
+            advanced.dump->buffer = getterBlocks.getBlockDump(advanced.header.hash, advanced.header.blockSize, servers, isVerifySign);
         } catch (...) {
             advanced.exception = std::current_exception();
+            advanced.isReady = true;
         }
-        advancedBlocks[currBlock] = advanced;
-    }
-    parallelFor(countAdvanced, advancedBlocks.begin(), advancedBlocks.end(), [this](auto &pair) {
-        if (pair.second.exception) {
+        const bool isError = advanced.isReady;
+        
+        {
+            std::lock_guard<std::mutex> lock(pipelineMut);
+            advancedBlocks.emplace(blockNumber, std::move(advanced));
+            if (!isError) {
+                blocksToParse.push_back(blockNumber);
+            }
+        }
+        pipelineCond.notify_all();
+        
+        //c Ошибку выбросит process, когда дойдет до этого блока. Дальше качать нет смысла, doProcess перезапустит конвейер
+        if (isError) {
             return;
         }
+    }
+}
+
+void NetworkBlockSource::headersWork() {
+    while (true) {
+        size_t fromBlock;
+        size_t countBlocks;
+        std::string prevHash;
+        {
+            std::unique_lock<std::mutex> lock(pipelineMut);
+            conditionWait(pipelineCond, lock, [this] {
+                return isStopPipeline || (nextHeaderToDownload <= lastBlockInBlockchain && nextHeaderToDownload < nextBlockToRead + HEADERS_AHEAD);
+            });
+            if (isStopPipeline) {
+                return;
+            }
+            fromBlock = nextHeaderToDownload;
+            countBlocks = std::min(lastBlockInBlockchain + 1, nextBlockToRead + HEADERS_AHEAD) - fromBlock;
+            prevHash = lastHeaderHash;
+        }
+        
+        std::vector<MinimumBlockHeader> headers;
         try {
-            if (isVerifySign) {
-                const BlockSignatureCheckResult signBlock = checkSignatureBlock(pair.second.dump);
-                pair.second.dump = signBlock.block;
-                pair.second.bi.header.senderSign.assign(signBlock.sign.begin(), signBlock.sign.end());
-                pair.second.bi.header.senderPubkey.assign(signBlock.pubkey.begin(), signBlock.pubkey.end());
-                pair.second.bi.header.senderAddress.assign(signBlock.address.begin(), signBlock.address.end());
+            headers = getterBlocks.getBlocksHeaders(fromBlock, countBlocks, servers);
+            for (const MinimumBlockHeader &header: headers) {
+                CHECK(prevHash.empty() || header.parentHash == prevHash, "Incorrect parent hash in block " + std::to_string(header.number));
+                prevHash = header.hash;
             }
-            CHECK(pair.second.dump.size() == pair.second.header.blockSize, "binaryDump.size() == nextBlockHeader.blockSize");
-            pair.second.bi.header.filePos.fileName = getFullPath(getBasename(pair.second.header.fileName), folderPath);
-            readNextBlockInfo(pair.second.dump.data(), pair.second.dump.data() + pair.second.dump.size(), 0, pair.second.bi, isValidate, saveAllTx, 0, 0);
         } catch (...) {
-            pair.second.exception = std::current_exception();
+            //c Тела до fromBlock докачаются, а на этом блоке process выбросит ошибку
+            AdvancedBlock advanced;
+            advanced.exception = std::current_exception();
+            advanced.isReady = true;
+            {
+                std::lock_guard<std::mutex> lock(pipelineMut);
+                advancedBlocks.emplace(fromBlock, std::move(advanced));
+            }
+            pipelineCond.notify_all();
+            return;
         }
-    });
+        
+        {
+            std::lock_guard<std::mutex> lock(pipelineMut);
+            knownHeaders.insert(knownHeaders.end(), std::make_move_iterator(headers.begin()), std::make_move_iterator(headers.end()));
+            nextHeaderToDownload += countBlocks;
+            lastHeaderHash = prevHash;
+        }
+        pipelineCond.notify_all();
+    }
+}
+
+void NetworkBlockSource::bodiesWork() {
+    while (true) {
+        size_t fromBlock;
+        std::vector<MinimumBlockHeader> headers;
+        {
+            std::unique_lock<std::mutex> lock(pipelineMut);
+            //c Место в окне и размер пачки считаются от одного прочитанного advanceBlocks
+            size_t advanceBlocks = 0;
+            size_t windowRoom = 0;
+            conditionWait(pipelineCond, lock, [this, &advanceBlocks, &windowRoom] {
+                if (isStopPipeline) {
+                    return true;
+                }
+                advanceBlocks = getterBlocks.getAdvanceBlocks();
+                const size_t windowEnd = nextBlockToRead + getWindowSize(advanceBlocks);
+                windowRoom = windowEnd > nextBlockToDownload ? windowEnd - nextBlockToDownload : 0;
+                return !knownHeaders.empty() && windowRoom != 0;
+            });
+            if (isStopPipeline) {
+                return;
+            }
+            fromBlock = nextBlockToDownload;
+            const size_t countBlocks = std::min({knownHeaders.size(), BODIES_BATCH_MULTIPLIER * advanceBlocks, windowRoom});
+            headers.assign(std::make_move_iterator(knownHeaders.begin()), std::make_move_iterator(knownHeaders.begin() + countBlocks));
+            knownHeaders.erase(knownHeaders.begin(), knownHeaders.begin() + countBlocks);
+            nextBlockToDownload += countBlocks;
+        }
+        
+        std::vector<std::string> dumps;
+        std::exception_ptr exception;
+        try {
+            dumps = getterBlocks.getBlocksDumps(headers, servers, isVerifySign);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(pipelineMut);
+            if (exception) {
+                AdvancedBlock advanced;
+                advanced.exception = exception;
+                advanced.isReady = true;
+                advancedBlocks.emplace(fromBlock, std::move(advanced));
+            } else {
+                for (size_t i = 0; i < headers.size(); i++) {
+                    AdvancedBlock advanced;
+                    advanced.header = std::move(headers[i]);
+                    advanced.bi = blockPool.getBlockInfo();
+                    advanced.dump = blockPool.getDump();
+                    advanced.dump->buffer = std::move(dumps[i]);
+                    advancedBlocks.emplace(fromBlock + i, std::move(advanced));
+                    blocksToParse.push_back(fromBlock + i);
+                }
+            }
+        }
+        pipelineCond.notify_all();
+        
+        //c Как и в downloadWork: ошибку выбросит process, doProcess перезапустит конвейер
+        if (exception) {
+            return;
+        }
+    }
+}
+
+void NetworkBlockSource::parseWork() {
+    while (true) {
+        AdvancedBlock *advanced;
+        {
+            std::unique_lock<std::mutex> lock(pipelineMut);
+            conditionWait(pipelineCond, lock, [this] {
+                return isStopPipeline || !blocksToParse.empty();
+            });
+            if (isStopPipeline) {
+                return;
+            }
+            //c Элементы map не переезжают, а удаляются только готовыми, поэтому указатель можно держать без блокировки
+            advanced = &advancedBlocks.at(blocksToParse.front());
+            blocksToParse.pop_front();
+        }
+        
+        parseBlock(*advanced);
+        
+        {
+            std::lock_guard<std::mutex> lock(pipelineMut);
+            advanced->isReady = true;
+        }
+        pipelineCond.notify_all();
+    }
+}
+
+void NetworkBlockSource::parseBlock(AdvancedBlock &advanced) const {
+    try {
+        BlockInfo &bi = *advanced.bi;
+        std::string &dump = advanced.dump->buffer;
+        if (isVerifySign) {
+            const BlockSignatureCheckResult signBlock = checkSignatureBlock(dump);
+            //c Блок без подписи короче, поэтому помещается в уже выделенную память дампа
+            dump.assign(signBlock.block);
+            bi.header.senderSign.assign(signBlock.sign.begin(), signBlock.sign.end());
+            bi.header.senderPubkey.assign(signBlock.pubkey.begin(), signBlock.pubkey.end());
+            bi.header.senderAddress.assign(signBlock.address.begin(), signBlock.address.end());
+        }
+        CHECK(dump.size() == advanced.header.blockSize, "binaryDump.size() == nextBlockHeader.blockSize");
+        bi.header.filePos.fileName = getFullPath(getBasename(advanced.header.fileName), folderPath);
+        readNextBlockInfo(dump.data(), dump.data() + dump.size(), 0, bi, isValidate, saveAllTx, 0, 0, isReadTxsDetails(isValidate));
+        CHECK(bi.header.hash == advanced.header.hash, "Incorrect block hash " + bi.header.hash + ". Expected " + advanced.header.hash);
+    } catch (...) {
+        advanced.exception = std::current_exception();
+    }
+}
+
+bool NetworkBlockSource::process(std::shared_ptr<BlockInfo> &bi, std::shared_ptr<BlockDump> &binaryDump) {
+    const bool isContinue = lastBlockInBlockchain >= nextBlockToRead;
+    if (!isContinue) {
+        return false;
+    }
+    
+    AdvancedBlock advanced;
+    {
+        std::unique_lock<std::mutex> lock(pipelineMut);
+        conditionWait(pipelineCond, lock, [this] {
+            const auto found = advancedBlocks.find(nextBlockToRead);
+            return found != advancedBlocks.end() && found->second.isReady;
+        });
+        const auto found = advancedBlocks.find(nextBlockToRead);
+        if (found->second.exception) {
+            std::rethrow_exception(found->second.exception);
+        }
+        advanced = std::move(found->second);
+        advancedBlocks.erase(found);
+        nextBlockToRead++;
+    }
+    //c Окно сдвинулось, поток скачивания может брать следующий блок
+    pipelineCond.notify_all();
     
-    CHECK(advancedBlocks.find(nextBlockToRead) != advancedBlocks.end(), "Incorrect results");
-    processAdvanced(advancedBlocks[nextBlockToRead]);
+    //c Блок уже разобран в объекты из пула, переданные bi и binaryDump вернутся в пул
+    bi = std::move(advanced.bi);
+    binaryDump = std::move(advanced.dump);
     return true;
 }
 
-void NetworkBlockSource::getExistingBlock(const BlockHeader& bh, BlockInfo& bi, std::string &blockDump) const {
+void NetworkBlockSource::getExistingBlock(const BlockHeader& bh, BlockInfo& bi, BlockDump &dump) const {
+    dump.clear();
+    std::string &blockDump = dump.buffer;
     CHECK(bh.blockNumber.has_value(), "Block number not set");
     const GetNewBlocksFromServer::LastBlockResponse lastBlock = getterBlocks.getLastBlock();
     CHECK(!lastBlock.error.has_value(), lastBlock.error.value());
-    const MinimumBlockHeader nextBlockHeader = getterBlocks.getBlockHeaderWithoutAdvanceLoad(bh.blockNumber.value(), lastBlock.servers[0]);
+    const MinimumBlockHeader nextBlockHeader = getterBlocks.getBlockHeaderWithoutAdvanceLoad(bh.blockNumber.value(), getterBlocks.getBestServer(lastBlock.servers));
     blockDump = getterBlocks.getBlockDumpWithoutAdvancedLoad(nextBlockHeader.hash, nextBlockHeader.blockSize, lastBlock.servers, isVerifySign);
     if (isVerifySign) {
         const BlockSignatureCheckResult signBlock = checkSignatureBlock(blockDump);
@@ -123,7 +545,7 @@ void NetworkBlockSource::getExistingBlock(const BlockHeader& bh, BlockInfo& bi,
         bi.header.senderAddress.assign(signBlock.address.begin(), signBlock.address.end());
     }
     CHECK(blockDump.size() == nextBlockHeader.blockSize, "binaryDump.size() == nextBlockHeader.blockSize");
-    readNextBlockInfo(blockDump.data(), blockDump.data() + blockDump.size(), bh.filePos.pos, bi, isValidate, saveAllTx, 0, 0);
+    readNextBlockInfo(blockDump.data(), blockDump.data() + blockDump.size(), bh.filePos.pos, bi, isValidate, saveAllTx, 0, 0, isReadTxsDetails(isValidate));
     bi.header.filePos.fileName = bh.filePos.fileName;
     for (auto &tx : bi.txs) {
         tx.filePos.fileName = bh.filePos.fileName;
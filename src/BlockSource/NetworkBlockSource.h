@@ -6,12 +6,19 @@
 #include "OopUtils.h"
 
 #include "BlockInfo.h"
+#include "BlockPool.h"
 
 #include "GetNewBlocksFromServers.h"
 
+#include "Thread.h"
+
 #include <string>
 #include <map>
 #include <vector>
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 namespace torrent_node_lib {
     
@@ -20,7 +27,7 @@ class P2P;
 class NetworkBlockSource: public BlockSource, common::no_copyable, common::no_moveable {
 public:
     
-    NetworkBlockSource(const std::string &folderPath, size_t maxAdvancedLoadBlocks, size_t countBlocksInBatch, bool isCompress, P2P &p2p, bool saveAllTx, bool isValidate, bool isVerifySign);
+    NetworkBlockSource(const std::string &folderPath, size_t maxAdvancedLoadBlocks, size_t countBlocksInBatch, bool isCompress, P2P &p2p, bool saveAllTx, bool isValidate, bool isVerifySign, bool isHeadersFirst, const BlockPool &blockPool);
     
     void initialize() override;
     
@@ -28,21 +35,87 @@ public:
     
     size_t knownBlock() override;
     
-    bool process(BlockInfo &bi, std::string &binaryDump) override;
+    bool process(std::shared_ptr<BlockInfo> &bi, std::shared_ptr<BlockDump> &binaryDump) override;
+    
+    void getExistingBlock(const BlockHeader &bh, BlockInfo &bi, BlockDump &blockDump) const override;
+    
+    std::optional<AdvanceLoadStatistic> getAdvanceLoadStatistic() const override;
     
-    void getExistingBlock(const BlockHeader &bh, BlockInfo &bi, std::string &blockDump) const override;
+    void waitNewBlocks(size_t countBlocks, const milliseconds &pending) override;
     
-    ~NetworkBlockSource() override = default;
+    ~NetworkBlockSource() override;
     
 private:
     
     struct AdvancedBlock {
         MinimumBlockHeader header;
-        BlockInfo bi;
-        std::string dump;
+        //c Из blockPool. Блок разбирается сразу в них, и process отдает их без копирования
+        std::shared_ptr<BlockInfo> bi;
+        std::shared_ptr<BlockDump> dump;
         std::exception_ptr exception;
+        //c Блок скачан и разобран (или случилась ошибка) и его можно отдавать
+        bool isReady = false;
     };
     
+private:
+    
+    /**
+     *c Конвейер: поток скачивания идет по блокам вперед не дальше окна getWindowSize() от nextBlockToRead,
+     *c потоки разбора разбирают скачанные блоки, а process отдает готовые блоки строго по порядку.
+     *c Так сеть, разбор и запись работают одновременно
+     */
+    void startPipeline();
+    
+    void stopPipeline();
+    
+    void downloadWork();
+    
+    /**
+     *c Headers-first: поток заголовков забегает вперед на HEADERS_AHEAD блоков длинными запросами get-blocks
+     *c и проверяет по ним цепочку parentHash. Поток тел разбирает известные заголовки большими пачками
+     *c и качает дампы со всех серверов сразу. По порядку блоки выстраивает advancedBlocks
+     */
+    void headersWork();
+    
+    void bodiesWork();
+    
+    void parseWork();
+    
+    void parseBlock(AdvancedBlock &advanced) const;
+    
+    size_t getWindowSize() const;
+    
+    //c advanceBlocks меняется без pipelineMut, поэтому читающий его под локом считает окно от одного прочитанного значения
+    size_t getWindowSize(size_t advanceBlocks) const;
+    
+    struct Subscriber {
+        common::Thread thread;
+        
+        //c Поля ниже под subscribeMut
+        bool isStop = false;
+        
+        bool isAlive = false;
+        
+        //c Последний запрос закончился ошибкой
+        bool isFailed = false;
+        
+        bool isFinished = false;
+    };
+    
+    /**
+     *c Подписки на новые блоки: на каждый сервер поток, который держит long poll wait-count-blocks.
+     *c Пока хоть одна подписка работает, waitNewBlocks просыпается сразу по приходу блока, а опрос всех серверов становится редким.
+     *c При каждом вызове подписки на серверы, которых больше нет в servers, снимаются, а не отвечающие заменяются другими серверами из servers
+     */
+    void subscribe(const std::vector<std::string> &servers);
+    
+    void stopSubscribers();
+    
+    //c Присоединяет остановленные подписки, которые уже закончились. При isWaitAll ждет все
+    void joinStoppedSubscribers(bool isWaitAll);
+    
+    void subscribeWork(const std::string &server, Subscriber *subscriber);
+    
 private:
     
     GetNewBlocksFromServer getterBlocks;
@@ -60,9 +133,65 @@ private:
     const bool isValidate;
     
     const bool isVerifySign;
+    
+    const bool isHeadersFirst;
+    
+    BlockPool blockPool;
   
     std::map<size_t, AdvancedBlock> advancedBlocks;
     
+    std::deque<size_t> blocksToParse;
+    
+    size_t nextBlockToDownload = 0;
+    
+    //c Проверенные заголовки, тела которых еще никто не взял. Начинаются с nextBlockToDownload
+    std::deque<MinimumBlockHeader> knownHeaders;
+    
+    size_t nextHeaderToDownload = 0;
+    
+    //c Хэш блока nextHeaderToDownload - 1. Пустой, если сверять не с чем
+    std::string lastHeaderHash;
+    
+    bool isStopPipeline = false;
+    
+    bool isPipelineStarted = false;
+    
+    std::mutex pipelineMut;
+    
+    std::condition_variable pipelineCond;
+    
+    common::Thread downloadThread;
+    
+    common::Thread headersThread;
+    
+    common::Thread bodiesThread;
+    
+    std::vector<common::Thread> parseThreads;
+    
+    std::mutex subscribeMut;
+    
+    std::condition_variable subscribeCond;
+    
+    //c Подписки ждут блоков после max(knownCountBlocks, notifiedCountBlocks)
+    size_t knownCountBlocks = 0;
+    
+    size_t notifiedCountBlocks = 0;
+    
+    //c До какого количества блоков уведомления уже разбудили waitNewBlocks. Каждое уведомление будит один раз
+    size_t consumedCountBlocks = 0;
+    
+    size_t countAliveSubscribers = 0;
+    
+    bool isStopSubscribers = false;
+    
+    std::map<std::string, std::unique_ptr<Subscriber>> subscribers;
+    
+    //c Остановленные подписки могут еще досиживать long poll, поэтому присоединяются, только когда закончатся
+    std::vector<std::unique_ptr<Subscriber>> stoppedSubscribers;
+    
+    //c С какого сервера из servers начинать поиск новых подписок, чтобы замены не брались все время из начала списка
+    size_t subscribeRotation = 0;
+    
 };
 
 }
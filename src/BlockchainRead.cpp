@@ -2,15 +2,28 @@
 
 #include <string>
 #include <vector>
+#include <array>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <exception>
 
-#include <rapidjson/document.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/memorystream.h>
+#include <rapidjson/encodedstream.h>
 
 #include "check.h"
 #include "log.h"
+#include "parallel_for.h"
 #include "convertStrings.h"
 #include "utils/serialize.h"
+#include "utils/ReadOnlyFile.h"
+#include "utils/sha256.h"
 
 #include "Modules.h"
 #include "BlockInfo.h"
@@ -69,7 +82,7 @@ static size_t fileSize(std::ofstream &ifile) {
     return ifile.tellp();
 }
 
-size_t saveBlockToFileBinary(const std::string& fileName, const std::string& data) {
+size_t saveBlockToFileBinary(const std::string& fileName, std::string_view data) {
     std::ofstream file(fileName, std::ios::binary | std::ios::app);
     const size_t oldSize = fileSize(file);
     const uint64_t blockSize = data.size();
@@ -79,7 +92,7 @@ size_t saveBlockToFileBinary(const std::string& fileName, const std::string& dat
     return oldSize;
 }
 
-size_t saveTransactionToFile(std::ofstream& file, const std::string& data) {
+size_t saveTransactionToFile(std::ofstream& file, std::string_view data) {
     const size_t oldSize = fileSize(file);
     file << data;
     return oldSize;
@@ -182,11 +195,203 @@ static bool isSignBlockTx(const TransactionInfo &txInfo, const PrevTransactionSi
     return txInfo.fromAddress == txInfo.toAddress && txInfo.value == 0 && (helper.isFirst || (txInfo.data == helper.prevTxData && !txInfo.data.empty()));
 }
 
-static std::pair<SizeTransactinType, const char*> readTransactionInfo(const char *cur_pos, const char *end_pos, TransactionInfo &txInfo, bool isParseTx, bool isSaveAllTx, const PrevTransactionSignHelper &helper, bool isValidate) {    
+//c Подписанная часть транзакции. Заполняется, если подпись нужно проверить
+struct SignedTransactionData {
+    const char *begin = nullptr;
+    const char *end = nullptr;
+};
+
+/**
+ *c Вытаскивает из json только method и params.value, params.host, params.name, не строя дерево документа.
+ *c Как и при разборе в Document, берется первое вхождение ключа, а весь json должен быть корректным
+ */
+class DataMethodHandler: public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, DataMethodHandler> {
+public:
+    
+    explicit DataMethodHandler(TransactionInfo::DataMethod &result)
+        : result(result)
+    {}
+    
+    bool Key(const char *str, rapidjson::SizeType length, bool /*copy*/) {
+        const std::string_view key(str, length);
+        pending = Field::None;
+        if (depth == 1) {
+            if (key == "method") {
+                pending = takeField(Field::Method);
+            } else if (key == "params") {
+                pending = takeField(Field::Params);
+            }
+        } else if (depth == 2 && isInParams) {
+            if (key == "value") {
+                pending = takeField(Field::Value);
+            } else if (key == "host") {
+                pending = takeField(Field::Host);
+            } else if (key == "name") {
+                pending = takeField(Field::Name);
+            }
+        }
+        return true;
+    }
+    
+    bool String(const char *str, rapidjson::SizeType length, bool /*copy*/) {
+        if (pending == Field::Method) {
+            isMethodSet = true;
+            result.method.assign(str, length);
+        } else if (pending == Field::Value) {
+            result.value = std::string(str, length);
+        } else if (pending == Field::Host) {
+            result.host = std::string(str, length);
+        } else if (pending == Field::Name) {
+            result.name = std::string(str, length);
+        }
+        return Default();
+    }
+    
+    bool StartObject() {
+        if (pending == Field::Params) {
+            isInParams = true;
+        }
+        depth++;
+        return Default();
+    }
+    
+    bool EndObject(rapidjson::SizeType /*memberCount*/) {
+        depth--;
+        if (depth == 1) {
+            isInParams = false;
+        }
+        return true;
+    }
+    
+    bool StartArray() {
+        depth++;
+        return Default();
+    }
+    
+    bool EndArray(rapidjson::SizeType /*elementCount*/) {
+        depth--;
+        return true;
+    }
+    
+    bool Default() {
+        pending = Field::None;
+        return true;
+    }
+    
+    bool isMethodFound() const {
+        return isMethodSet;
+    }
+    
+private:
+    
+    enum Field {
+        None = 0, Method, Params, Value, Host, Name, Count
+    };
+    
+    Field takeField(Field field) {
+        if (foundFields[field]) {
+            return Field::None;
+        }
+        foundFields[field] = true;
+        return field;
+    }
+    
+private:
+    
+    TransactionInfo::DataMethod &result;
+    
+    size_t depth = 0;
+    
+    //c Ключ, значение которого разбирается следующим
+    Field pending = Field::None;
+    
+    std::array<bool, Field::Count> foundFields = {};
+    
+    bool isInParams = false;
+    
+    bool isMethodSet = false;
+};
+
+static std::optional<TransactionInfo::DataMethod> parseDataMethod(const char *data, size_t size) {
+    //c Стек разборщика берется из буфера на стеке, чтобы не ходить в кучу на каждую транзакцию
+    char stackBuffer[1024];
+    rapidjson::MemoryPoolAllocator<> stackAllocator(stackBuffer, sizeof(stackBuffer));
+    rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>> reader(&stackAllocator, sizeof(stackBuffer) / 2);
+    
+    TransactionInfo::DataMethod result;
+    DataMethodHandler handler(result);
+    rapidjson::MemoryStream memoryStream(data, size);
+    rapidjson::EncodedInputStream<rapidjson::UTF8<>, rapidjson::MemoryStream> stream(memoryStream);
+    const rapidjson::ParseResult pr = reader.Parse(stream, handler);
+    if (!pr || !handler.isMethodFound()) { // Здесь специально стоят if-ы вместо чеков, чтобы не крашится, если пользователь захочет послать какую-нибудь фигню
+        return std::nullopt;
+    }
+    return result;
+}
+
+//c Поля, которые считать дорого, а нужны они не всем воркерам: адрес отправителя и то, что берется из json в data
+static void readTransactionDetails(const char *dumpBegin, TransactionInfo &txInfo) {
+    bool isBlockedFrom = false;
+    const std::vector<unsigned char> &data = txInfo.data;
+    if (!data.empty()) {
+        if (data.size() == 9 && data[0] == 1) {
+            isBlockedFrom = true;
+        } else if (data[0] == '{' && data[data.size() - 1] == '}') {
+            txInfo.dataMethod = parseDataMethod((const char*)data.data(), data.size());
+        }
+    }
+    
+    if (txInfo.dataMethod.has_value()) {
+        const TransactionInfo::DataMethod &dataMethod = txInfo.dataMethod.value();
+        if (dataMethod.method == "delegate" || dataMethod.method == "undelegate") {
+            TransactionInfo::DelegateInfo delegateInfo;
+            
+            delegateInfo.isDelegate = dataMethod.method == "delegate";
+            if (delegateInfo.isDelegate) {
+                if (dataMethod.value.has_value()) {
+                    try {
+                        delegateInfo.value = std::stoull(dataMethod.value.value());
+                        txInfo.delegate = delegateInfo;
+                    } catch (...) {
+                        // ignore
+                    }
+                }
+            } else {
+                txInfo.delegate = delegateInfo;
+            }
+        }
+        
+        if (txInfo.scriptInfo.has_value() && (dataMethod.method == "compile" || dataMethod.method == "run")) {
+            txInfo.scriptInfo.value().isInitializeScript = dataMethod.method == "compile";
+        }
+    }
+    
+    if (!txInfo.pubKey.empty()) {
+        const std::vector<unsigned char> binAddress = get_address_bin(txInfo.pubKey.view(dumpBegin));
+        CHECK(!binAddress.empty(), "incorrect pubkey script");
+        txInfo.fromAddress = Address(binAddress, isBlockedFrom);
+    }
+    
+    txInfo.isDetailsRead = true;
+}
+
+void readTransactionDetails(std::string_view dump, TransactionInfo &txInfo) {
+    if (!txInfo.isDetailsRead) {
+        readTransactionDetails(dump.data(), txInfo);
+    }
+}
+
+/**
+ *c Если signedData не nullptr, подпись не проверяется сразу, а в signedData возвращается подписанная часть транзакции,
+ *c чтобы проверить подписи всего блока параллельно.
+ *c Так же с hashData: хэш не считается, а возвращаются байты, от которых его посчитать.
+ *c Подпись, ключ и сырые байты транзакции не копируются, а запоминаются как DumpSpan от dumpBegin.
+ *c Без isReadDetails поля из readTransactionDetails не заполняются. При проверке подписей они нужны всегда
+ */
+static std::pair<SizeTransactinType, const char*> readTransactionInfo(const char *dumpBegin, const char *cur_pos, const char *end_pos, TransactionInfo &txInfo, bool isParseTx, bool isSaveAllTx, const PrevTransactionSignHelper &helper, bool isValidate, bool isReadDetails, SignedTransactionData *signedData = nullptr, Sha256Message *hashData = nullptr) {    
     const char * tx_start = nullptr;
     const char * const allTxStart = cur_pos;
     
-    bool isBlockedFrom = false;
     SizeTransactinType tx_size = 0;
     SizeTransactinType tx_hash_size = 0;
     const char *endClearTx = nullptr;
@@ -215,74 +420,25 @@ static std::pair<SizeTransactinType, const char*> readTransactionInfo(const char
     txInfo.data = std::vector<unsigned char>(cur_pos, cur_pos + dataSize);
     cur_pos += dataSize;
     
-    if (dataSize > 0) {
-        if (dataSize == 9 && txInfo.data[0] == 1) {
-            isBlockedFrom = true;
-        } else if (txInfo.data[0] == '{' && txInfo.data[txInfo.data.size() - 1] == '}') {
-            rapidjson::Document doc;
-            const rapidjson::ParseResult pr = doc.Parse((const char*)txInfo.data.data(), txInfo.data.size());
-            if (pr) { // Здесь специально стоят if-ы вместо чеков, чтобы не крашится, если пользователь захочет послать какую-нибудь фигню
-                if (doc.HasMember("method") && doc["method"].IsString()) {
-                    const std::string method = doc["method"].GetString();
-                    if (method == "delegate" || method == "undelegate") {
-                        TransactionInfo::DelegateInfo delegateInfo;
-                        
-                        delegateInfo.isDelegate = method == "delegate";
-                        if (delegateInfo.isDelegate) {
-                            if (doc.HasMember("params") && doc["params"].IsObject()) {
-                                const auto &paramsJson = doc["params"];
-                                if (paramsJson.HasMember("value") && paramsJson["value"].IsString()) {
-                                    try {
-                                        delegateInfo.value = std::stoull(paramsJson["value"].GetString());
-                                        txInfo.delegate = delegateInfo;
-                                    } catch (...) {
-                                        // ignore
-                                    }
-                                }                               
-                            }
-                        } else {
-                            txInfo.delegate = delegateInfo;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    
     if (txInfo.toAddress.isScriptAddress()) {
         TransactionInfo::ScriptInfo scriptInfo;
         scriptInfo.isInitializeScript = false;
         txInfo.scriptInfo = scriptInfo;
         
         txInfo.isModuleNotSet = true;
-        
-        if (dataSize > 0) {
-            if (txInfo.data[0] == '{' && txInfo.data[txInfo.data.size() - 1] == '}') {
-                rapidjson::Document doc;
-                const rapidjson::ParseResult pr = doc.Parse((const char*)txInfo.data.data(), txInfo.data.size());
-                if (pr) { // Здесь специально стоят if-ы вместо чеков, чтобы не крашится, если пользователь захочет послать какую-нибудь фигню
-                    if (doc.HasMember("method") && doc["method"].IsString()) {
-                        const std::string method = doc["method"].GetString();
-                        if (method == "compile" || method == "run") {
-                            txInfo.scriptInfo.value().isInitializeScript = method == "compile";
-                        }
-                    }
-                }
-            }
-        }
     }
     
     endClearTx = cur_pos;
     
     const size_t signSize = readVarInt(cur_pos, end_pos);
     CHECK(cur_pos + signSize <= end_pos, "Out of the array");
-    txInfo.sign = std::vector<char>(cur_pos, cur_pos + signSize);
+    txInfo.sign = DumpSpan(dumpBegin, cur_pos, cur_pos + signSize);
     cur_pos += signSize;
     
     const size_t pubkeySize = readVarInt(cur_pos, end_pos);
     CHECK(cur_pos + pubkeySize <= end_pos, "Out of the array");
     if (pubkeySize != 0) {
-        txInfo.pubKey = std::vector<unsigned char>(cur_pos, cur_pos + pubkeySize);
+        txInfo.pubKey = DumpSpan(dumpBegin, cur_pos, cur_pos + pubkeySize);
         cur_pos += pubkeySize;
     } else {
         txInfo.fromAddress.setEmpty();
@@ -296,24 +452,26 @@ static std::pair<SizeTransactinType, const char*> readTransactionInfo(const char
     
     const char* const allTxEnd = cur_pos;
     
-    if (!txInfo.pubKey.empty()) {
-        const std::vector<unsigned char> binAddress = get_address_bin(txInfo.pubKey);
-        CHECK(!binAddress.empty(), "incorrect pubkey script");
-        txInfo.fromAddress = Address(binAddress, isBlockedFrom);
+    if (isReadDetails) {
+        readTransactionDetails(dumpBegin, txInfo);
     }
         
     CHECK(tx_start != nullptr, "Ups");
-    const std::array<unsigned char, 32> tx_hash = get_double_sha256((unsigned char *)tx_start, tx_hash_size);
-    txInfo.hash = std::string(tx_hash.cbegin(), tx_hash.cend());
+    if (hashData != nullptr) {
+        *hashData = Sha256Message{(const unsigned char*)tx_start, tx_hash_size};
+    } else {
+        const std::array<unsigned char, 32> tx_hash = get_double_sha256((unsigned char *)tx_start, tx_hash_size);
+        txInfo.hash = std::string(tx_hash.cbegin(), tx_hash.cend());
+    }
     
     if (txInfo.scriptInfo.has_value()) {
         CHECK(endClearTx != nullptr, "End tx not found");
-        txInfo.scriptInfo->txRaw = std::string(tx_start, endClearTx);
+        txInfo.scriptInfo->txRaw = DumpSpan(dumpBegin, tx_start, endClearTx);
     }
     txInfo.sizeRawTx = tx_size;
     
     if (isSaveAllTx) {
-        txInfo.allRawTx = std::string(allTxStart, allTxEnd);
+        txInfo.allRawTx = DumpSpan(dumpBegin, allTxStart, allTxEnd);
     }
     
     txInfo.isSignBlockTx = isSignBlockTx(txInfo, helper);
@@ -321,7 +479,12 @@ static std::pair<SizeTransactinType, const char*> readTransactionInfo(const char
     if (isValidate) {
         if (!txInfo.fromAddress.isInitialWallet()) {
             //LOGINFO << "Ya tuta 2 " << toHex(txInfo.hash.begin(), txInfo.hash.end()) << " " << toHex(allTxStart, allTxEnd) << " " << toHex(txInfo.pubKey);
-            CHECK(crypto_check_sign_data(txInfo.sign, txInfo.pubKey, (const unsigned char*)tx_start, std::distance(tx_start, endClearTx)), "Not validate");
+            if (signedData != nullptr) {
+                signedData->begin = tx_start;
+                signedData->end = endClearTx;
+            } else {
+                CHECK(crypto_check_sign_data(txInfo.sign.view(dumpBegin), txInfo.pubKey.view(dumpBegin), (const unsigned char*)tx_start, std::distance(tx_start, endClearTx)), "Not validate");
+            }
         }
     }
     
@@ -345,14 +508,139 @@ bool readOneTransactionInfo(std::ifstream &ifile, size_t currPos, TransactionInf
         seekFile(ifile, currPos);
         ifile.read(fh_buff.data(), fh_buff.size());
         
-        readTransactionInfo(fh_buff.data(), fh_buff.data() + fh_buff.size(), txInfo, true, isSaveAllTx, PrevTransactionSignHelper(), false);
+        readTransactionInfo(fh_buff.data(), fh_buff.data(), fh_buff.data() + fh_buff.size(), txInfo, true, isSaveAllTx, PrevTransactionSignHelper(), false, true);
 
         return true;
     }
     return false;
 }
 
-static void readBlockTxs(const char *begin_pos, const char *end_pos, size_t posInFile, BlockInfo &bi, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isValidate) {
+struct TransactionSignToCheck {
+    size_t txIndex;
+    SignedTransactionData signedData;
+};
+
+//c Меньше этого подписей на поток не даем, иначе запуск потоков дороже самой проверки
+const static size_t MIN_SIGNS_IN_THREAD = 64;
+
+//c Разбор транзакции дешевле проверки подписи, поэтому и кусок на поток больше
+const static size_t MIN_TXS_IN_THREAD = 256;
+
+/**
+ *c Потоки для параллельного разбора блоков общие на всех: блоки разбираются в нескольких потоках сразу,
+ *c и без общего лимита каждый из них запустил бы по hardware_concurrency потоков.
+ *c Берет до wantThreads потоков из общего лимита и возвращает их в деструкторе
+ */
+class ParseThreadsBudget {
+public:
+    
+    explicit ParseThreadsBudget(size_t wantThreads) {
+        const size_t limit = std::max(std::thread::hardware_concurrency(), 1u);
+        size_t busy = countBusyThreads.load();
+        while (busy < limit) {
+            const size_t got = std::min(wantThreads, limit - busy);
+            if (countBusyThreads.compare_exchange_weak(busy, busy + got)) {
+                countThreads = got;
+                break;
+            }
+        }
+    }
+    
+    ParseThreadsBudget(const ParseThreadsBudget &) = delete;
+    ParseThreadsBudget& operator=(const ParseThreadsBudget &) = delete;
+    
+    ~ParseThreadsBudget() {
+        countBusyThreads.fetch_sub(countThreads);
+    }
+    
+    size_t getCountThreads() const {
+        return countThreads;
+    }
+    
+private:
+    
+    size_t countThreads = 0;
+    
+    inline static std::atomic<size_t> countBusyThreads = 0;
+};
+
+/**
+ *c Делит [0, count) на куски не меньше minInThread и обрабатывает их параллельно.
+ *c Если элементов мало или общий лимит потоков исчерпан, все делается в текущем потоке. Первое исключение из кусков пробрасывается наружу
+ */
+static void parallelForRanges(size_t count, size_t minInThread, const std::function<void(size_t from, size_t to)> &func) {
+    if (count < 2 * minInThread) {
+        func(0, count);
+        return;
+    }
+    
+    const ParseThreadsBudget budget(count / minInThread);
+    const size_t countThreads = budget.getCountThreads();
+    if (countThreads < 2) {
+        func(0, count);
+        return;
+    }
+    
+    const size_t step = (count + countThreads - 1) / countThreads;
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t from = 0; from < count; from += step) {
+        ranges.emplace_back(from, std::min(from + step, count));
+    }
+    
+    std::mutex exceptionMut;
+    std::exception_ptr exception;
+    parallelFor(countThreads, ranges.begin(), ranges.end(), [&func, &exceptionMut, &exception](const std::pair<size_t, size_t> &range) {
+        try {
+            func(range.first, range.second);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(exceptionMut);
+            if (exception == nullptr) {
+                exception = std::current_exception();
+            }
+        }
+    });
+    if (exception != nullptr) {
+        std::rethrow_exception(exception);
+    }
+}
+
+static void checkTransactionsSigns(const char *dumpBegin, const std::pmr::vector<TransactionInfo> &txs, const std::vector<TransactionSignToCheck> &signs) {
+    std::atomic<bool> isValid(true);
+    parallelForRanges(signs.size(), MIN_SIGNS_IN_THREAD, [dumpBegin, &txs, &signs, &isValid](size_t from, size_t to) {
+        for (size_t i = from; i < to && isValid.load(std::memory_order_relaxed); i++) {
+            const TransactionSignToCheck &sign = signs[i];
+            const TransactionInfo &txInfo = txs[sign.txIndex];
+            if (!crypto_check_sign_data(txInfo.sign.view(dumpBegin), txInfo.pubKey.view(dumpBegin), (const unsigned char*)sign.signedData.begin, std::distance(sign.signedData.begin, sign.signedData.end))) {
+                isValid = false;
+            }
+        }
+    });
+    CHECK(isValid.load(), "Not validate");
+}
+
+//c Первый проход: читаются только размеры транзакций, чтобы узнать, где начинается каждая из нужных
+static std::vector<const char*> findTransactionsBegin(const char *cur_pos, const char *end_pos, size_t beginTx, size_t countTx) {
+    std::vector<const char*> txsBegin;
+    for (size_t txIndex = 0;; txIndex++) {
+        const char *txBegin = cur_pos;
+        const SizeTransactinType tx_size = readVarInt(cur_pos, end_pos);
+        if (tx_size == 0) {
+            break;
+        }
+        CHECK(cur_pos + tx_size <= end_pos, "Out of the array");
+        cur_pos += tx_size;
+        
+        if (txIndex >= beginTx) {
+            txsBegin.push_back(txBegin);
+            if (countTx != 0 && txsBegin.size() >= countTx) {
+                break;
+            }
+        }
+    }
+    return txsBegin;
+}
+
+static void readBlockTxs(const char *begin_pos, const char *end_pos, size_t posInFile, BlockInfo &bi, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isValidate, bool isReadTxsDetails) {
     const size_t offsetBeginBlock = sizeof(uint64_t);
     
     const char *cur_pos = begin_pos;
@@ -361,38 +649,61 @@ static void readBlockTxs(const char *begin_pos, const char *end_pos, size_t posI
     std::array<unsigned char, 32> block_hash = get_double_sha256((unsigned char *)begin_pos, std::distance(begin_pos, end_pos));
     bi.header.hash = toHex(block_hash.cbegin(), block_hash.cend());
     
-    SizeTransactinType tx_size = 0;
-    size_t txIndex = 0;
-    PrevTransactionSignHelper prevTransactionSignBlockHelper;
-    prevTransactionSignBlockHelper.isFirst = true;
-    prevTransactionSignBlockHelper.isPrevSign = true;
-    do {
-        TransactionInfo txInfo;
-        txInfo.filePos.pos = cur_pos - begin_pos + posInFile + offsetBeginBlock;
-        
-        const bool isReadTransaction = txIndex >= beginTx;
-        const auto &[newSize, newPos] = readTransactionInfo(cur_pos, end_pos, txInfo, isReadTransaction, isSaveAllTx, prevTransactionSignBlockHelper, isValidate);
-        
-        tx_size = newSize;
-        cur_pos = newPos;
-        if (txInfo.isInitialized && isReadTransaction) {
-            bi.txs.push_back(txInfo);
+    const std::vector<const char*> txsBegin = findTransactionsBegin(cur_pos, end_pos, beginTx, countTx);
+    
+    //c Второй проход: транзакции друг от друга не зависят, поэтому большие блоки разбираются параллельно прямо в bi.txs.
+    //c Хэши транзакций куска считаются одной пачкой
+    const size_t firstTx = bi.txs.size();
+    bi.txs.resize(firstTx + txsBegin.size());
+    std::vector<SignedTransactionData> signedDatas(txsBegin.size());
+    const bool isReadDetails = isReadTxsDetails || isValidate;
+    parallelForRanges(txsBegin.size(), MIN_TXS_IN_THREAD, [&](size_t from, size_t to) {
+        std::vector<Sha256Message> hashDatas(to - from);
+        for (size_t i = from; i < to; i++) {
+            TransactionInfo &txInfo = bi.txs[firstTx + i];
+            txInfo.filePos.pos = txsBegin[i] - begin_pos + posInFile + offsetBeginBlock;
+            readTransactionInfo(begin_pos, txsBegin[i], end_pos, txInfo, true, isSaveAllTx, PrevTransactionSignHelper(), isValidate, isReadDetails, &signedDatas[i], &hashDatas[i - from]);
         }
-        if (countTx != 0 && bi.txs.size() >= countTx) {
-            break;
+        const std::vector<Sha256Hash> hashes = doubleSha256Batch(hashDatas);
+        for (size_t i = from; i < to; i++) {
+            const Sha256Hash &hash = hashes[i - from];
+            bi.txs[firstTx + i].hash = std::string(hash.cbegin(), hash.cend());
         }
-        
-        prevTransactionSignBlockHelper.isPrevSign = txInfo.isSignBlockTx;
-        prevTransactionSignBlockHelper.prevTxData = txInfo.data;
-        prevTransactionSignBlockHelper.isFirst = false;
-        
-        txIndex++;
-    } while (tx_size > 0);
+    });
+    
+    //c Третий проход: транзакция подписи блока зависит от предыдущей. Такие транзакции идут в начале блока, поэтому проход короткий.
+    //c Если первые транзакции блока не читались, цепочка подписей разорвана, как и раньше
+    if (beginTx == 0) {
+        PrevTransactionSignHelper prevTransactionSignBlockHelper;
+        prevTransactionSignBlockHelper.isFirst = true;
+        prevTransactionSignBlockHelper.isPrevSign = true;
+        for (size_t i = firstTx; i < bi.txs.size(); i++) {
+            TransactionInfo &txInfo = bi.txs[i];
+            readTransactionDetails(std::string_view(begin_pos, std::distance(begin_pos, end_pos)), txInfo);
+            txInfo.isSignBlockTx = isSignBlockTx(txInfo, prevTransactionSignBlockHelper);
+            if (!txInfo.isSignBlockTx) {
+                break;
+            }
+            prevTransactionSignBlockHelper.prevTxData = txInfo.data;
+            prevTransactionSignBlockHelper.isFirst = false;
+        }
+    }
+    
+    std::vector<TransactionSignToCheck> signsToCheck;
+    for (size_t i = 0; i < signedDatas.size(); i++) {
+        if (signedDatas[i].begin != nullptr) {
+            signsToCheck.push_back(TransactionSignToCheck{firstTx + i, signedDatas[i]});
+        }
+    }
+    //c Подписи проверяются после разбора всего блока, параллельно
+    checkTransactionsSigns(begin_pos, bi.txs, signsToCheck);
+    
     if (countTx == 0) {
         bi.header.countTxs = bi.txs.size();
     }
     if (!bi.txs.empty()) {
-        const TransactionInfo &tx = bi.txs.front();
+        TransactionInfo &tx = bi.txs.front();
+        readTransactionDetails(std::string_view(begin_pos, std::distance(begin_pos, end_pos)), tx);
         if (tx.fromAddress == tx.toAddress && tx.value == 0) {
             //c Это транзакция подписи
             bi.header.signature = tx.data;
@@ -400,7 +711,7 @@ static void readBlockTxs(const char *begin_pos, const char *end_pos, size_t posI
     }
 }
 
-size_t readNextBlockInfo(std::ifstream &ifile, size_t currPos, BlockInfo &bi, std::string &blockDump, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx) {
+size_t readNextBlockInfo(std::ifstream &ifile, size_t currPos, BlockInfo &bi, std::string &blockDump, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isReadTxsDetails) {
     const size_t f_size = fileSize(ifile);
     
     const bool res = readBlockHeader(ifile, currPos, f_size, bi.header);
@@ -412,12 +723,13 @@ size_t readNextBlockInfo(std::ifstream &ifile, size_t currPos, BlockInfo &bi, st
         return currPos;
     } else {
         const size_t b_size = bi.header.blockSize;
-        blockDump = std::string(b_size, 0);
+        //c assign, а не новая строка: буфер дампа из BlockPool переиспользует свою память
+        blockDump.assign(b_size, 0);
         const size_t offsetBeginBlock = sizeof(uint64_t);
         seekFile(ifile, currPos + offsetBeginBlock);
         ifile.read(blockDump.data(), b_size);
 
-        readBlockTxs(blockDump.data(), blockDump.data() + blockDump.size(), currPos, bi, isSaveAllTx, beginTx, countTx, isValidate);
+        readBlockTxs(blockDump.data(), blockDump.data() + blockDump.size(), currPos, bi, isSaveAllTx, beginTx, countTx, isValidate, isReadTxsDetails);
         
         currPos += (bi.header.blockSize+sizeof(uint64_t));
         
@@ -427,9 +739,9 @@ size_t readNextBlockInfo(std::ifstream &ifile, size_t currPos, BlockInfo &bi, st
     return currPos;
 }
 
-void readNextBlockInfo(const char *begin_pos, const char *end_pos, size_t posInFile, BlockInfo &bi, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx) {
+void readNextBlockInfo(const char *begin_pos, const char *end_pos, size_t posInFile, BlockInfo &bi, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isReadTxsDetails) {
     readBlockHeaderWithoutSize(begin_pos, end_pos, bi.header);
-    readBlockTxs(begin_pos, end_pos, posInFile, bi, isSaveAllTx, beginTx, countTx, isValidate);
+    readBlockTxs(begin_pos, end_pos, posInFile, bi, isSaveAllTx, beginTx, countTx, isValidate, isReadTxsDetails);
     bi.header.blockSize = std::distance(begin_pos, end_pos);
     bi.header.filePos.pos = posInFile;
     bi.header.endBlockPos = posInFile + bi.header.blockSize+sizeof(uint64_t);
@@ -437,34 +749,193 @@ void readNextBlockInfo(const char *begin_pos, const char *end_pos, size_t posInF
 
 
 
-std::pair<size_t, std::string> getBlockDump(std::ifstream &ifile, size_t currPos, size_t fromByte, size_t toByte) {
-    const size_t f_size = fileSize(ifile);
-    if (f_size <= currPos) {
+size_t readNextBlockInfo(const ReadOnlyFile &file, size_t currPos, BlockInfo &bi, std::string &blockDump, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isReadTxsDetails) {
+    std::array<char, BLOCK_HEADER_SIZE> fh_buff;
+    if (file.read(currPos, fh_buff.data(), fh_buff.size()) != fh_buff.size()) {
+        return currPos;
+    }
+    bi.header.filePos.pos = currPos;
+    readBlockHeader(fh_buff.data(), fh_buff.data() + fh_buff.size(), bi.header);
+    
+    const size_t b_size = bi.header.blockSize;
+    blockDump.assign(b_size, 0);
+    const size_t offsetBeginBlock = sizeof(uint64_t);
+    if (file.read(currPos + offsetBeginBlock, blockDump.data(), b_size) != b_size) {
+        return currPos;
+    }
+    
+    readBlockTxs(blockDump.data(), blockDump.data() + blockDump.size(), currPos, bi, isSaveAllTx, beginTx, countTx, isValidate, isReadTxsDetails);
+    
+    currPos += (bi.header.blockSize+sizeof(uint64_t));
+    
+    bi.header.endBlockPos = currPos;
+    
+    return currPos;
+}
+
+std::pair<size_t, std::string> getBlockDump(const ReadOnlyFile &file, size_t currPos, size_t fromByte, size_t toByte) {
+    uint64_t block_size;
+    if (file.read(currPos, reinterpret_cast<char*>(&block_size), sizeof(block_size)) != sizeof(block_size)) {
         return std::make_pair(0, "");
-    } else if ((f_size - currPos) >= BLOCK_HEADER_SIZE) {       
-        const size_t bh_size = BLOCK_HEADER_SIZE;
-        std::vector<char> fh_buff(bh_size, 0);
-        seekFile(ifile, currPos);
-        ifile.read(fh_buff.data(), bh_size);
-        
-        const char *cur_pos = fh_buff.data();
-        
-        const uint64_t block_size = *((const uint64_t *)cur_pos);
-        
-        if (fromByte >= block_size) {
-            return {};
+    }
+    
+    if (fromByte >= block_size) {
+        return {};
+    }
+    if (toByte > block_size) {
+        toByte = block_size;
+    }
+    
+    std::string result(toByte - fromByte, 0);
+    const size_t offsetBeginBlock = sizeof(uint64_t);
+    const size_t readed = file.read(currPos + offsetBeginBlock + fromByte, result.data(), result.size());
+    CHECK(readed == result.size(), "Block in file " + file.getFileName() + " truncated");
+    return std::make_pair(block_size, result);
+}
+
+std::pair<size_t, ReadOnlyFileRange> getBlockDumpRange(const std::shared_ptr<const ReadOnlyFile> &file, size_t currPos, size_t fromByte, size_t toByte) {
+    uint64_t block_size;
+    if (file->read(currPos, reinterpret_cast<char*>(&block_size), sizeof(block_size)) != sizeof(block_size)) {
+        return std::make_pair(0, ReadOnlyFileRange());
+    }
+    
+    if (fromByte >= block_size) {
+        return std::make_pair(0, ReadOnlyFileRange());
+    }
+    if (toByte > block_size) {
+        toByte = block_size;
+    }
+    
+    ReadOnlyFileRange range;
+    range.file = file;
+    const size_t offsetBeginBlock = sizeof(uint64_t);
+    range.offset = currPos + offsetBeginBlock + fromByte;
+    range.length = toByte - fromByte;
+    return std::make_pair(block_size, range);
+}
+
+//c Ищет кусок блоков [from, return), лежащих в файле вплотную, размером не больше maxRangeSize (но хотя бы один блок)
+static size_t findAdjacentBlocks(const std::vector<std::shared_ptr<const BlockHeader>> &bhs, size_t from, size_t maxRangeSize, size_t &rangeSize) {
+    const size_t sizeField = sizeof(uint64_t);
+    const FilePosition &beginPos = bhs[from]->filePos;
+    rangeSize = sizeField + bhs[from]->blockSize;
+    size_t to = from + 1;
+    while (to < bhs.size() && bhs[to]->filePos.pos == beginPos.pos + rangeSize && bhs[to]->filePos.fileName == beginPos.fileName) {
+        const size_t nextRangeSize = rangeSize + sizeField + bhs[to]->blockSize;
+        if (nextRangeSize > maxRangeSize) {
+            break;
         }
-        if (toByte > block_size) {
-            toByte = block_size;
+        rangeSize = nextRangeSize;
+        to++;
+    }
+    return to;
+}
+
+//c Читает блоки [from, to) одним pread в buffer и переводит их размеры в big endian
+static void readFramedBlocks(const std::vector<std::shared_ptr<const BlockHeader>> &bhs, size_t from, size_t to, size_t rangeSize, char *buffer) {
+    const size_t sizeField = sizeof(uint64_t);
+    const FilePosition &beginPos = bhs[from]->filePos;
+    
+    const std::shared_ptr<const ReadOnlyFile> file = getReadOnlyFile(beginPos.fileName);
+    const size_t readed = file->read(beginPos.pos, buffer, rangeSize);
+    CHECK(readed == rangeSize, "Block in file " + beginPos.fileName + " truncated");
+    
+    size_t bufferPos = 0;
+    for (size_t i = from; i < to; i++) {
+        char *sizePtr = buffer + bufferPos;
+        uint64_t blockSize;
+        std::memcpy(&blockSize, sizePtr, sizeField);
+        CHECK(blockSize == bhs[i]->blockSize, "Incorrect block size in file " + beginPos.fileName);
+        for (size_t k = 0; k < sizeField; k++) {
+            sizePtr[sizeField - 1 - k] = static_cast<char>(blockSize % 256);
+            blockSize /= 256;
         }
-        
-        std::string result(toByte - fromByte, 0);
-        const size_t offsetBeginBlock = sizeof(uint64_t);
-        seekFile(ifile, currPos + offsetBeginBlock + fromByte);
-        ifile.read((char*)result.data(), result.size());
-        return std::make_pair(block_size, result);
+        bufferPos += sizeField + bhs[i]->blockSize;
+    }
+}
+
+std::string getBlockDumpsFramed(const std::vector<std::shared_ptr<const BlockHeader>> &bhs) {
+    const size_t sizeField = sizeof(uint64_t);
+    
+    size_t totalSize = 0;
+    for (const std::shared_ptr<const BlockHeader> &bh: bhs) {
+        CHECK(!bh->filePos.fileName.empty(), "Empty file name in block header");
+        totalSize += sizeField + bh->blockSize;
     }
-    return std::make_pair(0, "");;
+    
+    std::string result(totalSize, 0);
+    size_t resultPos = 0;
+    size_t i = 0;
+    while (i < bhs.size()) {
+        size_t rangeSize;
+        const size_t j = findAdjacentBlocks(bhs, i, std::numeric_limits<size_t>::max(), rangeSize);
+        readFramedBlocks(bhs, i, j, rangeSize, result.data() + resultPos);
+        resultPos += rangeSize;
+        i = j;
+    }
+    return result;
+}
+
+void getBlockDumpsFramed(const std::vector<std::shared_ptr<const BlockHeader>> &bhs, size_t maxChunkSize, const std::function<void(std::string_view chunk)> &processChunk) {
+    for (const std::shared_ptr<const BlockHeader> &bh: bhs) {
+        CHECK(!bh->filePos.fileName.empty(), "Empty file name in block header");
+    }
+    
+    std::string chunk;
+    size_t i = 0;
+    while (i < bhs.size()) {
+        size_t rangeSize;
+        const size_t j = findAdjacentBlocks(bhs, i, maxChunkSize, rangeSize);
+        chunk.resize(rangeSize);
+        readFramedBlocks(bhs, i, j, rangeSize, chunk.data());
+        processChunk(chunk);
+        i = j;
+    }
+}
+
+size_t readNextBlockInfo(const std::string &fileName, FileAccessPattern pattern, size_t currPos, BlockInfo &bi, MappedFileView &blockDump, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isReadTxsDetails) {
+    const MappedFileView header = getMappedFileView(fileName, currPos, BLOCK_HEADER_SIZE, pattern);
+    if (header.data.size() != BLOCK_HEADER_SIZE) {
+        return currPos;
+    }
+    bi.header.filePos.pos = currPos;
+    readBlockHeader(header.data.data(), header.data.data() + header.data.size(), bi.header);
+    
+    const size_t b_size = bi.header.blockSize;
+    const size_t offsetBeginBlock = sizeof(uint64_t);
+    blockDump = getMappedFileView(fileName, currPos + offsetBeginBlock, b_size, pattern);
+    if (blockDump.data.size() != b_size) {
+        return currPos;
+    }
+    
+    readBlockTxs(blockDump.data.data(), blockDump.data.data() + blockDump.data.size(), currPos, bi, isSaveAllTx, beginTx, countTx, isValidate, isReadTxsDetails);
+    
+    currPos += (bi.header.blockSize+sizeof(uint64_t));
+    
+    bi.header.endBlockPos = currPos;
+    
+    return currPos;
+}
+
+std::pair<size_t, MappedFileView> getBlockDump(const std::string &fileName, FileAccessPattern pattern, size_t currPos, size_t fromByte, size_t toByte) {
+    const MappedFileView sizeView = getMappedFileView(fileName, currPos, sizeof(uint64_t), pattern);
+    if (sizeView.data.size() != sizeof(uint64_t)) {
+        return std::make_pair(0, MappedFileView());
+    }
+    uint64_t block_size;
+    std::memcpy(&block_size, sizeView.data.data(), sizeof(block_size));
+    
+    if (fromByte >= block_size) {
+        return std::make_pair(0, MappedFileView());
+    }
+    if (toByte > block_size) {
+        toByte = block_size;
+    }
+    
+    const size_t offsetBeginBlock = sizeof(uint64_t);
+    MappedFileView result = getMappedFileView(fileName, currPos + offsetBeginBlock + fromByte, toByte - fromByte, pattern);
+    CHECK(result.data.size() == toByte - fromByte, "Block in file " + fileName + " truncated");
+    return std::make_pair(block_size, result);
 }
 
 }
@@ -4,19 +4,26 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <memory>
+#include <functional>
+#include <string_view>
+
+#include "utils/MappedFilesStore.h"
+#include "utils/ReadOnlyFile.h"
 
 namespace torrent_node_lib {
 
 struct TransactionInfo;
 struct BlockInfo;
+struct BlockHeader;
 class PrivateKey;
 
 /**
  *c Возвращает размер файла до записи в него
  */
-size_t saveBlockToFileBinary(const std::string &fileName, const std::string &data);
+size_t saveBlockToFileBinary(const std::string &fileName, std::string_view data);
 
-size_t saveTransactionToFile(std::ofstream &file, const std::string &data);
+size_t saveTransactionToFile(std::ofstream &file, std::string_view data);
 
 void openFile(std::ifstream &file, const std::string &fileName);
 
@@ -30,11 +37,46 @@ void closeFile(std::ofstream &file);
 
 bool readOneTransactionInfo(std::ifstream &ifile, size_t currPos, TransactionInfo &txInfo, bool isSaveAllTx);
 
-void readNextBlockInfo(const char *begin_pos, const char *end_pos, size_t posInFile, BlockInfo &bi, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx);
+/**
+ *c Без isReadTxsDetails транзакции разбираются облегченно: адрес отправителя и поля из json в data не заполняются.
+ *c Их дочитывает readTransactionDetails по требованию
+ */
+void readNextBlockInfo(const char *begin_pos, const char *end_pos, size_t posInFile, BlockInfo &bi, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isReadTxsDetails = true);
+
+//c Дочитывает поля транзакции, пропущенные облегченным разбором. dump - тот же дамп блока, из которого она разобрана
+void readTransactionDetails(std::string_view dump, TransactionInfo &txInfo);
+
+size_t readNextBlockInfo(std::ifstream &ifile, size_t currPos, BlockInfo &bi, std::string &blockDump, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isReadTxsDetails = true);
+
+size_t readNextBlockInfo(const ReadOnlyFile &file, size_t currPos, BlockInfo &bi, std::string &blockDump, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isReadTxsDetails = true);
+
+std::pair<size_t, std::string> getBlockDump(const ReadOnlyFile &file, size_t currPos, size_t fromByte, size_t toByte);
+
+/**
+ *c Возвращает размер блока и место куска [fromByte, toByte) блока в файле, ничего не читая кроме размера.
+ *c Если fromByte за концом блока, возвращается пустой кусок
+ */
+std::pair<size_t, ReadOnlyFileRange> getBlockDumpRange(const std::shared_ptr<const ReadOnlyFile> &file, size_t currPos, size_t fromByte, size_t toByte);
+
+/**
+ *c Читает дампы блоков в формате ответа get-dumps-blocks-by-* (размер big endian + дамп).
+ *c Блоки, лежащие в файле вплотную друг за другом, читаются одним pread сразу в результат.
+ *c Размер блока в файле и в ответе занимает одинаково 8 байт, поэтому после чтения меняется только порядок байт размера
+ */
+std::string getBlockDumpsFramed(const std::vector<std::shared_ptr<const BlockHeader>> &bhs);
 
-size_t readNextBlockInfo(std::ifstream &ifile, size_t currPos, BlockInfo &bi, std::string &blockDump, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx);
+/**
+ *c То же, но отдает результат кусками не больше maxChunkSize (блок больше maxChunkSize отдается отдельным куском).
+ *c Память ограничена одним куском, буфер куска переиспользуется
+ */
+void getBlockDumpsFramed(const std::vector<std::shared_ptr<const BlockHeader>> &bhs, size_t maxChunkSize, const std::function<void(std::string_view chunk)> &processChunk);
+
+/**
+ *c Варианты чтения через отображение файла в память. blockDump указывает прямо в отображение
+ */
+size_t readNextBlockInfo(const std::string &fileName, FileAccessPattern pattern, size_t currPos, BlockInfo &bi, MappedFileView &blockDump, bool isValidate, bool isSaveAllTx, size_t beginTx, size_t countTx, bool isReadTxsDetails = true);
 
-std::pair<size_t, std::string> getBlockDump(std::ifstream &ifile, size_t currPos, size_t fromByte, size_t toByte);
+std::pair<size_t, MappedFileView> getBlockDump(const std::string &fileName, FileAccessPattern pattern, size_t currPos, size_t fromByte, size_t toByte);
 
 }
 
@@ -20,6 +20,10 @@
 #include <secp256k1.h>
 
 #include <atomic>
+#include <string_view>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 #include "log.h"
 #include "check.h"
@@ -213,7 +217,7 @@ std::string get_address(const std::vector<unsigned char> & bpubk) {
     return address;
 }
 
-std::vector<unsigned char> get_address_bin(const std::vector<unsigned char> & bpubk) {
+static std::vector<unsigned char> calc_address_bin(const std::vector<unsigned char> & bpubk) {
     std::array<unsigned char, RIPEMD160_DIGEST_LENGTH + 1> wide_h;
     std::array<unsigned char, SHA256_DIGEST_LENGTH> hash2;
     const bool res = get_address_comp(bpubk, wide_h, hash2);
@@ -227,6 +231,124 @@ std::vector<unsigned char> get_address_bin(const std::vector<unsigned char> & bp
     return result;
 }
 
+namespace {
+
+//c Адрес и разобранный ключ для одного публичного ключа. Ключ разбирается при первой проверке подписи
+class PubkeyInfo {
+public:
+    
+    explicit PubkeyInfo(std::vector<unsigned char> &&address)
+        : address(std::move(address))
+    {}
+    
+    const std::vector<unsigned char>& getAddress() const {
+        return address;
+    }
+    
+    EVP_PKEY* getKey(std::string_view pubkey) const {
+        std::call_once(isKeyParsed, [this, pubkey] {
+            CHECK(isInitialized, "Not initialized");
+            const unsigned char *data = reinterpret_cast<const unsigned char*>(pubkey.data());
+            key.reset(d2i_PUBKEY(nullptr, &data, pubkey.size()));
+        });
+        return key.get();
+    }
+    
+private:
+    
+    const std::vector<unsigned char> address;
+    
+    mutable std::once_flag isKeyParsed;
+    mutable std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key{nullptr, EVP_PKEY_free};
+};
+
+const static size_t PUBKEY_CACHE_SHARDS = 16;
+const static size_t PUBKEY_CACHE_SHARD_SIZE = 1024;
+
+/**
+ *c Одни и те же отправители (биржи, форжинг, подписи блоков) встречаются почти в каждом блоке,
+ *c поэтому адрес и разобранный ключ запоминаются. Кэш разбит на части со своими мьютексами, чтобы потоки разбора блока не толкались
+ */
+class PubkeyCache {
+public:
+    
+    std::shared_ptr<const PubkeyInfo> get(std::string_view pubkey) {
+        const std::string key(pubkey);
+        Shard &shard = shards[std::hash<std::string>()(key) % shards.size()];
+        {
+            std::lock_guard<std::mutex> lock(shard.mut);
+            const auto found = shard.infos.find(key);
+            if (found != shard.infos.end()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+                countHits.fetch_add(1, std::memory_order_relaxed);
+                return found->second->second;
+            }
+        }
+        countMisses.fetch_add(1, std::memory_order_relaxed);
+        
+        std::shared_ptr<const PubkeyInfo> info = std::make_shared<const PubkeyInfo>(calc_address_bin(std::vector<unsigned char>(pubkey.begin(), pubkey.end())));
+        
+        std::lock_guard<std::mutex> lock(shard.mut);
+        const auto found = shard.infos.find(key);
+        if (found != shard.infos.end()) {
+            return found->second->second;
+        }
+        shard.lru.emplace_front(key, info);
+        shard.infos.emplace(key, shard.lru.begin());
+        if (shard.lru.size() > PUBKEY_CACHE_SHARD_SIZE) {
+            shard.infos.erase(shard.lru.back().first);
+            shard.lru.pop_back();
+        }
+        return info;
+    }
+    
+    PubkeyCacheStatistic getStatistic() {
+        PubkeyCacheStatistic result;
+        result.hits = countHits.load(std::memory_order_relaxed);
+        result.misses = countMisses.load(std::memory_order_relaxed);
+        for (Shard &shard: shards) {
+            std::lock_guard<std::mutex> lock(shard.mut);
+            result.size += shard.lru.size();
+        }
+        return result;
+    }
+    
+private:
+    
+    using Element = std::pair<std::string, std::shared_ptr<const PubkeyInfo>>;
+    
+    struct Shard {
+        std::list<Element> lru;
+        std::unordered_map<std::string, std::list<Element>::iterator> infos;
+        
+        std::mutex mut;
+    };
+    
+    std::array<Shard, PUBKEY_CACHE_SHARDS> shards;
+    
+    std::atomic<size_t> countHits{0};
+    std::atomic<size_t> countMisses{0};
+};
+
+PubkeyCache& getPubkeyCache() {
+    static PubkeyCache cache;
+    return cache;
+}
+
+}
+
+std::vector<unsigned char> get_address_bin(const std::vector<unsigned char> & bpubk) {
+    return get_address_bin(std::string_view(reinterpret_cast<const char*>(bpubk.data()), bpubk.size()));
+}
+
+std::vector<unsigned char> get_address_bin(std::string_view bpubk) {
+    return getPubkeyCache().get(bpubk)->getAddress();
+}
+
+PubkeyCacheStatistic getPubkeyCacheStatistic() {
+    return getPubkeyCache().getStatistic();
+}
+
 /*std::vector<unsigned char> crypto_sign_data(
     const std::vector<unsigned char>& private_key, 
     const unsigned char *data,
@@ -299,9 +421,7 @@ bool crypto_check_sign_data2(
     }
 }
 
-bool CheckBufferSignature(EVP_PKEY* publicKey, const std::vector<char>& data, ECDSA_SIG* signature) {
-    size_t bufsize = data.size();
-    const char* buff = data.data();
+bool CheckBufferSignature(EVP_PKEY* publicKey, const char *buff, size_t bufsize, ECDSA_SIG* signature) {
     
     EVP_MD_CTX* mdctx;
     static const EVP_MD* md = EVP_sha256();
@@ -363,7 +483,7 @@ bool check_sign(const DataContainer& data, const SignContainer& sign, const PubK
     std::vector<char> data_as_vector;
     data_as_vector.insert(data_as_vector.end(), data.begin(), data.end());
     
-    if (CheckBufferSignature(pubkey, data_as_vector, signature)) {
+    if (CheckBufferSignature(pubkey, data_as_vector.data(), data_as_vector.size(), signature)) {
         EVP_PKEY_free(pubkey);
         ECDSA_SIG_free(signature);
         return true;
@@ -380,7 +500,27 @@ bool crypto_check_sign_data(
     const unsigned char *data,
     size_t data_size)
 {
-    return check_sign(std::vector(data, data + data_size), sign, public_key);
+    return crypto_check_sign_data(std::string_view(sign.data(), sign.size()), std::string_view(reinterpret_cast<const char*>(public_key.data()), public_key.size()), data, data_size);
+}
+
+bool crypto_check_sign_data(
+    std::string_view sign, 
+    std::string_view public_key, 
+    const unsigned char *data,
+    size_t data_size)
+{
+    EVP_PKEY *pubkey = getPubkeyCache().get(public_key)->getKey(public_key);
+    if (pubkey == nullptr) {
+        return false;
+    }
+    ECDSA_SIG* signature = ReadSignature(sign);
+    if (signature == nullptr) {
+        return false;
+    }
+    
+    const bool result = CheckBufferSignature(pubkey, reinterpret_cast<const char*>(data), data_size, signature);
+    ECDSA_SIG_free(signature);
+    return result;
 }
 
 void initBlockchainUtilsImpl() {
@@ -2,6 +2,7 @@
 #define BLOCKCHAIN_UTILS_H_
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <array>
 
@@ -17,8 +18,11 @@ std::string get_address(const std::string & pubk);
 
 std::string get_address(const std::vector<unsigned char> & bpubk);
 
+//c Результат кэшируется вместе с разобранным публичным ключом, см. getPubkeyCacheStatistic
 std::vector<unsigned char> get_address_bin(const std::vector<unsigned char> & bpubk);
 
+std::vector<unsigned char> get_address_bin(std::string_view bpubk);
+
 std::string makeAddressFromSecpKey(const std::vector<unsigned char> &pubkey);
 
 bool crypto_check_sign_data(
@@ -27,6 +31,21 @@ bool crypto_check_sign_data(
     const unsigned char *data,
     size_t data_size);
 
+bool crypto_check_sign_data(
+    std::string_view sign, 
+    std::string_view public_key, 
+    const unsigned char *data,
+    size_t data_size);
+
+struct PubkeyCacheStatistic {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t size = 0;
+};
+
+//c Статистика кэша публичных ключей, которым пользуются get_address_bin и crypto_check_sign_data
+PubkeyCacheStatistic getPubkeyCacheStatistic();
+
 void initBlockchainUtilsImpl();
 
 }
@@ -35,7 +35,8 @@ void Cache<Value>::remove(const Attribute& attribute) {
     attributes.erase(attribute);
 }
 
-template class Cache<std::shared_ptr<std::string>>;
+template class Cache<std::shared_ptr<BlockDump>>;
+template class Cache<std::string>;
 template class Cache<TransactionInfo>;
 template class Cache<TransactionStatus>;
 
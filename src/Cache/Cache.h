@@ -14,6 +14,8 @@
 
 #include "HashedString.h"
 
+#include "BlockDump.h"
+
 namespace torrent_node_lib {
 
 template<typename Value>
@@ -45,7 +47,8 @@ struct AllCaches {
     size_t maxCountElementsTxsCache;
     size_t macLocalCacheElements;
     
-    Cache<std::shared_ptr<std::string>> blockDumpCache;
+    Cache<std::shared_ptr<BlockDump>> blockDumpCache;
+    Cache<std::string> blockSignCache;
     Cache<TransactionInfo> txsCache;
     Cache<TransactionStatus> txsStatusCache;
     
@@ -23,6 +23,7 @@ const static std::string KEY_BLOCK_METADATA = "?block_meta";
 const static std::string VERSION_DB = "?version_db";
 
 const static std::string BLOCK_PREFIX = "b_";
+const static std::string BLOCK_SIGN_PREFIX = "bs_";
 const static std::string MAIN_BLOCK_NUMBER_PREFIX = "ms_";
 const static std::string NODE_STAT_BLOCK_NUMBER_PREFIX = "ns_";
 const static std::string FILE_PREFIX = "f_";
@@ -152,6 +153,12 @@ static void makeBlockKey(const std::string& blockHash, std::vector<char> &buffer
     makeKeyPrefix(blockHash, BLOCK_PREFIX, buffer);
 }
 
+static void makeBlockSignKey(const std::string& blockHash, std::vector<char> &buffer) {
+    CHECK(!blockHash.empty(), "Incorrect blockHash: empty");
+    buffer.clear();
+    makeKeyPrefix(blockHash, BLOCK_SIGN_PREFIX, buffer);
+}
+
 static void makeFileKey(const std::string& fileName, std::vector<char> &buffer) {
     CHECK(!fileName.empty(), "Incorrect blockHash: empty");
     buffer.clear();
@@ -167,6 +174,11 @@ void Batch::addBlockHeader(const std::string& blockHash, const std::string& valu
     addKey(buffer, value);
 }
 
+void Batch::addBlockSign(const std::string& blockHash, const std::string& value) {
+    makeBlockSignKey(blockHash, buffer);
+    addKey(buffer, value);
+}
+
 void Batch::addBlockMetadata(const std::string& value) {
     addKey(KEY_BLOCK_METADATA, value);
 }
@@ -218,6 +230,24 @@ std::set<std::string> getAllBlocks(const LevelDb &leveldb) {
     return std::set<std::string>(res.begin(), res.end());
 }
 
+std::string findBlock(const std::string &blockHash, const LevelDb &leveldb) {
+    std::vector<char> key;
+    makeBlockKey(blockHash, key);
+    return leveldb.findOneValueWithoutCheck(key);
+}
+
+std::string findBlockSign(const std::string &blockHash, const LevelDb &leveldb) {
+    std::vector<char> key;
+    makeBlockSignKey(blockHash, key);
+    return leveldb.findOneValueWithoutCheck(key);
+}
+
+void saveBlockSign(const std::string &blockHash, const std::string &value, LevelDb &leveldb) {
+    std::vector<char> key;
+    makeBlockSignKey(blockHash, key);
+    leveldb.saveValue(key, value);
+}
+
 template<class Key, class Value>
 void Batch::addKey(const Key &key, const Value& value) {
     std::lock_guard<std::mutex> lock(mut);
@@ -42,6 +42,8 @@ public:
        
     void addBlockHeader(const std::string &blockHash, const std::string &value);
     
+    void addBlockSign(const std::string &blockHash, const std::string &value);
+    
     void addBlockMetadata(const std::string &value);
     
     void addFileMetadata(const CroppedFileName &fileName, const std::string &value);
@@ -129,6 +131,12 @@ std::unordered_map<CroppedFileName, FileInfo> getAllFiles(const LevelDb &leveldb
 
 std::set<std::string> getAllBlocks(const LevelDb &leveldb);
 
+std::string findBlock(const std::string &blockHash, const LevelDb &leveldb);
+
+std::string findBlockSign(const std::string &blockHash, const LevelDb &leveldb);
+
+void saveBlockSign(const std::string &blockHash, const std::string &value, LevelDb &leveldb);
+
 std::string findModules(const LevelDb &leveldb);
 
 std::string findMainBlock(const LevelDb &leveldb);
@@ -0,0 +1,231 @@
+#include "CurlMulti.h"
+
+#include <future>
+#include <algorithm>
+
+#include "check.h"
+#include "log.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+const static long CONNECT_TIMEOUT_MS = 3000;
+
+const static int POLL_TIMEOUT_MS = 1000;
+
+static size_t writeResponse(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    std::string &response = *static_cast<std::string*>(userdata);
+    response.append(ptr, size * nmemb);
+    return size * nmemb;
+}
+
+CurlMulti::CurlMulti(size_t maxConnectionsPerHost) {
+    CHECK(maxConnectionsPerHost != 0, "Incorrect count connections: 0");
+    multi = curl_multi_init();
+    CHECK(multi != nullptr, "curl_multi_init error");
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(maxConnectionsPerHost));
+    
+    thread = Thread(&CurlMulti::work, this);
+}
+
+CurlMulti::~CurlMulti() {
+    isStopped = true;
+    curl_multi_wakeup(multi);
+    thread.join();
+    curl_multi_cleanup(multi);
+}
+
+CurlMulti::RequestHandle CurlMulti::request(const std::string &url, const std::string &postData, const std::string &header, milliseconds timeout, ResponseCallback callback) {
+    auto request = std::make_unique<Request>();
+    request->url = url;
+    request->postData = postData;
+    request->header = header;
+    request->timeout = timeout;
+    request->callback = std::move(callback);
+    
+    RequestHandle handle;
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        handle = nextHandle++;
+        request->handle = handle;
+        if (isAcceptRequests) {
+            newRequests.emplace_back(std::move(request));
+        }
+    }
+    if (request != nullptr) {
+        request->callback("", CurlException("Stopped"));
+        return handle;
+    }
+    curl_multi_wakeup(multi);
+    return handle;
+}
+
+void CurlMulti::cancel(RequestHandle handle) {
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        if (!isAcceptRequests) {
+            return;
+        }
+        cancelledRequests.emplace_back(handle);
+    }
+    curl_multi_wakeup(multi);
+}
+
+std::string CurlMulti::requestSync(const std::string &url, const std::string &postData, const std::string &header, milliseconds timeout) {
+    std::promise<void> done;
+    std::future<void> future = done.get_future();
+    std::string result;
+    std::optional<CurlException> error;
+    request(url, postData, header, timeout, [&done, &result, &error](std::string &&response, const std::optional<CurlException> &exception) {
+        result = std::move(response);
+        if (exception.has_value()) {
+            error.emplace(exception.value());
+        }
+        done.set_value();
+    });
+    future.get();
+    if (error.has_value()) {
+        throwErr(error->message);
+    }
+    return result;
+}
+
+void CurlMulti::startRequest(std::unique_ptr<Request> request) {
+    CURL *easy = curl_easy_init();
+    if (easy == nullptr) {
+        request->callback("", CurlException("curl_easy_init error"));
+        return;
+    }
+    
+    curl_easy_setopt(easy, CURLOPT_URL, request->url.c_str());
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, static_cast<long>(request->timeout.count()));
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, std::min(CONNECT_TIMEOUT_MS, static_cast<long>(request->timeout.count())));
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, writeResponse);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &request->response);
+    if (!request->postData.empty()) {
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, request->postData.c_str());
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(request->postData.size()));
+    }
+    if (!request->header.empty()) {
+        request->headers = curl_slist_append(nullptr, request->header.c_str());
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, request->headers);
+    }
+    
+    const CURLMcode res = curl_multi_add_handle(multi, easy);
+    if (res != CURLM_OK) {
+        freeRequest(easy, *request);
+        request->callback("", CurlException(std::string("curl_multi_add_handle error: ") + curl_multi_strerror(res)));
+        return;
+    }
+    activeHandles.emplace(request->handle, easy);
+    activeRequests.emplace(easy, std::move(request));
+}
+
+void CurlMulti::freeRequest(CURL *easy, Request &request) {
+    curl_easy_cleanup(easy);
+    if (request.headers != nullptr) {
+        curl_slist_free_all(request.headers);
+        request.headers = nullptr;
+    }
+}
+
+void CurlMulti::finishRequest(CURL *easy, CURLcode result) {
+    const auto found = activeRequests.find(easy);
+    CHECK(found != activeRequests.end(), "Request not found");
+    std::unique_ptr<Request> request = std::move(found->second);
+    activeRequests.erase(found);
+    activeHandles.erase(request->handle);
+    
+    long httpCode = 0;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &httpCode);
+    
+    curl_multi_remove_handle(multi, easy);
+    freeRequest(easy, *request);
+    
+    if (result != CURLE_OK) {
+        request->callback("", CurlException(request->url + ": " + curl_easy_strerror(result)));
+    } else if (httpCode >= 400) {
+        request->callback("", CurlException(request->url + ": http code " + std::to_string(httpCode)));
+    } else {
+        request->callback(std::move(request->response), std::nullopt);
+    }
+}
+
+void CurlMulti::cancelRequest(RequestHandle handle) {
+    const auto foundHandle = activeHandles.find(handle);
+    if (foundHandle == activeHandles.end()) {
+        return;
+    }
+    CURL *easy = foundHandle->second;
+    activeHandles.erase(foundHandle);
+    const auto found = activeRequests.find(easy);
+    CHECK(found != activeRequests.end(), "Request not found");
+    std::unique_ptr<Request> request = std::move(found->second);
+    activeRequests.erase(found);
+    
+    curl_multi_remove_handle(multi, easy);
+    freeRequest(easy, *request);
+    request->callback("", CurlException(request->url + ": cancelled"));
+}
+
+void CurlMulti::work() {
+    while (!isStopped.load()) {
+        try {
+            std::vector<std::unique_ptr<Request>> requests;
+            std::vector<RequestHandle> cancelled;
+            {
+                std::lock_guard<std::mutex> lock(mut);
+                requests.swap(newRequests);
+                cancelled.swap(cancelledRequests);
+            }
+            for (std::unique_ptr<Request> &request: requests) {
+                startRequest(std::move(request));
+            }
+            //c Отмена после запуска: запрос мог быть отменен, еще не дойдя до curl
+            for (const RequestHandle handle: cancelled) {
+                cancelRequest(handle);
+            }
+            
+            int runningHandles = 0;
+            curl_multi_perform(multi, &runningHandles);
+            
+            int messagesLeft = 0;
+            while (CURLMsg *msg = curl_multi_info_read(multi, &messagesLeft)) {
+                if (msg->msg == CURLMSG_DONE) {
+                    finishRequest(msg->easy_handle, msg->data.result);
+                }
+            }
+            
+            curl_multi_poll(multi, nullptr, 0, POLL_TIMEOUT_MS, nullptr);
+        } catch (const exception &e) {
+            LOGERR << e;
+        } catch (const std::exception &e) {
+            LOGERR << e.what();
+        } catch (...) {
+            LOGERR << "Unknown error";
+        }
+    }
+    
+    //c Ждущие ответа должны узнать, что его не будет
+    for (auto &[easy, request]: activeRequests) {
+        curl_multi_remove_handle(multi, easy);
+        freeRequest(easy, *request);
+        request->callback("", CurlException("Stopped"));
+    }
+    activeRequests.clear();
+    activeHandles.clear();
+    
+    std::vector<std::unique_ptr<Request>> requests;
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        isAcceptRequests = false;
+        requests.swap(newRequests);
+    }
+    for (std::unique_ptr<Request> &request: requests) {
+        request->callback("", CurlException("Stopped"));
+    }
+}
+
+}
@@ -0,0 +1,105 @@
+#ifndef CURL_MULTI_H_
+#define CURL_MULTI_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <functional>
+
+#include <curl/curl.h>
+
+#include "duration.h"
+#include "Thread.h"
+
+#include "P2P.h"
+
+namespace torrent_node_lib {
+
+/**
+ *c Асинхронный http клиент: все запросы идут через один curl multi в одном потоке.
+ *c Одновременно могут выполняться сотни запросов, у каждого свой дедлайн.
+ *c callback вызывается из потока клиента, поэтому он не должен долго работать или ждать другие запросы
+ */
+class CurlMulti {
+public:
+
+    using ResponseCallback = std::function<void(std::string &&response, const std::optional<CurlException> &exception)>;
+    
+    using RequestHandle = uint64_t;
+
+public:
+
+    //c maxConnectionsPerHost - больше соединений с одним сервером не открывается, остальные запросы к нему ждут в очереди curl
+    explicit CurlMulti(size_t maxConnectionsPerHost);
+    
+    CurlMulti(const CurlMulti &) = delete;
+    CurlMulti& operator=(const CurlMulti &) = delete;
+    
+    ~CurlMulti();
+    
+    //c timeout - дедлайн всего запроса, включая ожидание свободного соединения. Если клиент остановлен, callback вызывается сразу
+    RequestHandle request(const std::string &url, const std::string &postData, const std::string &header, milliseconds timeout, ResponseCallback callback);
+    
+    //c Прерывает запрос, callback получит ошибку. Если запрос уже завершился, ничего не делает
+    void cancel(RequestHandle handle);
+    
+    //c Для синхронных вызовов. Бросает исключение, если запрос не удался
+    std::string requestSync(const std::string &url, const std::string &postData, const std::string &header, milliseconds timeout);
+
+private:
+
+    struct Request {
+        RequestHandle handle;
+        std::string url;
+        std::string postData;
+        std::string header;
+        milliseconds timeout;
+        ResponseCallback callback;
+        
+        std::string response;
+        curl_slist *headers = nullptr;
+    };
+    
+    void work();
+    
+    void startRequest(std::unique_ptr<Request> request);
+    
+    void finishRequest(CURL *easy, CURLcode result);
+    
+    void cancelRequest(RequestHandle handle);
+    
+    static void freeRequest(CURL *easy, Request &request);
+
+private:
+
+    CURLM *multi;
+    
+    std::mutex mut;
+    
+    std::vector<std::unique_ptr<Request>> newRequests;
+    
+    std::vector<RequestHandle> cancelledRequests;
+    
+    RequestHandle nextHandle = 0;
+    
+    //c Под mut. После остановки потока новые запросы сразу завершаются ошибкой
+    bool isAcceptRequests = true;
+    
+    //c Трогается только из потока клиента
+    std::unordered_map<CURL*, std::unique_ptr<Request>> activeRequests;
+    
+    std::unordered_map<RequestHandle, CURL*> activeHandles;
+    
+    std::atomic<bool> isStopped = false;
+    
+    common::Thread thread;
+
+};
+
+}
+
+#endif // CURL_MULTI_H_
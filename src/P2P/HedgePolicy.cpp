@@ -0,0 +1,78 @@
+#include "HedgePolicy.h"
+
+#include <algorithm>
+
+#include "check.h"
+#include "log.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+const static size_t HEDGE_SAMPLES = 200;
+const static size_t HEDGE_MIN_SAMPLES = 20;
+
+const static milliseconds HEDGE_MIN_DELAY = 10ms;
+
+const static double HEDGE_BUDGET_RATIO = 0.1;
+//c Чтобы в начале синхронизации, когда скачано мало, дубли тоже были возможны
+const static size_t HEDGE_BUDGET_INITIAL_BYTES = 1 * 1024 * 1024;
+
+const static double RESPONSE_SIZE_EWMA = 0.2;
+
+std::string HedgePolicy::makeKey(const std::string &qs, size_t requestSize) {
+    size_t order = 0;
+    while (requestSize > 1) {
+        requestSize >>= 1;
+        order++;
+    }
+    return qs + ":" + std::to_string(order);
+}
+
+void HedgePolicy::addSample(const std::string &qs, size_t requestSize, const milliseconds &time, size_t responseSize) {
+    std::lock_guard<std::mutex> lock(mut);
+    totalBytes += responseSize;
+    
+    Samples &s = samples[makeKey(qs, requestSize)];
+    if (s.times.empty()) {
+        s.avgResponseSize = responseSize;
+    } else {
+        s.avgResponseSize += (responseSize - s.avgResponseSize) * RESPONSE_SIZE_EWMA;
+    }
+    if (s.times.size() < HEDGE_SAMPLES) {
+        s.times.emplace_back(time);
+    } else {
+        s.times[s.nextSample] = time;
+    }
+    s.nextSample = (s.nextSample + 1) % HEDGE_SAMPLES;
+    
+    if (s.times.size() >= HEDGE_MIN_SAMPLES) {
+        std::vector<milliseconds> sorted = s.times;
+        const auto p95 = sorted.begin() + sorted.size() * 95 / 100;
+        std::nth_element(sorted.begin(), p95, sorted.end());
+        s.p95 = std::max(*p95, HEDGE_MIN_DELAY);
+    }
+}
+
+std::optional<milliseconds> HedgePolicy::getHedgeDelay(const std::string &qs, size_t requestSize) const {
+    std::lock_guard<std::mutex> lock(mut);
+    const auto found = samples.find(makeKey(qs, requestSize));
+    if (found == samples.end()) {
+        return std::nullopt;
+    }
+    return found->second.p95;
+}
+
+bool HedgePolicy::takeBudget(const std::string &qs, size_t requestSize) {
+    std::lock_guard<std::mutex> lock(mut);
+    const auto found = samples.find(makeKey(qs, requestSize));
+    CHECK(found != samples.end(), "Hedge samples not found");
+    const size_t expectedSize = found->second.avgResponseSize;
+    if (hedgedBytes + expectedSize > totalBytes * HEDGE_BUDGET_RATIO + HEDGE_BUDGET_INITIAL_BYTES) {
+        return false;
+    }
+    hedgedBytes += expectedSize;
+    return true;
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef HEDGE_POLICY_H_
+#define HEDGE_POLICY_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <optional>
+
+#include "duration.h"
+
+namespace torrent_node_lib {
+
+/**
+ *c Когда дублировать запрос сегмента на другой сервер.
+ *c Время ответа запоминается отдельно для каждого вида запроса (qs) и порядка его размера: байт сегмента или блоков в пачке.
+ *c Запрос, который идет дольше p95 своего вида, стоит продублировать, если хватает бюджета:
+ *c дубли не должны добавлять больше HEDGE_BUDGET_RATIO к уже скачанному объему
+ */
+class HedgePolicy {
+public:
+
+    void addSample(const std::string &qs, size_t requestSize, const milliseconds &time, size_t responseSize);
+    
+    //c nullopt, пока замеров этого вида мало
+    std::optional<milliseconds> getHedgeDelay(const std::string &qs, size_t requestSize) const;
+    
+    //c Списывает из бюджета ожидаемый объем ответа. false, если бюджет исчерпан
+    bool takeBudget(const std::string &qs, size_t requestSize);
+
+private:
+
+    struct Samples {
+        std::vector<milliseconds> times;
+        size_t nextSample = 0;
+        
+        double avgResponseSize = 0;
+        
+        std::optional<milliseconds> p95;
+    };
+    
+    static std::string makeKey(const std::string &qs, size_t requestSize);
+
+private:
+
+    mutable std::mutex mut;
+    
+    std::map<std::string, Samples> samples;
+    
+    size_t totalBytes = 0;
+    
+    size_t hedgedBytes = 0;
+
+};
+
+}
+
+#endif // HEDGE_POLICY_H_
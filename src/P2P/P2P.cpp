@@ -1,16 +1,27 @@
 #include "P2P.h"
 
+#include <deque>
+#include <map>
+#include <condition_variable>
+
+#include "PeerWorkers.h"
+#include "HedgePolicy.h"
+
 #include "check.h"
 #include "log.h"
 
 #include "parallel_for.h"
-#include "BlockedQueue.h"
-#include "Thread.h"
+#include "stopProgram.h"
 
 using namespace common;
 
 namespace torrent_node_lib {
 
+std::string P2P::getBestServer(const std::vector<std::string> &servers) const {
+    CHECK(!servers.empty(), "Servers empty");
+    return servers.front();
+}
+
 std::vector<P2P::Segment> P2P::makeSegments(size_t countSegments, size_t size, size_t minSize) {
     const size_t step = std::min(size, std::max(size / countSegments, minSize));
     CHECK(step != 0, "step == 0");
@@ -28,72 +39,251 @@ std::vector<P2P::Segment> P2P::makeSegments(size_t countSegments, size_t size, s
     return answer;
 }
 
-bool P2P::process(const std::vector<std::reference_wrapper<const Server>> &requestServers, const std::vector<Segment> &segments, const MakeQsAndPostFunction &makeQsAndPost, const RequestFunction &requestFunction) {
-    size_t countSuccessRequests = 0;
-    size_t countExitThreads = 0;
+//c Как часто process проверяет, не пора ли продублировать долгий запрос
+const static milliseconds HEDGE_CHECK_PERIOD = 20ms;
+
+//c Сегменты одного вызова process. Раздаются соединениям по одному, каждый сегмент - отдельная задача воркера.
+//c Живет, пока его держат задачи воркеров, поэтому не ссылается на стек вызывающего
+struct P2P::SegmentsJob {
+    struct SegmentState {
+        //c Сервер и время первого из идущих запросов сегмента
+        std::string server;
+        time_point beginTime;
+        
+        size_t countRequests = 0;
+        bool isDone = false;
+        bool isHedged = false;
+    };
+    
+    //c Соединение с сервером. Пока его сегмент не докачан, новый ему не выдается
+    struct Connection {
+        std::string server;
+        size_t connectionNumber;
+        
+        bool isBusy = false;
+        bool isFailed = false;
+        
+        Connection(const std::string &server, size_t connectionNumber)
+            : server(server)
+            , connectionNumber(connectionNumber)
+        {}
+    };
+    
     std::mutex mut;
     std::condition_variable cond;
     
-    BlockedQueue<Segment, 1000> blockedQueue;
-       
-    std::vector<Thread> threads;
-    threads.reserve(requestServers.size());
-    for (const Server &server: requestServers) {
-        threads.emplace_back([&blockedQueue, &countSuccessRequests, &countExitThreads, &mut, &cond, &requestFunction, &makeQsAndPost, threadNumber=threads.size()](const Server &server){
-            try {
-                while (true) {
-                    Segment segment;
-                    const bool isStopped = !blockedQueue.pop(segment);
-                    if (isStopped) {
-                        break;
-                    }
-                    
-                    const auto &[qs, post] = makeQsAndPost(segment.fromByte, segment.toByte);
-                    try {
-                        requestFunction(threadNumber, qs, post, server.server, segment);
-                        std::lock_guard<std::mutex> lock(mut);
-                        countSuccessRequests++;
-                        cond.notify_one();
-                    } catch (const exception &e) {
-                        LOGWARN << "Error " << e;
-                        blockedQueue.push(segment);
-                        break;
-                    }
-                    
-                    checkStopSignal();
-                }
-            } catch (const exception &e) {
-                LOGERR << e;
-            } catch (const StopException &e) {
-                LOGINFO << "Stop p2p::request thread";
-            } catch (const std::exception &e) {
-                LOGERR << e.what();
-            } catch (...) {
-                LOGERR << "Unknown error";
+    const std::vector<Segment> allSegments;
+    std::vector<std::pair<std::string, std::string>> requests;
+    
+    std::deque<Segment> segments;
+    std::vector<SegmentState> states;
+    std::vector<std::string> answers;
+    
+    std::vector<Connection> connections;
+    
+    size_t countSuccessRequests = 0;
+    size_t countFailedConnections = 0;
+    
+    bool isStopped = false;
+    
+    HedgePolicy *const hedgePolicy;
+    const size_t requestSize;
+    const RequestFunction requestFunction;
+    
+    SegmentsJob(const std::vector<Segment> &segments, HedgePolicy *hedgePolicy, size_t requestSize, const RequestFunction &requestFunction)
+        : allSegments(segments)
+        , segments(segments.begin(), segments.end())
+        , states(segments.size())
+        , answers(segments.size())
+        , hedgePolicy(hedgePolicy)
+        , requestSize(requestSize)
+        , requestFunction(requestFunction)
+    {}
+    
+    //c Размер, по которому hedgePolicy разделяет замеры
+    size_t getRequestSize(const Segment &segment) const {
+        return requestSize != 0 ? requestSize : segment.toByte - segment.fromByte;
+    }
+    
+    //c Вызывается под mut
+    bool isFinished() const {
+        return countSuccessRequests == answers.size() || countFailedConnections == connections.size();
+    }
+    
+    void stop() {
+        std::lock_guard<std::mutex> lock(mut);
+        isStopped = true;
+        cond.notify_all();
+    }
+    
+    //c Под mut. Сегмент, который другой сервер качает дольше p95, если бюджет позволяет его продублировать
+    std::optional<Segment> takeHedgeSegment(const std::string &server, const time_point &now, time_point &nextCheck) {
+        for (const Segment &segment: allSegments) {
+            SegmentState &state = states[segment.posInArray];
+            if (state.isDone || state.isHedged || state.countRequests == 0 || state.server == server) {
+                continue;
+            }
+            const std::string &qs = requests[segment.posInArray].first;
+            const size_t size = getRequestSize(segment);
+            const std::optional<milliseconds> delay = hedgePolicy->getHedgeDelay(qs, size);
+            if (!delay.has_value()) {
+                continue;
+            }
+            const time_point hedgeTime = state.beginTime + delay.value();
+            if (hedgeTime > now) {
+                nextCheck = std::min(nextCheck, hedgeTime);
+                continue;
+            }
+            if (!hedgePolicy->takeBudget(qs, size)) {
+                continue;
             }
-            std::lock_guard<std::mutex> lock(mut);
-            countExitThreads++;
-            cond.notify_one();
-        },
-        server
-        );
+            state.isHedged = true;
+            return segment;
+        }
+        return std::nullopt;
     }
     
-    for (const Segment &segment: segments) {
-        blockedQueue.push(segment);
+    //c Под mut. Следующий сегмент для соединения: из очереди или дубль долгого. nextCheck - когда снова проверить дубли
+    std::optional<Segment> takeSegment(const std::string &server, const time_point &now, time_point &nextCheck) {
+        while (!segments.empty()) {
+            const Segment segment = segments.front();
+            segments.pop_front();
+            if (!states[segment.posInArray].isDone) {
+                return segment;
+            }
+        }
+        if (hedgePolicy == nullptr) {
+            return std::nullopt;
+        }
+        return takeHedgeSegment(server, now, nextCheck);
+    }
+};
+
+void P2P::processSegment(SegmentsJob &job, size_t connectionIndex, const Segment &segment, size_t connectionNumber) {
+    const std::string &server = job.connections[connectionIndex].server;
+    const auto &[qs, post] = job.requests[segment.posInArray];
+    
+    const IsCancelledFunction isCancelled = [&job, posInArray=segment.posInArray] {
+        std::lock_guard<std::mutex> lock(job.mut);
+        return job.isStopped || job.states[posInArray].isDone;
+    };
+    
+    //c Задача могла дождаться очереди воркера, когда сегмент уже скачан или process закончен
+    if (isCancelled()) {
+        std::lock_guard<std::mutex> lock(job.mut);
+        job.states[segment.posInArray].countRequests--;
+        job.connections[connectionIndex].isBusy = false;
+        job.cond.notify_all();
+        return;
+    }
+    
+    std::string answer;
+    bool isSuccess = false;
+    try {
+        Timer tt;
+        answer = job.requestFunction(connectionNumber, qs, post, server, segment, isCancelled);
+        tt.stop();
+        if (job.hedgePolicy != nullptr) {
+            job.hedgePolicy->addSample(qs, job.getRequestSize(segment), tt.count(), answer.size());
+        }
+        isSuccess = true;
+    } catch (const exception &e) {
+        if (!isCancelled()) {
+            LOGWARN << "Error " << e;
+        }
+    } catch (const StopException &e) {
+        LOGINFO << "Stop p2p::request";
+    } catch (const std::exception &e) {
+        LOGERR << e.what();
+    } catch (...) {
+        LOGERR << "Unknown error";
     }
     
-    std::unique_lock<std::mutex> lock(mut);
-    conditionWait(cond, lock, [&countSuccessRequests, &countExitThreads, countSegments=segments.size(), &threads](){return countSuccessRequests == countSegments || countExitThreads == threads.size(); });
-    lock.unlock();
-    blockedQueue.stop();
-    for (auto &thread: threads) {
-        thread.join();
+    std::lock_guard<std::mutex> lock(job.mut);
+    SegmentsJob::SegmentState &state = job.states[segment.posInArray];
+    SegmentsJob::Connection &connection = job.connections[connectionIndex];
+    state.countRequests--;
+    connection.isBusy = false;
+    if (isSuccess) {
+        //c Проигравший дубль и ответ после окончания process просто отбрасываются
+        if (!state.isDone && !job.isStopped) {
+            state.isDone = true;
+            job.answers[segment.posInArray] = std::move(answer);
+            job.countSuccessRequests++;
+        }
+    } else if (!state.isDone && !job.isStopped) {
+        //c Упавший после отмены запрос (проигравший дубль или после окончания process) соединение не выбивает
+        connection.isFailed = true;
+        job.countFailedConnections++;
+        //c Если дубль еще идет, сегмент в очередь не возвращается
+        if (state.countRequests == 0) {
+            state.isHedged = false;
+            job.segments.push_back(segment);
+        }
     }
+    job.cond.notify_all();
+}
+
+bool P2P::process(PeerWorkers &workers, HedgePolicy *hedgePolicy, const std::vector<std::reference_wrapper<const Server>> &requestServers, const std::vector<Segment> &segments, size_t requestSize, const MakeQsAndPostFunction &makeQsAndPost, const RequestFunction &requestFunction, std::vector<std::string> &answers) {
+    CHECK(!requestServers.empty(), "Servers empty");
     
-    checkStopSignal();
+    const std::shared_ptr<SegmentsJob> job = std::make_shared<SegmentsJob>(segments, hedgePolicy, requestSize, requestFunction);
+    job->requests.reserve(segments.size());
+    for (const Segment &segment: segments) {
+        job->requests.emplace_back(makeQsAndPost(segment.fromByte, segment.toByte));
+    }
+    std::map<std::string, size_t> countServerConnections;
+    job->connections.reserve(requestServers.size());
+    for (const Server &server: requestServers) {
+        job->connections.emplace_back(server.server, countServerConnections[server.server]++);
+    }
+    
+    //c Задача воркера качает один сегмент и освобождает его, так что воркер не занят этим вызовом, пока ждет следующий.
+    //c Следующий сегмент соединению выдает этот поток, когда оно освободится
+    bool isSuccess;
+    try {
+        std::unique_lock<std::mutex> lock(job->mut);
+        while (!job->isFinished()) {
+            const time_point now = ::now();
+            time_point nextCheck = now + (hedgePolicy != nullptr ? HEDGE_CHECK_PERIOD : 100ms);
+            for (size_t i = 0; i < job->connections.size(); i++) {
+                SegmentsJob::Connection &connection = job->connections[i];
+                if (connection.isBusy || connection.isFailed) {
+                    continue;
+                }
+                const std::optional<Segment> segment = job->takeSegment(connection.server, now, nextCheck);
+                if (!segment.has_value()) {
+                    continue;
+                }
+                SegmentsJob::SegmentState &state = job->states[segment->posInArray];
+                if (state.countRequests == 0) {
+                    state.server = connection.server;
+                    state.beginTime = now;
+                }
+                state.countRequests++;
+                connection.isBusy = true;
+                workers.submit(connection.server, connection.connectionNumber, [job, i, segment=segment.value()](size_t connectionNumber) {
+                    processSegment(*job, i, segment, connectionNumber);
+                });
+            }
+            
+            job->cond.wait_until(lock, nextCheck);
+            
+            lock.unlock();
+            checkStopSignal();
+            lock.lock();
+        }
+        isSuccess = job->countSuccessRequests == job->answers.size();
+    } catch (...) {
+        job->stop();
+        throw;
+    }
+    //c Проигравшие дубли докачиваются без нас, их ответы отбрасываются
+    job->stop();
     
-    return countSuccessRequests == segments.size();
+    std::lock_guard<std::mutex> lock(job->mut);
+    answers = std::move(job->answers);
+    return isSuccess;
 }
 
 SendAllResult P2P::process(const std::vector<std::reference_wrapper<const Server>> &requestServers, const std::string &qs, const std::string &post, const std::string &header, const RequestFunctionSimple &requestFunction) {
@@ -12,6 +12,10 @@
 
 namespace torrent_node_lib {
 
+class PeerWorkers;
+
+class HedgePolicy;
+
 struct CurlException {
     
     CurlException(const std::string &message)
@@ -53,6 +57,17 @@ struct SendAllResult {
     std::vector<SendOneResult> results;
 };
 
+struct PeerStatistic {
+    std::string server;
+    double latencyMs = 0;
+    double bytesPerSecond = 0;
+    double errorRate = 0;
+    double score = 0;
+    size_t countRequests = 0;
+    size_t countErrors = 0;
+    bool isEjected = false;
+};
+
 class P2P {   
 public:
     
@@ -66,12 +81,25 @@ public:
     
     virtual std::string request(size_t responseSize, bool isPrecisionSize, const MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const = 0;
     
-    virtual std::vector<std::string> requests(size_t countRequests, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const = 0;
+    //c requestSize - сколько данных в одном запросе, например блоков в пачке. По нему HedgePolicy отделяет замеры запросов разного размера
+    virtual std::vector<std::string> requests(size_t countRequests, size_t requestSize, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const = 0;
     
     virtual std::string runOneRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const = 0;
     
     virtual SendAllResult requestAll(const std::string &qs, const std::string &postData, const std::string &header, const std::set<std::string> &additionalServers) const = 0;
     
+    //c Для long poll: время ответа ничего не говорит о сервере, поэтому в его оценку не идет
+    virtual std::string runLongPollRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const {
+        return runOneRequest(server, qs, postData, header);
+    }
+    
+    //c Сервер из servers для запросов, которые нельзя разделить между серверами
+    virtual std::string getBestServer(const std::vector<std::string> &servers) const;
+    
+    virtual std::vector<PeerStatistic> getPeersStatistic() const {
+        return {};
+    }
+    
 protected:
     
     struct Server {
@@ -96,16 +124,34 @@ protected:
         {}
     };
     
-    using RequestFunction = std::function<void(size_t threadNumber, const std::string &qs, const std::string &post, const std::string &server, const Segment &segment)>;
+    //c isCancelled возвращает true, когда ответ больше не нужен: сегмент скачан дублем или process закончен
+    using IsCancelledFunction = std::function<bool()>;
+    
+    //c connectionNumber - номер соединения с сервером, от 0 до countConnections. Возвращает ответ для сегмента.
+    //c Может выполняться и после возврата из process, поэтому не должна ссылаться на стек вызывающего
+    using RequestFunction = std::function<std::string(size_t connectionNumber, const std::string &qs, const std::string &post, const std::string &server, const Segment &segment, const IsCancelledFunction &isCancelled)>;
     
     using RequestFunctionSimple = std::function<std::string(const std::string &qs, const std::string &post, const std::string &header, const std::string &server)>;
         
     static std::vector<Segment> makeSegments(size_t countSegments, size_t size, size_t minSize);
     
-    static bool process(const std::vector<std::reference_wrapper<const Server>> &requestServers, const std::vector<Segment> &segments, const MakeQsAndPostFunction &makeQsAndPost, const RequestFunction &requestFunction);
+    /**
+     *c Раздает сегменты соединениям по одному: каждый сегмент - отдельная задача воркера workers, так что параллельные вызовы process
+     *c чередуются на воркерах сервера. Каждое вхождение сервера в requestServers - еще одно его соединение.
+     *c Соединение, на котором запрос упал, возвращает сегмент в очередь и больше в этом вызове не участвует.
+     *c Если задан hedgePolicy, свободное соединение дублирует сегмент, который другой сервер качает слишком долго. Берется первый ответ,
+     *c process возвращается, не дожидаясь проигравшего. requestSize - размер запроса для hedgePolicy, 0 - размер сегмента
+     */
+    static bool process(PeerWorkers &workers, HedgePolicy *hedgePolicy, const std::vector<std::reference_wrapper<const Server>> &requestServers, const std::vector<Segment> &segments, size_t requestSize, const MakeQsAndPostFunction &makeQsAndPost, const RequestFunction &requestFunction, std::vector<std::string> &answers);
     
     static SendAllResult process(const std::vector<std::reference_wrapper<const Server>> &requestServers, const std::string &qs, const std::string &post, const std::string &header, const RequestFunctionSimple &requestFunction);
     
+private:
+    
+    struct SegmentsJob;
+    
+    static void processSegment(SegmentsJob &job, size_t connectionIndex, const Segment &segment, size_t connectionNumber);
+    
 };
 
 }
@@ -0,0 +1,467 @@
+#include "P2P_Async.h"
+
+#include <deque>
+#include <algorithm>
+#include <condition_variable>
+
+#include "check.h"
+#include "log.h"
+
+#include "stopProgram.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+const static milliseconds REQUEST_TIMEOUT = 5s;
+
+//c Как часто ожидающий requestImpl проверяет, не пора ли продублировать долгий запрос
+const static milliseconds HEDGE_CHECK_PERIOD = 20ms;
+
+static std::string makeUrl(const std::string &server, const std::string &qs) {
+    std::string url = server;
+    CHECK(!url.empty(), "server empty");
+    if (url[url.size() - 1] != '/') {
+        url += '/';
+    }
+    url += qs;
+    return url;
+}
+
+struct P2P_Async::PendingSegment {
+    std::string server;
+    Segment segment;
+};
+
+//c Состояние одного вызова requestImpl. Меняется только под mut
+struct P2P_Async::SegmentsJob {
+    struct SegmentState {
+        //c Сервер и время первого из идущих запросов сегмента
+        std::string server;
+        time_point beginTime;
+        
+        size_t countRequests = 0;
+        bool isDone = false;
+        bool isHedged = false;
+        
+        //c Чтобы отменить проигравший дубль
+        std::vector<CurlMulti::RequestHandle> handles;
+    };
+    
+    std::mutex mut;
+    std::condition_variable cond;
+    
+    std::vector<Segment> allSegments;
+    std::deque<Segment> segments;
+    std::vector<SegmentState> states;
+    //c qs и post для каждого сегмента по posInArray, чтобы не вызывать makeQsAndPost из потока CurlMulti
+    std::vector<std::pair<std::string, std::string>> requests;
+    std::vector<std::string> answers;
+    
+    //c Живые соединения, которым сейчас нечего скачивать. Получат сегмент, если кто-то вернет его в очередь, или станут дублем
+    std::vector<std::string> idleConnections;
+    
+    size_t countSuccessRequests = 0;
+    size_t countAliveConnections;
+    
+    //c После этого ответы игнорируются: responseParse мог уже умереть вместе с вызывающим
+    bool isStopped = false;
+    
+    const std::string header;
+    const bool isPrecisionSize;
+    const size_t requestSize;
+    const ResponseParseFunction &responseParse;
+    
+    SegmentsJob(size_t countAliveConnections, const std::string &header, bool isPrecisionSize, size_t requestSize, const ResponseParseFunction &responseParse)
+        : countAliveConnections(countAliveConnections)
+        , header(header)
+        , isPrecisionSize(isPrecisionSize)
+        , requestSize(requestSize)
+        , responseParse(responseParse)
+    {}
+    
+    //c Размер, по которому hedgePolicy разделяет замеры
+    size_t getRequestSize(const Segment &segment) const {
+        return requestSize != 0 ? requestSize : segment.toByte - segment.fromByte;
+    }
+    
+    bool isFinished() const {
+        return countSuccessRequests == answers.size() || countAliveConnections == 0;
+    }
+    
+    void startSegment(const std::string &server, const Segment &segment) {
+        SegmentState &state = states[segment.posInArray];
+        if (state.countRequests == 0) {
+            state.server = server;
+            state.beginTime = ::now();
+        }
+        state.countRequests++;
+    }
+    
+    //c Под mut. Берет сегмент для соединения с server или откладывает соединение до появления сегментов
+    std::optional<PendingSegment> takeSegment(const std::string &server) {
+        while (!segments.empty()) {
+            const Segment segment = segments.front();
+            segments.pop_front();
+            if (!states[segment.posInArray].isDone) {
+                startSegment(server, segment);
+                return PendingSegment{server, segment};
+            }
+        }
+        idleConnections.emplace_back(server);
+        return std::nullopt;
+    }
+    
+    //c Под mut. Дубли сегментов, которые качаются дольше p95, на свободные соединения других серверов
+    std::vector<PendingSegment> takeHedgeSegments(HedgePolicy &hedgePolicy, const time_point &now, time_point &nextCheck) {
+        std::vector<PendingSegment> hedges;
+        for (const Segment &segment: allSegments) {
+            if (idleConnections.empty()) {
+                break;
+            }
+            SegmentState &state = states[segment.posInArray];
+            if (state.isDone || state.isHedged || state.countRequests == 0) {
+                continue;
+            }
+            const auto foundIdle = std::find_if(idleConnections.begin(), idleConnections.end(), [&state](const std::string &server) {
+                return server != state.server;
+            });
+            if (foundIdle == idleConnections.end()) {
+                continue;
+            }
+            const std::string &qs = requests[segment.posInArray].first;
+            const size_t size = getRequestSize(segment);
+            const std::optional<milliseconds> delay = hedgePolicy.getHedgeDelay(qs, size);
+            if (!delay.has_value()) {
+                continue;
+            }
+            const time_point hedgeTime = state.beginTime + delay.value();
+            if (hedgeTime > now) {
+                nextCheck = std::min(nextCheck, hedgeTime);
+                continue;
+            }
+            if (!hedgePolicy.takeBudget(qs, size)) {
+                continue;
+            }
+            state.isHedged = true;
+            startSegment(*foundIdle, segment);
+            hedges.push_back(PendingSegment{*foundIdle, segment});
+            idleConnections.erase(foundIdle);
+        }
+        return hedges;
+    }
+};
+
+P2P_Async::P2P_Async(const std::vector<std::string> &servers, size_t countConnections)
+    : servers(servers.begin(), servers.end())
+    , countConnections(countConnections)
+    , multi(countConnections)
+{
+    CHECK(countConnections != 0, "Incorrect count connections: 0");
+}
+
+void P2P_Async::broadcast(const std::string &qs, const std::string &postData, const std::string &header, const BroadcastResult &callback) const {
+    std::mutex mut;
+    std::condition_variable cond;
+    size_t countResponses = 0;
+    
+    for (const Server &server: servers) {
+        multi.request(makeUrl(server.server, qs), postData, header, REQUEST_TIMEOUT, [&mut, &cond, &countResponses, &callback, &server](std::string &&response, const std::optional<CurlException> &exception) {
+            if (exception.has_value()) {
+                callback(server.server, "", exception);
+            } else {
+                callback(server.server, response, std::nullopt);
+            }
+            std::lock_guard<std::mutex> lock(mut);
+            countResponses++;
+            cond.notify_one();
+        });
+    }
+    
+    //c Каждый запрос завершается не позже своего дедлайна, поэтому ждем всех, даже если программу останавливают: callback ссылается на стек
+    std::unique_lock<std::mutex> lock(mut);
+    cond.wait(lock, [&countResponses, this] {
+        return countResponses == servers.size();
+    });
+    lock.unlock();
+    
+    checkStopSignal();
+}
+
+std::string P2P_Async::runOneRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const {
+    const time_point beginTime = ::now();
+    try {
+        std::string response = multi.requestSync(makeUrl(server, qs), postData, header, REQUEST_TIMEOUT);
+        scores.addSuccess(server, std::chrono::duration_cast<milliseconds>(::now() - beginTime), response.size());
+        return response;
+    } catch (...) {
+        scores.addError(server);
+        throw;
+    }
+}
+
+std::string P2P_Async::runLongPollRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const {
+    return multi.requestSync(makeUrl(server, qs), postData, header, REQUEST_TIMEOUT);
+}
+
+std::string P2P_Async::getBestServer(const std::vector<std::string> &servers) const {
+    return scores.getBestServer(servers);
+}
+
+std::vector<PeerStatistic> P2P_Async::getPeersStatistic() const {
+    return scores.getStatistic();
+}
+
+void P2P_Async::sendSegments(const std::shared_ptr<SegmentsJob> &job, std::vector<PendingSegment> &&pendings) const {
+    for (PendingSegment &pending: pendings) {
+        const auto &[qs, post] = job->requests.at(pending.segment.posInArray);
+        const CurlMulti::RequestHandle handle = multi.request(makeUrl(pending.server, qs), post, job->header, REQUEST_TIMEOUT, [this, job, server=pending.server, segment=pending.segment, beginTime=::now()](std::string &&response, const std::optional<CurlException> &exception) {
+            onSegmentResponse(job, server, segment, beginTime, std::move(response), exception);
+        });
+        
+        bool isDone;
+        {
+            std::lock_guard<std::mutex> lock(job->mut);
+            SegmentsJob::SegmentState &state = job->states[pending.segment.posInArray];
+            isDone = state.isDone;
+            if (!isDone) {
+                state.handles.emplace_back(handle);
+            }
+        }
+        //c Сегмент успели скачать другим запросом, пока этот отправлялся
+        if (isDone) {
+            multi.cancel(handle);
+        }
+    }
+}
+
+void P2P_Async::onSegmentResponse(const std::shared_ptr<SegmentsJob> &job, const std::string &server, const Segment &segment, const time_point &beginTime, std::string &&response, const std::optional<CurlException> &exception) const {
+    const milliseconds time = std::chrono::duration_cast<milliseconds>(::now() - beginTime);
+    std::vector<PendingSegment> next;
+    std::vector<CurlMulti::RequestHandle> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(job->mut);
+        if (job->isStopped) {
+            return;
+        }
+        
+        SegmentsJob::SegmentState &state = job->states[segment.posInArray];
+        state.countRequests--;
+        
+        if (state.isDone) {
+            //c Проигравший дубль, отмененный или опоздавший. Соединение живо и может качать дальше
+            std::optional<PendingSegment> pending = job->takeSegment(server);
+            if (pending.has_value()) {
+                next.emplace_back(std::move(pending.value()));
+            }
+        } else {
+            bool isSuccess = false;
+            if (exception.has_value()) {
+                LOGWARN << "Error " << exception->message;
+            } else {
+                try {
+                    const ResponseParse parsed = job->responseParse(response);
+                    CHECK(!parsed.error.has_value(), parsed.error.value());
+                    if (job->isPrecisionSize) {
+                        CHECK(parsed.response.size() == segment.toByte - segment.fromByte, "Incorrect response size");
+                    }
+                    job->answers.at(segment.posInArray) = parsed.response;
+                    isSuccess = true;
+                } catch (const common::exception &e) {
+                    LOGWARN << "Error " << e;
+                } catch (const std::exception &e) {
+                    LOGWARN << "Error " << e.what();
+                }
+            }
+            
+            if (isSuccess) {
+                scores.addSuccess(server, time, response.size());
+                hedgePolicy.addSample(job->requests[segment.posInArray].first, job->getRequestSize(segment), time, response.size());
+            } else {
+                scores.addError(server);
+            }
+            
+            if (isSuccess) {
+                state.isDone = true;
+                cancelled.swap(state.handles);
+                job->countSuccessRequests++;
+                std::optional<PendingSegment> pending = job->takeSegment(server);
+                if (pending.has_value()) {
+                    next.emplace_back(std::move(pending.value()));
+                }
+            } else {
+                //c Как в P2P::process: соединение, на котором запрос упал, выбывает, а сегмент достается другому. Если идет дубль, ждем его
+                if (state.countRequests == 0) {
+                    state.isHedged = false;
+                    job->segments.push_back(segment);
+                }
+                job->countAliveConnections--;
+                while (!job->idleConnections.empty() && !job->segments.empty()) {
+                    const std::string idleServer = job->idleConnections.back();
+                    job->idleConnections.pop_back();
+                    std::optional<PendingSegment> pending = job->takeSegment(idleServer);
+                    if (pending.has_value()) {
+                        next.emplace_back(std::move(pending.value()));
+                    }
+                }
+            }
+        }
+        
+        if (job->isFinished()) {
+            job->cond.notify_all();
+        }
+    }
+    //c Среди них и собственный запрос, он уже завершен, так что его отмена ничего не делает
+    for (const CurlMulti::RequestHandle handle: cancelled) {
+        multi.cancel(handle);
+    }
+    sendSegments(job, std::move(next));
+}
+
+std::vector<std::string> P2P_Async::requestImpl(size_t responseSize, size_t minResponseSize, size_t requestSize, bool isPrecisionSize, const MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
+    CHECK(responseSize != 0, "response size 0");
+    CHECK(!hintsServers.empty(), "Servers empty");
+    
+    std::vector<std::string> serversNames;
+    for (const std::string &server: hintsServers) {
+        if (std::find(serversNames.begin(), serversNames.end(), server) == serversNames.end()) {
+            serversNames.emplace_back(server);
+        }
+    }
+    const std::vector<std::pair<std::string, size_t>> distribution = scores.distributeConnections(serversNames, countConnections);
+    size_t countRequestConnections = 0;
+    for (const auto &[server, connections]: distribution) {
+        countRequestConnections += connections;
+    }
+    
+    const bool isMultitplyRequests = minResponseSize == 1;
+    const size_t countSegments = isMultitplyRequests ? responseSize : std::min((responseSize + minResponseSize - 1) / minResponseSize, countRequestConnections);
+    
+    const std::vector<Segment> segments = P2P::makeSegments(countSegments, responseSize, minResponseSize);
+    
+    const std::shared_ptr<SegmentsJob> job = std::make_shared<SegmentsJob>(countRequestConnections, header, isPrecisionSize, requestSize, responseParse);
+    job->allSegments = segments;
+    job->segments.assign(segments.begin(), segments.end());
+    job->states.resize(segments.size());
+    job->answers.resize(segments.size());
+    job->requests.reserve(segments.size());
+    for (const Segment &segment: segments) {
+        job->requests.emplace_back(makeQsAndPost(segment.fromByte, segment.toByte));
+    }
+    
+    std::vector<PendingSegment> pendings;
+    {
+        std::lock_guard<std::mutex> lock(job->mut);
+        for (size_t i = 0; i < countConnections; i++) {
+            for (const auto &[server, connections]: distribution) {
+                if (i >= connections) {
+                    continue;
+                }
+                std::optional<PendingSegment> pending = job->takeSegment(server);
+                if (pending.has_value()) {
+                    pendings.emplace_back(std::move(pending.value()));
+                }
+            }
+        }
+    }
+    sendSegments(job, std::move(pendings));
+    
+    std::unique_lock<std::mutex> lock(job->mut);
+    try {
+        while (!job->isFinished()) {
+            const time_point now = ::now();
+            time_point nextCheck = now + HEDGE_CHECK_PERIOD;
+            std::vector<PendingSegment> hedges = job->takeHedgeSegments(hedgePolicy, now, nextCheck);
+            if (!hedges.empty()) {
+                lock.unlock();
+                sendSegments(job, std::move(hedges));
+                lock.lock();
+                continue;
+            }
+            job->cond.wait_until(lock, nextCheck);
+            checkStopSignal();
+        }
+    } catch (...) {
+        job->isStopped = true;
+        throw;
+    }
+    job->isStopped = true;
+    //c Оставшиеся запросы больше не нужны
+    std::vector<CurlMulti::RequestHandle> cancelled;
+    for (SegmentsJob::SegmentState &state: job->states) {
+        if (state.countRequests != 0) {
+            cancelled.insert(cancelled.end(), state.handles.begin(), state.handles.end());
+        }
+    }
+    lock.unlock();
+    for (const CurlMulti::RequestHandle handle: cancelled) {
+        multi.cancel(handle);
+    }
+    
+    lock.lock();
+    CHECK(job->countSuccessRequests == job->answers.size(), "dont run request");
+    
+    return std::move(job->answers);
+}
+
+std::string P2P_Async::request(size_t responseSize, bool isPrecisionSize, const MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
+    const size_t MIN_RESPONSE_SIZE = 1000;
+    
+    const std::vector<std::string> answers = requestImpl(responseSize, MIN_RESPONSE_SIZE, 0, isPrecisionSize, makeQsAndPost, header, responseParse, hintsServers);
+    
+    std::string response;
+    response.reserve(responseSize);
+    for (const std::string &answer: answers) {
+        response += answer;
+    }
+    if (isPrecisionSize) {
+        CHECK(response.size() == responseSize, "response size != getted response. Getted response size: " + std::to_string(response.size()) + ". Expected response size: " + std::to_string(responseSize));
+    }
+    
+    return response;
+}
+
+std::vector<std::string> P2P_Async::requests(size_t countRequests, size_t requestSize, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
+    const auto makeQsAndPortImpl = [makeQsAndPost](size_t from, size_t to) {
+        CHECK(to == from + 1, "Incorrect call makeQsAndPortFunc");
+        return makeQsAndPost(from);
+    };
+    const std::vector<std::string> answers = requestImpl(countRequests, 1, requestSize, false, makeQsAndPortImpl, header, responseParse, hintsServers);
+    CHECK(answers.size() == countRequests, "Incorrect count answers");
+    return answers;
+}
+
+SendAllResult P2P_Async::requestAll(const std::string &qs, const std::string &postData, const std::string &header, const std::set<std::string> &additionalServers) const {
+    SendAllResult result;
+    std::mutex mut;
+    std::condition_variable cond;
+    
+    for (const std::string &server: additionalServers) {
+        multi.request(makeUrl(server, qs), postData, header, REQUEST_TIMEOUT, [&result, &mut, &cond, server, beginTime=::now()](std::string &&response, const std::optional<CurlException> &exception) {
+            ResponseParse r;
+            if (exception.has_value()) {
+                r.error = exception->message;
+            } else {
+                r.response = std::move(response);
+            }
+            const milliseconds time = std::chrono::duration_cast<milliseconds>(::now() - beginTime);
+            
+            std::lock_guard<std::mutex> lock(mut);
+            result.results.emplace_back(server, r, time);
+            cond.notify_one();
+        });
+    }
+    
+    //c Ждем всех, даже если программу останавливают: callback ссылается на стек
+    std::unique_lock<std::mutex> lock(mut);
+    cond.wait(lock, [&result, &additionalServers] {
+        return result.results.size() == additionalServers.size();
+    });
+    lock.unlock();
+    
+    checkStopSignal();
+    
+    return result;
+}
+
+}
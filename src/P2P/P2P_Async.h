@@ -0,0 +1,73 @@
+#ifndef P2P_ASYNC_H_
+#define P2P_ASYNC_H_
+
+#include "P2P.h"
+
+#include <memory>
+
+#include "CurlMulti.h"
+#include "PeerScores.h"
+#include "HedgePolicy.h"
+
+namespace torrent_node_lib {
+
+/**
+ *c То же, что P2P_Ips, но все запросы идут через один CurlMulti, без потока на запрос.
+ *c broadcast и requestAll отправляют запросы ко всем серверам сразу, сегменты скачиваются не более чем по countConnections соединениям на сервер.
+ *c Сегмент, который качается дольше p95, дублируется на свободное соединение другого сервера, проигравший запрос отменяется
+ */
+class P2P_Async: public P2P {
+public:
+
+    P2P_Async(const std::vector<std::string> &servers, size_t countConnections);
+    
+    /**
+     *c Выполняет запрос по всем серверам. Результаты возвращает в callback.
+     *c callback вызывается из потока CurlMulti.
+     */
+    void broadcast(const std::string &qs, const std::string &postData, const std::string &header, const BroadcastResult &callback) const override;
+    
+    std::string request(size_t responseSize, bool isPrecisionSize, const MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const override;
+    
+    std::vector<std::string> requests(size_t countRequests, size_t requestSize, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const override;
+    
+    std::string runOneRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const override;
+    
+    SendAllResult requestAll(const std::string &qs, const std::string &postData, const std::string &header, const std::set<std::string> &additionalServers) const override;
+    
+    std::string runLongPollRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const override;
+    
+    std::string getBestServer(const std::vector<std::string> &servers) const override;
+    
+    std::vector<PeerStatistic> getPeersStatistic() const override;
+
+private:
+
+    struct SegmentsJob;
+    
+    struct PendingSegment;
+    
+    std::vector<std::string> requestImpl(size_t responseSize, size_t minResponseSize, size_t requestSize, bool isPrecisionSize, const MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const;
+    
+    void sendSegments(const std::shared_ptr<SegmentsJob> &job, std::vector<PendingSegment> &&pendings) const;
+    
+    void onSegmentResponse(const std::shared_ptr<SegmentsJob> &job, const std::string &server, const Segment &segment, const time_point &beginTime, std::string &&response, const std::optional<CurlException> &exception) const;
+
+private:
+
+    std::vector<Server> servers;
+    
+    size_t countConnections;
+    
+    mutable PeerScores scores;
+    
+    mutable HedgePolicy hedgePolicy;
+    
+    //c Объявлен последним: при остановке его поток еще вызывает callback, которые трогают scores и hedgePolicy
+    mutable CurlMulti multi;
+
+};
+
+}
+
+#endif // P2P_ASYNC_H_
@@ -13,6 +13,7 @@ using namespace torrent_node_lib;
 
 P2P_Graph::P2P_Graph(const std::vector<std::pair<std::string, std::string>> &graphVec, const std::string &thisIp, size_t countConnections)
     : countConnections(countConnections)
+    , workers(countConnections)
 {
     CHECK(countConnections != 0, "Incorrect count connections: 0");
     Curl::initialize();
@@ -84,21 +85,21 @@ std::vector<std::string> P2P_Graph::requestImpl(size_t responseSize, size_t minR
     const bool isMultitplyRequests = minResponseSize == 1;
     const size_t countSegments = isMultitplyRequests ? responseSize : std::min((responseSize + minResponseSize - 1) / minResponseSize, requestServers.size());
     
-    std::vector<std::string> answers(countSegments);
-    
-    const RequestFunction requestFunction = [&answers, &header, &responseParse, isPrecisionSize, this](size_t threadNumber, const std::string &qs, const std::string &post, const std::string &server, const Segment &segment) {
-        CHECK(curls.size() > threadNumber, "Curls empty");
-        const std::string response = request(curls[threadNumber], qs, post, header, server);
+    const RequestFunction requestFunction = [header, responseParse, isPrecisionSize, this](size_t connectionNumber, const std::string &qs, const std::string &post, const std::string &server, const Segment &segment, const IsCancelledFunction &/*isCancelled*/) {
+        CHECK(curls.size() > connectionNumber, "Curls empty");
+        const std::string response = request(curls[connectionNumber], qs, post, header, server);
         const ResponseParse parsed = responseParse(response);
         CHECK(!parsed.error.has_value(), parsed.error.value());
         if (isPrecisionSize) {
             CHECK(parsed.response.size() == segment.toByte - segment.fromByte, "Incorrect response size");
         }
-        answers.at(segment.posInArray) = parsed.response;
+        return parsed.response;
     };
     
     const std::vector<Segment> segments = P2P::makeSegments(countSegments, responseSize, minResponseSize);
-    const bool isSuccess = P2P::process(requestServers, segments, makeQsAndPost, requestFunction);
+    //c Сервер один, дублировать запросы не на кого
+    std::vector<std::string> answers;
+    const bool isSuccess = P2P::process(workers, nullptr, requestServers, segments, 0, makeQsAndPost, requestFunction, answers);
     
     CHECK(isSuccess, "dont run request");
     
@@ -122,7 +123,7 @@ std::string P2P_Graph::request(size_t responseSize, bool isPrecisionSize, const
     return response;
 }
 
-std::vector<std::string> P2P_Graph::requests(size_t countRequests, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
+std::vector<std::string> P2P_Graph::requests(size_t countRequests, size_t requestSize, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
     const auto makeQsAndPortImpl = [makeQsAndPost](size_t from, size_t to) {
         CHECK(to == from + 1, "Incorrect call makeQsAndPortFunc");
         return makeQsAndPost(from);
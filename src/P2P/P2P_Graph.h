@@ -7,6 +7,8 @@
 
 #include "utils/Graph.h"
 
+#include "PeerWorkers.h"
+
 #include "curlWrapper.h"
 
 using GraphString = Graph<std::string>;
@@ -24,7 +26,7 @@ public:
     
     std::string request(size_t responseSize, bool isPrecisionSize, const torrent_node_lib::MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const torrent_node_lib::ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const override;
        
-    std::vector<std::string> requests(size_t countRequests, const torrent_node_lib::MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const torrent_node_lib::ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const override;
+    std::vector<std::string> requests(size_t countRequests, size_t requestSize, const torrent_node_lib::MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const torrent_node_lib::ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const override;
     
     std::string runOneRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const override;
    
@@ -48,6 +50,9 @@ private:
     
     std::vector<common::Curl::CurlInstance> curls;
     
+    //c Соединение i обслуживает один и тот же поток и curls[i]
+    mutable torrent_node_lib::PeerWorkers workers;
+    
 };
 
 #endif // P2P_GRAPH_H_
@@ -6,33 +6,100 @@
 #include "log.h"
 
 #include "parallel_for.h"
+#include "duration.h"
+
+#include <algorithm>
 
 using namespace common;
 
 namespace torrent_node_lib {
 
+const static long REQUEST_TIMEOUT_MS = 5000;
+
+const static long CONNECT_TIMEOUT_MS = 3000;
+
+static std::string makeUrl(const std::string &server, const std::string &qs) {
+    std::string url = server;
+    CHECK(!url.empty(), "server empty");
+    if (url[url.size() - 1] != '/') {
+        url += '/';
+    }
+    url += qs;
+    return url;
+}
+
+static size_t writeResponse(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    std::string &response = *static_cast<std::string*>(userdata);
+    response.append(ptr, size * nmemb);
+    return size * nmemb;
+}
+
+//c curl вызывает ее и пока ждет ответа, не реже раза в секунду, так что отмененный запрос не держит соединение до таймаута
+static int checkCancelled(void *clientp, curl_off_t /*dltotal*/, curl_off_t /*dlnow*/, curl_off_t /*ultotal*/, curl_off_t /*ulnow*/) {
+    const auto &isCancelled = *static_cast<const std::function<bool()>*>(clientp);
+    return isCancelled() ? 1 : 0;
+}
+
+void P2P_Ips::CurlEasyDeleter::operator()(CURL *easy) const {
+    curl_easy_cleanup(easy);
+}
+
 P2P_Ips::P2P_Ips(const std::vector<std::string> &servers, size_t countConnections)
     : servers(servers.begin(), servers.end())
     , countConnections(countConnections)
+    , workers(countConnections)
 {
     CHECK(countConnections != 0, "Incorrect count connections: 0");
     Curl::initialize();
     
     for (const std::string &server: servers) {
         for (size_t i = 0; i < countConnections; i++) {
-            curls[server].emplace_back(Curl::getInstance());
+            CurlEasy easy(curl_easy_init());
+            CHECK(easy != nullptr, "curl_easy_init error");
+            curls[server].emplace_back(std::move(easy));
         }
     }
 }
 
 std::string P2P_Ips::request(const CurlInstance &curl, const std::string& qs, const std::string& postData, const std::string& header, const std::string& server) const {
-    std::string url = server;
-    CHECK(!url.empty(), "server empty");
-    if (url[url.size() - 1] != '/') {
-        url += '/';
+    const std::string response = Curl::request(curl, makeUrl(server, qs), postData, header, "", REQUEST_TIMEOUT_MS / 1000);
+    return response;
+}
+
+std::string P2P_Ips::requestSegment(CURL *easy, const std::string &url, const std::string &postData, const std::string &header, const IsCancelledFunction &isCancelled) {
+    std::string response;
+    
+    //c reset не закрывает открытые соединения, поэтому keep-alive с сервером сохраняется
+    curl_easy_reset(easy);
+    curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, REQUEST_TIMEOUT_MS);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, CONNECT_TIMEOUT_MS);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, writeResponse);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(easy, CURLOPT_XFERINFOFUNCTION, checkCancelled);
+    curl_easy_setopt(easy, CURLOPT_XFERINFODATA, &isCancelled);
+    if (!postData.empty()) {
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, postData.c_str());
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(postData.size()));
     }
-    url += qs;
-    const std::string response = Curl::request(curl, url, postData, header, "", 5);
+    curl_slist *headers = nullptr;
+    if (!header.empty()) {
+        headers = curl_slist_append(nullptr, header.c_str());
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, headers);
+    }
+    
+    const CURLcode result = curl_easy_perform(easy);
+    long httpCode = 0;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &httpCode);
+    if (headers != nullptr) {
+        curl_slist_free_all(headers);
+    }
+    
+    CHECK(result != CURLE_ABORTED_BY_CALLBACK, url + ": cancelled");
+    CHECK(result == CURLE_OK, url + ": " + curl_easy_strerror(result));
+    CHECK(httpCode < 400, url + ": http code " + std::to_string(httpCode));
     return response;
 }
 
@@ -53,18 +120,55 @@ void P2P_Ips::broadcast(const std::string &qs, const std::string &postData, cons
 }
 
 std::string P2P_Ips::runOneRequest(const std::string& server, const std::string& qs, const std::string& postData, const std::string& header) const {
+    Timer tt;
+    try {
+        std::string response = request(Curl::getInstance(), qs, postData, header, server);
+        tt.stop();
+        scores.addSuccess(server, tt.count(), response.size());
+        return response;
+    } catch (...) {
+        scores.addError(server);
+        throw;
+    }
+}
+
+std::string P2P_Ips::runLongPollRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const {
     return request(Curl::getInstance(), qs, postData, header, server);
 }
 
+std::string P2P_Ips::getBestServer(const std::vector<std::string> &servers) const {
+    return scores.getBestServer(servers);
+}
+
+std::vector<PeerStatistic> P2P_Ips::getPeersStatistic() const {
+    return scores.getStatistic();
+}
+
 std::vector<std::reference_wrapper<const P2P_Ips::Server>> P2P_Ips::getServersList(const std::vector<Server> &srves) const {
+    std::vector<std::string> serversNames;
+    for (const Server &server: srves) {
+        if (std::find(serversNames.begin(), serversNames.end(), server.server) == serversNames.end()) {
+            serversNames.emplace_back(server.server);
+        }
+    }
+    const std::vector<std::pair<std::string, size_t>> distribution = scores.distributeConnections(serversNames, countConnections);
+    
+    //c Сначала по одному соединению каждому серверу от лучшего к худшему, потом вторые соединения и т.д.
     std::vector<std::reference_wrapper<const P2P_Ips::Server>> result;
     for (size_t i = 0; i < countConnections; i++) {
-        result.insert(result.end(), srves.begin(), srves.end());
+        for (const auto &[serverName, connections]: distribution) {
+            if (i < connections) {
+                const auto found = std::find_if(srves.begin(), srves.end(), [&serverName=serverName](const Server &server) {
+                    return server.server == serverName;
+                });
+                result.emplace_back(*found);
+            }
+        }
     }
     return result;
 }
 
-std::vector<std::string> P2P_Ips::requestImpl(size_t responseSize, size_t minResponseSize, bool isPrecisionSize, const torrent_node_lib::MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const torrent_node_lib::ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
+std::vector<std::string> P2P_Ips::requestImpl(size_t responseSize, size_t minResponseSize, size_t requestSize, bool isPrecisionSize, const torrent_node_lib::MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const torrent_node_lib::ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
     CHECK(responseSize != 0, "response size 0");
     
     const std::vector<Server> servers(hintsServers.begin(), hintsServers.end());
@@ -73,35 +177,34 @@ std::vector<std::string> P2P_Ips::requestImpl(size_t responseSize, size_t minRes
     const bool isMultitplyRequests = minResponseSize == 1;
     const size_t countSegments = isMultitplyRequests ? responseSize : std::min((responseSize + minResponseSize - 1) / minResponseSize, requestServers.size());
     
-    std::vector<std::string> answers(countSegments);
-    
-    std::map<std::string, std::map<size_t, size_t>> curlsDistribution;
-    std::mutex curlsDistributionMutex;
-    
-    const RequestFunction requestFunction = [&answers, &header, &responseParse, isPrecisionSize, &curlsDistribution, &curlsDistributionMutex, this](size_t threadNumber, const std::string &qs, const std::string &post, const std::string &server, const Segment &segment) {
+    const RequestFunction requestFunction = [header, responseParse, isPrecisionSize, this](size_t connectionNumber, const std::string &qs, const std::string &post, const std::string &server, const Segment &segment, const IsCancelledFunction &isCancelled) {
         const auto foundCurl = curls.find(server);
         CHECK(foundCurl != curls.end(), "curl instance not found");
+        CHECK(foundCurl->second.size() > connectionNumber, "curl instance not found");
         
-        std::unique_lock<std::mutex> lock(curlsDistributionMutex);
-        std::map<size_t, size_t> &curlDist = curlsDistribution[server];
-        if (curlDist.find(threadNumber) == curlDist.end()) {
-            curlDist[threadNumber] = curlDist.size();
-        }
-        const size_t indexInCurls = curlDist[threadNumber];
-        lock.unlock();
-        
-        CHECK(foundCurl->second.size() > indexInCurls, "curl instance not found");
-        const std::string response = request(foundCurl->second[indexInCurls], qs, post, header, server);
-        const ResponseParse parsed = responseParse(response);
-        CHECK(!parsed.error.has_value(), parsed.error.value());
-        if (isPrecisionSize) {
-            CHECK(parsed.response.size() == segment.toByte - segment.fromByte, "Incorrect response size");
+        Timer tt;
+        try {
+            const std::string response = requestSegment(foundCurl->second[connectionNumber].get(), makeUrl(server, qs), post, header, isCancelled);
+            const ResponseParse parsed = responseParse(response);
+            CHECK(!parsed.error.has_value(), parsed.error.value());
+            if (isPrecisionSize) {
+                CHECK(parsed.response.size() == segment.toByte - segment.fromByte, "Incorrect response size");
+            }
+            tt.stop();
+            scores.addSuccess(server, tt.count(), response.size());
+            return parsed.response;
+        } catch (...) {
+            //c Прерванный дубль ничего не говорит о сервере
+            if (!isCancelled()) {
+                scores.addError(server);
+            }
+            throw;
         }
-        answers.at(segment.posInArray) = parsed.response;
     };
     
     const std::vector<Segment> segments = P2P::makeSegments(countSegments, responseSize, minResponseSize);
-    const bool isSuccess = P2P::process(requestServers, segments, makeQsAndPost, requestFunction);
+    std::vector<std::string> answers;
+    const bool isSuccess = P2P::process(workers, &hedgePolicy, requestServers, segments, requestSize, makeQsAndPost, requestFunction, answers);
     
     CHECK(isSuccess, "dont run request");
     
@@ -111,7 +214,7 @@ std::vector<std::string> P2P_Ips::requestImpl(size_t responseSize, size_t minRes
 std::string P2P_Ips::request(size_t responseSize, bool isPrecisionSize, const MakeQsAndPostFunction& makeQsAndPost, const std::string& header, const ResponseParseFunction& responseParse, const std::vector<std::string> &hintsServers) const {
     const size_t MIN_RESPONSE_SIZE = 1000;
     
-    const std::vector<std::string> answers = requestImpl(responseSize, MIN_RESPONSE_SIZE, isPrecisionSize, makeQsAndPost, header, responseParse, hintsServers);
+    const std::vector<std::string> answers = requestImpl(responseSize, MIN_RESPONSE_SIZE, 0, isPrecisionSize, makeQsAndPost, header, responseParse, hintsServers);
     
     std::string response;
     response.reserve(responseSize);
@@ -125,12 +228,12 @@ std::string P2P_Ips::request(size_t responseSize, bool isPrecisionSize, const Ma
     return response;
 }
 
-std::vector<std::string> P2P_Ips::requests(size_t countRequests, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
+std::vector<std::string> P2P_Ips::requests(size_t countRequests, size_t requestSize, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const {
     const auto makeQsAndPortImpl = [makeQsAndPost](size_t from, size_t to) {
         CHECK(to == from + 1, "Incorrect call makeQsAndPortFunc");
         return makeQsAndPost(from);
     };
-    const std::vector<std::string> answers = requestImpl(countRequests, 1, false, makeQsAndPortImpl, header, responseParse, hintsServers);
+    const std::vector<std::string> answers = requestImpl(countRequests, 1, requestSize, false, makeQsAndPortImpl, header, responseParse, hintsServers);
     CHECK(answers.size() == countRequests, "Incorrect count answers");
     return answers;
 }
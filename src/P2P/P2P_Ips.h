@@ -4,6 +4,13 @@
 #include "P2P.h"
 
 #include <map>
+#include <memory>
+
+#include <curl/curl.h>
+
+#include "PeerWorkers.h"
+#include "PeerScores.h"
+#include "HedgePolicy.h"
 
 namespace common {
 struct CurlInstance;
@@ -24,19 +31,37 @@ public:
     
     std::string request(size_t responseSize, bool isPrecisionSize, const MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const override;
     
-    std::vector<std::string> requests(size_t countRequests, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const override;
+    std::vector<std::string> requests(size_t countRequests, size_t requestSize, const MakeQsAndPostFunction2 &makeQsAndPost, const std::string &header, const ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const override;
     
     std::string runOneRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const override;
    
     SendAllResult requestAll(const std::string &qs, const std::string &postData, const std::string &header, const std::set<std::string> &additionalServers) const override;
     
+    std::string runLongPollRequest(const std::string &server, const std::string &qs, const std::string &postData, const std::string &header) const override;
+    
+    std::string getBestServer(const std::vector<std::string> &servers) const override;
+    
+    std::vector<PeerStatistic> getPeersStatistic() const override;
+    
 private:
     
+    //c Каждый сервер встречается столько раз, сколько соединений ему дали оценки scores
     std::vector<std::reference_wrapper<const Server>> getServersList(const std::vector<Server> &srvrs) const;
     
     std::string request(const common::CurlInstance &curl, const std::string &qs, const std::string &postData, const std::string &header, const std::string &server) const;
     
-    std::vector<std::string> requestImpl(size_t responseSize, size_t minResponseSize, bool isPrecisionSize, const torrent_node_lib::MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const torrent_node_lib::ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const;
+    //c Запрос сегмента. Прерывается, как только isCancelled вернет true, а не по таймауту
+    static std::string requestSegment(CURL *easy, const std::string &url, const std::string &postData, const std::string &header, const IsCancelledFunction &isCancelled);
+    
+    std::vector<std::string> requestImpl(size_t responseSize, size_t minResponseSize, size_t requestSize, bool isPrecisionSize, const torrent_node_lib::MakeQsAndPostFunction &makeQsAndPost, const std::string &header, const torrent_node_lib::ResponseParseFunction &responseParse, const std::vector<std::string> &hintsServers) const;
+    
+private:
+    
+    struct CurlEasyDeleter {
+        void operator()(CURL *easy) const;
+    };
+    
+    using CurlEasy = std::unique_ptr<CURL, CurlEasyDeleter>;
     
 private:
     
@@ -44,7 +69,16 @@ private:
     
     size_t countConnections;
     
-    std::map<std::string, std::vector<common::CurlInstance>> curls;
+    //c Свои easy handle, а не CurlInstance: к ним можно подключить прерывание проигравшего дубля. Соединение с сервером они тоже переиспользуют
+    std::map<std::string, std::vector<CurlEasy>> curls;
+    
+    mutable PeerScores scores;
+    
+    mutable HedgePolicy hedgePolicy;
+    
+    //c Соединение i сервера всегда обслуживает один и тот же поток и curls[server][i].
+    //c Объявлен последним: проигравшие дубли могут еще работать с curls и scores, поэтому потоки останавливаются первыми
+    mutable PeerWorkers workers;
     
 };
 
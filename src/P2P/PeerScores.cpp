@@ -0,0 +1,144 @@
+#include "PeerScores.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "check.h"
+#include "log.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+const static double PEER_EWMA = 0.2;
+
+const static size_t EJECT_AFTER_ERRORS_IN_ROW = 3;
+
+const static milliseconds EJECT_TIME = 5s;
+const static milliseconds MAX_EJECT_TIME = 5min;
+
+//c Сервер с оценкой ниже лучшей в столько раз все равно получает одно соединение
+const static double MIN_SCORE_RATIO = 0.05;
+
+void PeerScores::addSuccess(const std::string &server, const milliseconds &time, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mut);
+    Peer &peer = peers[server];
+    const double timeMs = std::max<double>(time.count(), 1.);
+    if (peer.countRequests == peer.countErrors) {
+        peer.timeMs = timeMs;
+        peer.bytes = bytes;
+    } else {
+        peer.timeMs += (timeMs - peer.timeMs) * PEER_EWMA;
+        peer.bytes += (bytes - peer.bytes) * PEER_EWMA;
+    }
+    peer.errorRate -= peer.errorRate * PEER_EWMA;
+    peer.countRequests++;
+    peer.countErrorsInRow = 0;
+    peer.countEjects = 0;
+}
+
+void PeerScores::addError(const std::string &server) {
+    std::lock_guard<std::mutex> lock(mut);
+    Peer &peer = peers[server];
+    peer.errorRate += (1. - peer.errorRate) * PEER_EWMA;
+    peer.countRequests++;
+    peer.countErrors++;
+    peer.countErrorsInRow++;
+    if (peer.countErrorsInRow >= EJECT_AFTER_ERRORS_IN_ROW) {
+        const milliseconds ejectTime = std::min(EJECT_TIME * (1 << std::min<size_t>(peer.countEjects, 16)), MAX_EJECT_TIME);
+        peer.ejectedUntil = ::now() + ejectTime;
+        peer.countEjects++;
+        peer.countErrorsInRow = 0;
+        LOGWARN << "Server " << server << " ejected for " << ejectTime.count() << " ms";
+    }
+}
+
+double PeerScores::getScore(const Peer &peer) {
+    if (peer.timeMs == 0) {
+        return 0;
+    }
+    const double bytesPerSecond = peer.bytes * 1000. / peer.timeMs;
+    return bytesPerSecond * (1. - peer.errorRate);
+}
+
+double PeerScores::getScore(const std::string &server) const {
+    const auto found = peers.find(server);
+    if (found != peers.end() && found->second.timeMs != 0) {
+        return getScore(found->second);
+    }
+    double bestScore = 0;
+    for (const auto &[srv, peer]: peers) {
+        bestScore = std::max(bestScore, getScore(peer));
+    }
+    if (bestScore == 0) {
+        return 1.;
+    }
+    if (found != peers.end()) {
+        //c Одни ошибки, ни одного ответа
+        return bestScore * (1. - found->second.errorRate);
+    }
+    return bestScore;
+}
+
+bool PeerScores::isEjected(const std::string &server, const time_point &now) const {
+    const auto found = peers.find(server);
+    return found != peers.end() && found->second.ejectedUntil > now;
+}
+
+std::vector<std::pair<std::string, size_t>> PeerScores::distributeConnections(const std::vector<std::string> &servers, size_t countConnections) const {
+    CHECK(!servers.empty(), "Servers empty");
+    
+    std::lock_guard<std::mutex> lock(mut);
+    const time_point now = ::now();
+    std::vector<std::pair<std::string, double>> scores;
+    for (const std::string &server: servers) {
+        if (!isEjected(server, now)) {
+            scores.emplace_back(server, getScore(server));
+        }
+    }
+    if (scores.empty()) {
+        LOGWARN << "All servers ejected";
+        for (const std::string &server: servers) {
+            scores.emplace_back(server, getScore(server));
+        }
+    }
+    std::stable_sort(scores.begin(), scores.end(), [](const auto &first, const auto &second) {
+        return first.second > second.second;
+    });
+    
+    const double bestScore = scores.front().second;
+    std::vector<std::pair<std::string, size_t>> result;
+    result.reserve(scores.size());
+    for (const auto &[server, score]: scores) {
+        const double ratio = bestScore > 0 ? std::max(score / bestScore, MIN_SCORE_RATIO) : 1.;
+        const size_t connections = std::clamp<size_t>(std::lround(countConnections * ratio), 1, countConnections);
+        result.emplace_back(server, connections);
+    }
+    return result;
+}
+
+std::string PeerScores::getBestServer(const std::vector<std::string> &servers) const {
+    return distributeConnections(servers, 1).front().first;
+}
+
+std::vector<PeerStatistic> PeerScores::getStatistic() const {
+    std::lock_guard<std::mutex> lock(mut);
+    const time_point now = ::now();
+    std::vector<PeerStatistic> result;
+    result.reserve(peers.size());
+    for (const auto &[server, peer]: peers) {
+        PeerStatistic stat;
+        stat.server = server;
+        stat.latencyMs = peer.timeMs;
+        stat.bytesPerSecond = peer.timeMs != 0 ? peer.bytes * 1000. / peer.timeMs : 0;
+        stat.errorRate = peer.errorRate;
+        stat.score = getScore(peer);
+        stat.countRequests = peer.countRequests;
+        stat.countErrors = peer.countErrors;
+        stat.isEjected = isEjected(server, now);
+        result.emplace_back(stat);
+    }
+    return result;
+}
+
+}
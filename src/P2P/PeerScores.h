@@ -0,0 +1,71 @@
+#ifndef PEER_SCORES_H_
+#define PEER_SCORES_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include "duration.h"
+
+#include "P2P.h"
+
+namespace torrent_node_lib {
+
+/**
+ *c Оценки серверов по результатам запросов: скользящие средние (EWMA) времени запроса, объема ответа и доли ошибок.
+ *c Скорость сервера - средний объем на среднее время, оценка - скорость с поправкой на ошибки.
+ *c Сервер, который несколько раз подряд не ответил, временно исключается, каждое следующее исключение длиннее предыдущего
+ */
+class PeerScores {
+public:
+
+    void addSuccess(const std::string &server, const milliseconds &time, size_t bytes);
+    
+    void addError(const std::string &server);
+    
+    /**
+     *c Сколько соединений дать каждому серверу из servers, лучшие в начале.
+     *c Лучший получает countConnections, остальные пропорционально оценке, но не меньше одного. Исключенные не получают ничего,
+     *c кроме случая, когда исключены все
+     */
+    std::vector<std::pair<std::string, size_t>> distributeConnections(const std::vector<std::string> &servers, size_t countConnections) const;
+    
+    //c Лучший из не исключенных servers
+    std::string getBestServer(const std::vector<std::string> &servers) const;
+    
+    std::vector<PeerStatistic> getStatistic() const;
+
+private:
+
+    struct Peer {
+        double timeMs = 0;
+        double bytes = 0;
+        double errorRate = 0;
+        
+        size_t countRequests = 0;
+        size_t countErrors = 0;
+        
+        size_t countErrorsInRow = 0;
+        size_t countEjects = 0;
+        time_point ejectedUntil;
+    };
+    
+    static double getScore(const Peer &peer);
+    
+    //c Под mut. Для серверов без измерений - лучшая известная оценка, чтобы новый сервер попробовали
+    double getScore(const std::string &server) const;
+    
+    bool isEjected(const std::string &server, const time_point &now) const;
+
+private:
+
+    mutable std::mutex mut;
+    
+    std::map<std::string, Peer> peers;
+
+};
+
+}
+
+#endif // PEER_SCORES_H_
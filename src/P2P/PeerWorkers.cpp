@@ -0,0 +1,81 @@
+#include "PeerWorkers.h"
+
+#include "check.h"
+#include "log.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+PeerWorkers::PeerWorkers(size_t countConnections)
+    : countConnections(countConnections)
+{
+    CHECK(countConnections != 0, "Incorrect count connections: 0");
+}
+
+PeerWorkers::~PeerWorkers() {
+    std::lock_guard<std::mutex> lock(mut);
+    for (auto &[server, serverWorkers]: workers) {
+        for (std::unique_ptr<Worker> &worker: serverWorkers) {
+            std::lock_guard<std::mutex> lockWorker(worker->mut);
+            worker->isStopped = true;
+            worker->cond.notify_one();
+        }
+    }
+    for (auto &[server, serverWorkers]: workers) {
+        for (std::unique_ptr<Worker> &worker: serverWorkers) {
+            worker->thread.join();
+        }
+    }
+}
+
+void PeerWorkers::work(Worker &worker, size_t connectionNumber) {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(worker.mut);
+            worker.cond.wait(lock, [&worker] {
+                return worker.isStopped || !worker.tasks.empty();
+            });
+            if (worker.isStopped) {
+                return;
+            }
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+
+        try {
+            task(connectionNumber);
+        } catch (const exception &e) {
+            LOGERR << e;
+        } catch (const std::exception &e) {
+            LOGERR << e.what();
+        } catch (...) {
+            LOGERR << "Unknown error";
+        }
+    }
+}
+
+void PeerWorkers::submit(const std::string &server, size_t connectionNumber, Task task) {
+    CHECK(connectionNumber < countConnections, "Incorrect connection number");
+
+    Worker *worker;
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        std::vector<std::unique_ptr<Worker>> &serverWorkers = workers[server];
+        if (serverWorkers.empty()) {
+            LOGINFO << "Start " << countConnections << " p2p workers for " << server;
+            for (size_t i = 0; i < countConnections; i++) {
+                serverWorkers.emplace_back(std::make_unique<Worker>());
+                serverWorkers.back()->thread = Thread(&PeerWorkers::work, this, std::ref(*serverWorkers.back()), i);
+            }
+        }
+        worker = serverWorkers[connectionNumber].get();
+    }
+
+    std::lock_guard<std::mutex> lock(worker->mut);
+    worker->tasks.emplace_back(std::move(task));
+    worker->cond.notify_one();
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef PEER_WORKERS_H_
+#define PEER_WORKERS_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "Thread.h"
+
+namespace torrent_node_lib {
+
+/**
+ *c Постоянные потоки для запросов к серверам: на каждый сервер countConnections потоков, по одному на соединение.
+ *c Потоки сервера создаются при первом обращении к нему и живут до разрушения объекта, поэтому на запросах потоки не создаются.
+ *c Задачи одного соединения выполняются по очереди, так что curl соединения никогда не используется из двух потоков сразу
+ */
+class PeerWorkers {
+public:
+
+    using Task = std::function<void(size_t connectionNumber)>;
+
+public:
+
+    explicit PeerWorkers(size_t countConnections);
+
+    PeerWorkers(const PeerWorkers &) = delete;
+    PeerWorkers& operator=(const PeerWorkers &) = delete;
+
+    ~PeerWorkers();
+
+    void submit(const std::string &server, size_t connectionNumber, Task task);
+
+    size_t getCountConnections() const {
+        return countConnections;
+    }
+
+private:
+
+    struct Worker {
+        std::mutex mut;
+        std::condition_variable cond;
+        std::deque<Task> tasks;
+        bool isStopped = false;
+
+        common::Thread thread;
+    };
+
+    void work(Worker &worker, size_t connectionNumber);
+
+private:
+
+    const size_t countConnections;
+
+    std::mutex mut;
+
+    std::map<std::string, std::vector<std::unique_ptr<Worker>>> workers;
+
+};
+
+}
+
+#endif // PEER_WORKERS_H_
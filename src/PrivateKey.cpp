@@ -97,8 +97,8 @@ std::string makeFirstPartBlockSign(size_t blockSize) {
     return serializeIntBigEndian(blockSize);
 }
 
-std::string makeBlockSign(const std::string &blockDump, const PrivateKey &privateKey) {
-    const std::vector<unsigned char> sign = privateKey.sign(blockDump);
+std::string makeBlockSign(std::string_view blockDump, const PrivateKey &privateKey) {
+    const std::vector<unsigned char> sign = privateKey.sign(reinterpret_cast<const unsigned char*>(blockDump.data()), blockDump.size());
     const std::vector<unsigned char> &pubkey = privateKey.public_key();
     const std::string &address = privateKey.get_address();
     
@@ -113,6 +113,22 @@ std::string makeBlockSign(const std::string &blockDump, const PrivateKey &privat
     return res;
 }
 
+bool isBlockSignOfKey(const std::string &blockSign, const PrivateKey &privateKey) {
+    size_t from = 0;
+    size_t endPos = 0;
+    deserializeStringBigEndian(blockSign, from, endPos);
+    if (endPos == from) {
+        return false;
+    }
+    from = endPos;
+    const std::string pubkey = deserializeStringBigEndian(blockSign, from, endPos);
+    if (endPos == from) {
+        return false;
+    }
+    const std::vector<unsigned char> &currPubkey = privateKey.public_key();
+    return pubkey == std::string(currPubkey.begin(), currPubkey.end());
+}
+
 BlockSignatureCheckResult checkSignatureBlock(const std::string &blockDump) {
     BlockSignatureCheckResult result;
     
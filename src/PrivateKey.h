@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <string_view>
 
 namespace torrent_node_lib {
     
@@ -15,14 +16,12 @@ public:
     
     std::vector<unsigned char> sign(const std::string &data) const;
     
+    std::vector<unsigned char> sign(const unsigned char *data, size_t size) const;
+    
     const std::vector<unsigned char>& public_key() const;
     
     const std::string& get_address() const;
     
-private:
-
-    std::vector<unsigned char> sign(const unsigned char *data, size_t size) const;
-    
 private:
     
     std::vector<unsigned char> privateKey;
@@ -46,7 +45,9 @@ std::string getAddress(const std::vector<unsigned char> &pubkey);
 
 std::string makeFirstPartBlockSign(size_t blockSize);
 
-std::string makeBlockSign(const std::string &blockDump, const PrivateKey &privateKey);
+std::string makeBlockSign(std::string_view blockDump, const PrivateKey &privateKey);
+
+bool isBlockSignOfKey(const std::string &blockSign, const PrivateKey &privateKey);
 
 BlockSignatureCheckResult checkSignatureBlock(const std::string &blockDump);
 
@@ -1,10 +1,12 @@
 #include "Server.h"
 
 #include <string_view>
+#include <algorithm>
 #include <variant>
 
 #include "synchronize_blockchain.h"
 #include "BlockInfo.h"
+#include "BlockchainUtils.h"
 #include "Workers/NodeTestsBlockInfo.h"
 
 #include "check.h"
@@ -30,11 +32,18 @@ const static std::string GET_BLOCK_BY_HASH = "get-block-by-hash";
 const static std::string GET_BLOCK_BY_NUMBER = "get-block-by-number";
 const static std::string GET_BLOCKS = "get-blocks";
 const static std::string GET_COUNT_BLOCKS = "get-count-blocks";
+const static std::string WAIT_COUNT_BLOCKS = "wait-count-blocks";
 const static std::string GET_DUMP_BLOCK_BY_HASH = "get-dump-block-by-hash";
 const static std::string GET_DUMP_BLOCK_BY_NUMBER = "get-dump-block-by-number";
 const static std::string GET_DUMPS_BLOCKS_BY_HASH = "get-dumps-blocks-by-hash";
 const static std::string GET_DUMPS_BLOCKS_BY_NUMBER = "get-dumps-blocks-by-number";
 
+const static milliseconds WAIT_COUNT_BLOCKS_DEFAULT_TIMEOUT = 3s;
+const static milliseconds WAIT_COUNT_BLOCKS_MAX_TIMEOUT = 10s;
+
+//c Размер куска, которым читаются и сжимаются дампы при потоковом сжатии
+const static size_t DUMPS_STREAM_CHUNK_SIZE = 4 * 1024 * 1024;
+
 const static int HTTP_STATUS_OK = 200;
 const static int HTTP_STATUS_METHOD_NOT_ALLOWED = 405;
 const static int HTTP_STATUS_BAD_REQUEST = 400;
@@ -123,20 +132,24 @@ std::string getBlock(const RequestId &requestId, const rapidjson::Document &doc,
         }
     }
     
-    const BlockHeader bh = sync.getBlockchain().getBlock(hashOrNumber);
+    const std::shared_ptr<const BlockHeader> bh = sync.getBlockchain().getBlock(hashOrNumber);
     
-    if (!bh.blockNumber.has_value()) {
+    if (bh == nullptr) {
         return genErrorResponse(requestId, -32603, "block " + to_string(hashOrNumber) + " not found");
     }
     
-    BlockHeader nextBh = sync.getBlockchain().getBlock(*bh.blockNumber + 1);
+    const std::shared_ptr<const BlockHeader> nextBh = sync.getBlockchain().getBlock(*bh->blockNumber + 1);
     std::vector<TransactionInfo> signs;
     /*if (nextBh.blockNumber.has_value()) {
         const BlockInfo nextBi = sync.getFullBlock(nextBh, 0, 20);
         signs = nextBi.getBlockSignatures();
     }*/
     if (type == BlockTypeInfo::Simple || type == BlockTypeInfo::ForP2P || type == BlockTypeInfo::Small) {
-        return blockHeaderToJson(requestId, bh, nextBh, isFormat, type, version);
+        std::optional<std::reference_wrapper<const BlockHeader>> nextBlock;
+        if (nextBh != nullptr) {
+            nextBlock = *nextBh;
+        }
+        return blockHeaderToJson(requestId, *bh, nextBlock, isFormat, type, version);
     } else {
         return "";
     }
@@ -171,9 +184,20 @@ std::string getBlockDump(const rapidjson::Document &doc, const RequestId &reques
         isCompress = jsonParams["compress"].GetBool();
     }
     
-    const BlockHeader bh = sync.getBlockchain().getBlock(hashOrNumber);
-    CHECK(bh.blockNumber.has_value(), "block " + to_string(hashOrNumber) + " not found");
-    const std::string res = genDumpBlockBinary(sync.getBlockDump(bh, fromByte, toByte, isHex, isSign), isCompress);
+    const std::shared_ptr<const BlockHeader> bh = sync.getBlockchain().getBlock(hashOrNumber);
+    CHECK(bh != nullptr, "block " + to_string(hashOrNumber) + " not found");
+    
+    if (!isHex && !isSign && !isCompress) {
+        //c Сырой дамп отдаем как кусок файла: один pread прямо в тело ответа
+        const ReadOnlyFileRange range = sync.getBlockDumpRange(*bh, fromByte, toByte);
+        if (range.length != 0) {
+            std::string res;
+            readFileRange(range, res);
+            return res;
+        }
+    }
+    
+    const std::string res = genDumpBlockBinary(sync.getBlockDump(*bh, fromByte, toByte, isHex, isSign), isCompress);
     
     CHECK(!res.empty(), "block " + to_string(hashOrNumber) + " not found");
     if (isHex) {
@@ -217,11 +241,13 @@ static std::string getBlocks(const RequestId &requestId, const rapidjson::Docume
         isForward = jsonParams["direction"].GetString() == std::string("forward");
     }
 
-    std::vector<BlockHeader> bhs;
+    std::vector<std::shared_ptr<const BlockHeader>> bhs;
     bhs.reserve(countBlocks);
 
     const auto processBlock = [&bhs, &sync, type](int64_t i) {
-        bhs.emplace_back(sync.getBlockchain().getBlock(i));
+        std::shared_ptr<const BlockHeader> bh = sync.getBlockchain().getBlock(i);
+        CHECK(bh != nullptr, "Block header not set");
+        bhs.emplace_back(std::move(bh));
     };
 
     if (!isForward) {
@@ -251,24 +277,48 @@ std::string getBlockDumps(const rapidjson::Document &doc, const RequestId &reque
     if (jsonParams.HasMember("compress") && jsonParams["compress"].IsBool()) {
         isCompress = jsonParams["compress"].GetBool();
     }
+    //c Потоковое сжатие независимыми кусками (CompressStream). Старый compress сжимает одним блоком lz4 и требует весь ответ целиком
+    bool isCompressStream = false;
+    if (jsonParams.HasMember("compressStream") && jsonParams["compressStream"].IsBool()) {
+        isCompressStream = jsonParams["compressStream"].GetBool();
+    }
     CHECK_USER(jsonParams.HasMember(nameParam.c_str()) && jsonParams[nameParam.c_str()].IsArray(), "hashes field not found");
     const auto &jsonVals = jsonParams[nameParam.c_str()].GetArray();
     CHECK_USER(jsonVals.Size() <= 1000, "Too many blocks");
-    std::vector<std::string> result;
+    std::vector<std::shared_ptr<const BlockHeader>> bhs;
+    bhs.reserve(jsonVals.Size());
     for (const auto &jsonVal: jsonVals) {
         const T &hashOrNumber = getJsonField<T>(jsonVal);
-
-        const size_t fromByte = 0;
-        const size_t toByte = std::numeric_limits<size_t>::max();
-
-        const BlockHeader bh = sync.getBlockchain().getBlock(hashOrNumber);
-        CHECK(bh.blockNumber.has_value(), "block " + to_string(hashOrNumber) + " not found");
-        const std::string res = sync.getBlockDump(bh, fromByte, toByte, false, isSign);
-
-        CHECK(!res.empty(), "block " + to_string(hashOrNumber) + " not found");
-        result.emplace_back(res);
+        std::shared_ptr<const BlockHeader> bh = sync.getBlockchain().getBlock(hashOrNumber);
+        CHECK(bh != nullptr, "block " + to_string(hashOrNumber) + " not found");
+        bhs.emplace_back(std::move(bh));
+    }
+    
+    const bool isAllInFiles = std::all_of(bhs.begin(), bhs.end(), [](const std::shared_ptr<const BlockHeader> &bh) {
+        return !bh->filePos.fileName.empty();
+    });
+    if (!isSign && isAllInFiles && !isCompressStream) {
+        //c Подряд идущие блоки лежат в файле вплотную, поэтому читаем их большими кусками сразу в ответ
+        return genDumpBlockBinary(sync.getBlockDumps(bhs), isCompress);
     }
-    return genDumpBlocksBinary(result, isCompress);
+    
+    DumpBlocksBinaryWriter writer(isCompressStream);
+    if (!isSign && isAllInFiles) {
+        sync.getBlockDumps(bhs, DUMPS_STREAM_CHUNK_SIZE, [&writer](std::string_view chunk) {
+            writer.addFramed(chunk);
+        });
+    } else {
+        for (const std::shared_ptr<const BlockHeader> &bh: bhs) {
+            const size_t fromByte = 0;
+            const size_t toByte = std::numeric_limits<size_t>::max();
+            
+            const std::string res = sync.getBlockDump(*bh, fromByte, toByte, false, isSign);
+            
+            CHECK(!res.empty(), "block " + bh->hash + " not found");
+            writer.addBlock(res);
+        }
+    }
+    return genDumpBlockBinary(writer.finish(), isCompress && !isCompressStream);
 }
 
 static std::string signTestString(const std::string &strBinary, bool isHex, const RequestId &requestId, const Sync &sync) {
@@ -379,7 +429,7 @@ bool Server::run(int thread_number, Request& mhd_req, Response& mhd_resp) {
             CHECK_USER(sync.verifyTechnicalAddressSign(timestamp, fromHex(sign), fromHex(pubkey)), "Incorrect signature");
             
             const SmallStatisticElement smallStat = smallRequestStatistics.getStatistic();
-            response = genStatisticResponse(requestId, smallStat.stat, getProcLoad(), getTotalSystemMemory(), getOpenedConnections());
+            response = genStatisticResponse(requestId, smallStat.stat, getProcLoad(), getTotalSystemMemory(), getOpenedConnections(), sync.getAdvanceLoadStatistic(), getPubkeyCacheStatistic());
         } else if (func == GET_BLOCK_BY_HASH) {
             response = getBlock<std::string>(requestId, doc, "hash", sync, isFormatJson, jsonVersion);
         } else if (func == GET_BLOCK_BY_NUMBER) {
@@ -397,12 +447,27 @@ bool Server::run(int thread_number, Request& mhd_req, Response& mhd_resp) {
         } else if (func == GET_COUNT_BLOCKS) {
             const size_t countBlocks = sync.getBlockchain().countBlocks();
             
+            response = genCountBlockJson(requestId, countBlocks, isFormatJson, jsonVersion);
+        } else if (func == WAIT_COUNT_BLOCKS) {
+            //c Long poll: отвечает, как только блоков станет больше after, или по истечении timeout
+            CHECK_USER(doc.HasMember("params") && doc["params"].IsObject(), "params field not found");
+            const auto &jsonParams = doc["params"];
+            const size_t after = getJsonField<size_t>(jsonParams, "after");
+            milliseconds timeout = WAIT_COUNT_BLOCKS_DEFAULT_TIMEOUT;
+            if (jsonParams.HasMember("timeout")) {
+                timeout = std::min(milliseconds(getJsonField<size_t>(jsonParams, "timeout")), WAIT_COUNT_BLOCKS_MAX_TIMEOUT);
+            }
+            
+            const IncCountRunningThread incWaiting(countWaitingRequests);
+            CHECK_USER(countWaitingRequests <= maxWaitingRequests, "Too many waiting requests");
+            const size_t countBlocks = sync.getBlockchain().waitCountBlocks(after, timeout);
+            
             response = genCountBlockJson(requestId, countBlocks, isFormatJson, jsonVersion);
         } else {
             throwUserErr("Incorrect func " + func);
         }
         
-        mhd_resp.data = response;
+        mhd_resp.data = std::move(response);
         mhd_resp.code = HTTP_STATUS_OK;
     } catch (const exception &e) {
         LOGERR << e;
@@ -427,12 +492,10 @@ bool Server::run(int thread_number, Request& mhd_req, Response& mhd_resp) {
 
 bool Server::init() {
     LOGINFO << "Port " << port;
-
-    const int COUNT_THREADS = 8;
     
     countRunningThreads = 0;
     
-    set_threads(COUNT_THREADS);
+    set_threads(countThreads);
     set_port(port);
 
     return true;
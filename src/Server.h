@@ -14,11 +14,13 @@ class Sync;
 
 class Server: public sniper::mhd::MHD {
 public:
-    Server(const torrent_node_lib::Sync &sync, int port, std::atomic<int> &countRunningThreads, const std::string &serverPrivKey)
+    Server(const torrent_node_lib::Sync &sync, int port, std::atomic<int> &countRunningThreads, const std::string &serverPrivKey, int countThreads, int maxWaitingRequests)
         : sync(sync)
         , port(port)
         , countRunningThreads(countRunningThreads)
         , serverPrivKey(serverPrivKey)
+        , countThreads(countThreads)
+        , maxWaitingRequests(maxWaitingRequests)
         , isStoped(false)
     {}
     
@@ -37,8 +39,15 @@ private:
     std::atomic<int> &countRunningThreads;
     
     const std::string serverPrivKey;
+    
+    const int countThreads;
+    
+    //c wait-count-blocks держит поток сервера до ответа, поэтому ждущих запросов меньше, чем потоков
+    const int maxWaitingRequests;
 
     std::atomic<bool> isStoped;
+    
+    std::atomic<int> countWaitingRequests = 0;
         
     SmallStatistic smallRequestStatistics;
     
@@ -11,6 +11,8 @@
 #include "convertStrings.h"
 #include "stringUtils.h"
 
+#include "utils/ReadOnlyFile.h"
+
 #include "BlockSource/FileBlockSource.h"
 #include "BlockSource/NetworkBlockSource.h"
 
@@ -25,6 +27,12 @@ using namespace common;
 namespace torrent_node_lib {
     
 const static std::string VERSION_DB = "v3.5";
+
+const static size_t SNAPSHOT_PERIOD_BLOCKS = 100000;
+
+//c Примерно столько блоков одновременно живет в очередях воркеров
+const static size_t BLOCK_POOL_FREE_BLOCKS = 8;
+const static size_t BLOCK_POOL_FREE_DUMPS = 8;
     
 bool isInitialized = false;
 
@@ -38,16 +46,18 @@ void SyncImpl::initialize(const std::string& folderPath, const GetterBlockOption
         CHECK(getterBlocksOpt.p2p != nullptr, "p2p nullptr");
         isSaveBlockToFiles = modules[MODULE_BLOCK_RAW];
         const bool isSaveAllTx = modules[MODULE_USERS];
-        getBlockAlgorithm = std::make_unique<NetworkBlockSource>(folderPath, getterBlocksOpt.maxAdvancedLoadBlocks, getterBlocksOpt.countBlocksInBatch, getterBlocksOpt.isCompress, *getterBlocksOpt.p2p, isSaveAllTx, getterBlocksOpt.isValidate, getterBlocksOpt.isValidateSign);
+        getBlockAlgorithm = std::make_unique<NetworkBlockSource>(folderPath, getterBlocksOpt.maxAdvancedLoadBlocks, getterBlocksOpt.countBlocksInBatch, getterBlocksOpt.isCompress, *getterBlocksOpt.p2p, isSaveAllTx, getterBlocksOpt.isValidate, getterBlocksOpt.isValidateSign, getterBlocksOpt.isHeadersFirst, blockPool);
     }
 }
 
 SyncImpl::SyncImpl(const std::string& folderPath, const std::string &technicalAddress, const LevelDbOptions& leveldbOpt, const CachesOptions& cachesOpt, const GetterBlockOptions &getterBlocksOpt, const std::string &signKeyName, const TestNodesOptions &testNodesOpt)
     : leveldb(leveldbOpt.writeBufSizeMb, leveldbOpt.isBloomFilter, leveldbOpt.isChecks, leveldbOpt.folderName, leveldbOpt.lruCacheMb)
     , caches(cachesOpt.maxCountElementsBlockCache, cachesOpt.maxCountElementsTxsCache, cachesOpt.macLocalCacheElements)
+    , blockchainSnapshotFileName(leveldbOpt.folderName + ".snapshot")
     , technicalAddress(technicalAddress)
     , isValidate(getterBlocksOpt.isValidate)
     , testNodes(getterBlocksOpt.p2p, testNodesOpt.myIp, testNodesOpt.testNodesServer, testNodesOpt.defaultPortTorrent)
+    , blockPool(BLOCK_POOL_FREE_BLOCKS, BLOCK_POOL_FREE_DUMPS)
 {
     if (getterBlocksOpt.isValidate) {
         CHECK(!getterBlocksOpt.getBlocksFromFile, "validate and get_blocks_from_file options not compatible");
@@ -80,7 +90,7 @@ void SyncImpl::addUsers(const std::set<Address>& addresses) {
     users.insert(addresses.begin(), addresses.end());
 }
 
-void SyncImpl::saveTransactions(BlockInfo& bi, const std::string &binaryDump, bool saveBlockToFile) {
+void SyncImpl::saveTransactions(BlockInfo& bi, std::string_view binaryDump, bool saveBlockToFile) {
     if (!saveBlockToFile) {
         return;
     }
@@ -101,13 +111,11 @@ void SyncImpl::saveTransactions(BlockInfo& bi, const std::string &binaryDump, bo
         openFile(file, fileName);
         for (TransactionInfo &tx: bi.txs) {
             if (tx.isSaveToBd) {
-                const size_t filePos = saveTransactionToFile(file, tx.allRawTx);
+                const size_t filePos = saveTransactionToFile(file, tx.allRawTx.view(binaryDump));
                 
                 tx.filePos.fileName = fileName;
                 tx.filePos.pos = filePos;
             }
-            tx.allRawTx.clear();
-            tx.allRawTx.shrink_to_fit();
         }
     }   
 }
@@ -129,11 +137,14 @@ void SyncImpl::filterTransactionsToSave(BlockInfo& bi) {
     }
 }
 
-void SyncImpl::saveBlockToLeveldb(const BlockInfo &bi) {
+void SyncImpl::saveBlockToLeveldb(const BlockInfo &bi, const std::string &blockSign) {
     Batch batch;
     if (modules[MODULE_BLOCK]) {
         batch.addBlockHeader(bi.header.hash, bi.header.serialize());
     }
+    if (!blockSign.empty()) {
+        batch.addBlockSign(bi.header.hash, blockSign);
+    }
     
     const std::string blockMetadata = findBlockMetadata(leveldb);
     const BlocksMetadata metadata = BlocksMetadata::deserialize(blockMetadata);
@@ -158,6 +169,53 @@ void SyncImpl::saveBlockToLeveldb(const BlockInfo &bi) {
     addBatch(batch, leveldb);
 }
 
+bool SyncImpl::isSaveBlockSigns() const {
+    return privateKey != nullptr && modules[MODULE_BLOCK_RAW] && !modules[MODULE_USERS];
+}
+
+void SyncImpl::saveBlockSignToCache(const BlockInfo &bi, const std::string &blockSign) {
+    if (blockSign.empty() || caches.maxCountElementsBlockCache == 0) {
+        return;
+    }
+    const size_t blockNumber = bi.header.blockNumber.value();
+    caches.blockSignCache.addValue(bi.header.hash, std::to_string(blockNumber), blockSign);
+    caches.blockSignCache.remove(std::to_string(blockNumber - caches.maxCountElementsBlockCache));
+}
+
+void SyncImpl::saveReadBlockSignToCache(const std::string &blockHash, const std::string &blockSign) const {
+    if (blockSign.empty() || caches.maxCountElementsBlockCache == 0) {
+        return;
+    }
+    //c В поколении maxCountElementsBlockCache подписей. Когда начинается новое, удаляется позапрошлое
+    const size_t number = countReadBlockSigns++;
+    const size_t generation = number / caches.maxCountElementsBlockCache;
+    caches.blockSignCache.addValue(blockHash, "read_" + std::to_string(generation), blockSign);
+    if (number % caches.maxCountElementsBlockCache == 0 && generation >= 2) {
+        caches.blockSignCache.remove("read_" + std::to_string(generation - 2));
+    }
+}
+
+std::string SyncImpl::getSavedBlockSign(const std::string &blockHash) const {
+    const std::optional<std::string> cache = caches.blockSignCache.getValue(blockHash);
+    if (cache.has_value()) {
+        return cache.value();
+    }
+    const std::string blockSign = findBlockSign(blockHash, leveldb);
+    if (blockSign.empty() || !isBlockSignOfKey(blockSign, *privateKey)) {
+        //c Подпись могла быть сделана другим ключом, если ключ в конфиге поменялся
+        return "";
+    }
+    saveReadBlockSignToCache(blockHash, blockSign);
+    return blockSign;
+}
+
+std::string SyncImpl::makeAndSaveBlockSign(const std::string &blockHash, std::string_view blockDump) const {
+    const std::string blockSign = makeBlockSign(blockDump, *privateKey);
+    saveBlockSign(blockHash, blockSign, leveldb);
+    saveReadBlockSignToCache(blockHash, blockSign);
+    return blockSign;
+}
+
 bool SyncImpl::verifyTechnicalAddressSign(const std::string &binary, const std::vector<unsigned char> &signature, const std::vector<unsigned char> &pubkey) const {
     const bool res = verifySignature(binary, signature, pubkey);
     if (!res) {
@@ -166,6 +224,97 @@ bool SyncImpl::verifyTechnicalAddressSign(const std::string &binary, const std::
     return technicalAddress == getAddress(pubkey);
 }
 
+bool SyncImpl::loadBlockchainTail(const BlocksMetadata &metadata) {
+    if (metadata.blockHash.empty()) {
+        return false;
+    }
+    
+    const std::string lastSnapshotHash = blockchain.getLastBlock()->hash;
+    std::vector<BlockHeader> tail;
+    std::string hash = metadata.blockHash;
+    while (hash != lastSnapshotHash) {
+        if (blockchain.getBlock(hash) != nullptr) {
+            LOGWARN << "Blockchain snapshot ahead of database";
+            return false;
+        }
+        const std::string blockRaw = findBlock(hash, leveldb);
+        if (blockRaw.empty()) {
+            LOGWARN << "Block " << hash << " not found in database";
+            return false;
+        }
+        BlockHeader bh = BlockHeader::deserialize(blockRaw);
+        hash = bh.prevHash;
+        tail.emplace_back(std::move(bh));
+    }
+    
+    for (auto iter = tail.rbegin(); iter != tail.rend(); iter++) {
+        blockchain.addBlock(*iter);
+    }
+    return true;
+}
+
+void SyncImpl::loadBlockchain(const BlocksMetadata &metadata) {
+    Timer tt;
+    
+    blockchain.clear();
+    
+    const size_t countSnapshotBlocks = blockchain.loadSnapshot(blockchainSnapshotFileName);
+    bool isLoaded = false;
+    if (countSnapshotBlocks != 0) {
+        try {
+            isLoaded = loadBlockchainTail(metadata);
+        } catch (const exception &e) {
+            LOGWARN << "Dont load blockchain tail " << e;
+        }
+        if (!isLoaded) {
+            LOGWARN << "Blockchain snapshot not matches with database. Load full blockchain";
+            blockchain.clear();
+        }
+    }
+    
+    if (!isLoaded) {
+        {
+            const std::set<std::string> blocksRaw = getAllBlocks(leveldb);
+            for (const std::string &blockRaw: blocksRaw) {
+                BlockHeader bh = BlockHeader::deserialize(blockRaw);
+                blockchain.addWithoutCalc(bh);
+            }
+        }
+        
+        if (!metadata.blockHash.empty()) {
+            blockchain.calcBlockchain(metadata.blockHash);
+        }
+    }
+    
+    tt.stop();
+    
+    const size_t countBlocks = blockchain.countBlocks();
+    LOGINFO << "Last block " << countBlocks << " " << metadata.blockHash << ". From snapshot " << (isLoaded ? countSnapshotBlocks : 0) << ". Time ms " << tt.countMs();
+    
+    lastSnapshotBlock = isLoaded ? countSnapshotBlocks : 0;
+    if (countBlocks >= lastSnapshotBlock + SNAPSHOT_PERIOD_BLOCKS) {
+        saveBlockchainSnapshot();
+    }
+}
+
+void SyncImpl::saveBlockchainSnapshot() {
+    Timer tt;
+    const size_t countBlocks = blockchain.countBlocks();
+    //c При ошибке следующая попытка будет через период, а не на каждом блоке
+    lastSnapshotBlock = countBlocks;
+    try {
+        blockchain.saveSnapshot(blockchainSnapshotFileName);
+    } catch (const exception &e) {
+        LOGERR << "Dont save blockchain snapshot " << e;
+        return;
+    } catch (const std::exception &e) {
+        LOGERR << "Dont save blockchain snapshot " << e.what();
+        return;
+    }
+    tt.stop();
+    LOGINFO << "Blockchain snapshot saved. Count blocks " << countBlocks << ". Time ms " << tt.countMs();
+}
+
 void SyncImpl::synchronize(int countThreads) {
     this->countThreads = countThreads;
     
@@ -193,20 +342,7 @@ void SyncImpl::synchronize(int countThreads) {
         
         getBlockAlgorithm->initialize();
         
-        blockchain.clear();
-        
-        {
-            const std::set<std::string> blocksRaw = getAllBlocks(leveldb);
-            for (const std::string &blockRaw: blocksRaw) {
-                BlockHeader bh = BlockHeader::deserialize(blockRaw);
-                blockchain.addWithoutCalc(bh);
-            }
-        }
-        
-        if (!metadata.blockHash.empty()) {
-            const size_t countBlocks = blockchain.calcBlockchain(metadata.blockHash);
-            LOGINFO << "Last block " << countBlocks << " " << metadata.blockHash;
-        }
+        loadBlockchain(metadata);
            
         std::vector<Worker*> workers;
         cacheWorker = std::make_unique<WorkerCache>(caches);
@@ -239,20 +375,20 @@ void SyncImpl::synchronize(int countThreads) {
             const size_t fromBlockNumber = minElement.operator*()->getInitBlockNumber().value() + 1;
             LOGINFO << "Retry from block " << fromBlockNumber;
             for (size_t blockNumber = fromBlockNumber; blockNumber <= blockchain.countBlocks(); blockNumber++) {
-                const BlockHeader &bh = blockchain.getBlock(blockNumber);
-                std::shared_ptr<BlockInfo> bi = std::make_shared<BlockInfo>();
-                std::shared_ptr<std::string> blockDump = std::make_shared<std::string>();
+                const std::shared_ptr<const BlockHeader> bh = blockchain.getBlock(blockNumber);
+                std::shared_ptr<BlockInfo> bi = blockPool.getBlockInfo();
+                std::shared_ptr<BlockDump> blockDump = blockPool.getDump();
                 try {
-                    FileBlockSource::getExistingBlockS(bh, *bi, *blockDump, isValidate);
+                    FileBlockSource::getExistingBlockS(*bh, *bi, *blockDump, isValidate);
                 } catch (const exception &e) {
                     LOGWARN << "Dont get existing block " << e;
-                    getBlockAlgorithm->getExistingBlock(bh, *bi, *blockDump);
+                    getBlockAlgorithm->getExistingBlock(*bh, *bi, *blockDump);
                 } catch (const std::exception &e) {
                     LOGWARN << "Dont get existing block " << e.what();
-                    getBlockAlgorithm->getExistingBlock(bh, *bi, *blockDump);
+                    getBlockAlgorithm->getExistingBlock(*bh, *bi, *blockDump);
                 } catch (...) {
                     LOGWARN << "Dont get existing block " << "Unknown";
-                    getBlockAlgorithm->getExistingBlock(bh, *bi, *blockDump);
+                    getBlockAlgorithm->getExistingBlock(*bh, *bi, *blockDump);
                 }
                 filterTransactionsToSave(*bi);
                 for (Worker* &worker: workers) {
@@ -266,23 +402,25 @@ void SyncImpl::synchronize(int countThreads) {
         while (true) {
             const time_point beginWhileTime = ::now();
             std::shared_ptr<BlockInfo> prevBi = nullptr;
-            std::shared_ptr<std::string> prevDump = nullptr;
+            std::shared_ptr<BlockDump> prevDump = nullptr;
             try {
-                auto [isContinue, knownLstBlk] = getBlockAlgorithm->doProcess(blockchain.countBlocks(), blockchain.getLastBlock().hash);
+                auto [isContinue, knownLstBlk] = getBlockAlgorithm->doProcess(blockchain.countBlocks(), blockchain.getLastBlock()->hash);
                 knownLastBlock = knownLstBlk;
                 while (isContinue) {
                     Timer tt;
                     
-                    std::shared_ptr<BlockInfo> nextBi = std::make_shared<BlockInfo>();
+                    std::shared_ptr<BlockInfo> nextBi = blockPool.getBlockInfo();
                     
-                    nextBi->times.timeBegin = ::now();
-                    nextBi->times.timeBeginGetBlock = ::now();
+                    const time_point timeBegin = ::now();
                     
-                    std::shared_ptr<std::string> nextBlockDump = std::make_shared<std::string>();
-                    isContinue = getBlockAlgorithm->process(*nextBi, *nextBlockDump);
+                    std::shared_ptr<BlockDump> nextBlockDump = blockPool.getDump();
+                    isContinue = getBlockAlgorithm->process(nextBi, nextBlockDump);
                     if (!isContinue) {
                         break;
                     }
+                    //c Источник мог подменить nextBi уже разобранным блоком
+                    nextBi->times.timeBegin = timeBegin;
+                    nextBi->times.timeBeginGetBlock = timeBegin;
                     
                     Timer tt2;
 
@@ -309,7 +447,7 @@ void SyncImpl::synchronize(int countThreads) {
                     }
                     
                     filterTransactionsToSave(*prevBi);
-                    saveTransactions(*prevBi, *prevDump, isSaveBlockToFiles);
+                    saveTransactions(*prevBi, prevDump->view(), isSaveBlockToFiles);
                     
                     const size_t currentBlockNum = blockchain.addBlock(prevBi->header);
                     CHECK(currentBlockNum != 0, "Incorrect block number");
@@ -318,6 +456,11 @@ void SyncImpl::synchronize(int countThreads) {
                     for (TransactionInfo &tx: prevBi->txs) {
                         tx.blockNumber = prevBi->header.blockNumber.value();
                     }
+                    
+                    std::string blockSign;
+                    if (isSaveBlockSigns()) {
+                        blockSign = makeBlockSign(prevDump->view(), *privateKey);
+                    }
                                         
                     tt.stop();
                     tt2.stop();
@@ -330,7 +473,12 @@ void SyncImpl::synchronize(int countThreads) {
                         worker->process(prevBi, prevDump);
                     }
                     
-                    saveBlockToLeveldb(*prevBi);
+                    saveBlockToLeveldb(*prevBi, blockSign);
+                    saveBlockSignToCache(*prevBi, blockSign);
+                    
+                    if (currentBlockNum >= lastSnapshotBlock + SNAPSHOT_PERIOD_BLOCKS) {
+                        saveBlockchainSnapshot();
+                    }
                     
                     if (isValidate) {
                         prevBi = nextBi;
@@ -353,7 +501,7 @@ void SyncImpl::synchronize(int countThreads) {
                 pending = 0ms;
             }
             
-            sleepMs(pending);
+            getBlockAlgorithm->waitNewBlocks(blockchain.countBlocks(), pending);
         }
     } catch (const StopException &e) {
         LOGINFO << "Stop synchronize thread";
@@ -366,52 +514,83 @@ void SyncImpl::synchronize(int countThreads) {
     }
 }
 
+//c Возвращает размер блока и кусок его дампа. Через отображение кусок не копируется
+static std::pair<size_t, BlockDump> readBlockDumpFromFile(const BlockHeader &bh, size_t fromByte, size_t toByte) {
+    std::pair<size_t, BlockDump> result;
+    if (isMappedBlockFiles()) {
+        //c Запросы блоков от пиров идут вразнобой, поэтому упреждающее чтение не нужно
+        std::tie(result.first, result.second.mapped) = torrent_node_lib::getBlockDump(bh.filePos.fileName, FileAccessPattern::Random, bh.filePos.pos, fromByte, toByte);
+    } else {
+        const std::shared_ptr<const ReadOnlyFile> file = getReadOnlyFile(bh.filePos.fileName);
+        std::tie(result.first, result.second.buffer) = torrent_node_lib::getBlockDump(*file, bh.filePos.pos, fromByte, toByte);
+    }
+    return result;
+}
+
+ReadOnlyFileRange SyncImpl::getBlockDumpRange(const BlockHeader &bh, size_t fromByte, size_t toByte) const {
+    CHECK(modules[MODULE_BLOCK] && modules[MODULE_BLOCK_RAW] && !modules[MODULE_USERS], "modules " + MODULE_BLOCK_STR + " " + MODULE_BLOCK_RAW_STR + " not set");
+    if (bh.filePos.fileName.empty()) {
+        return ReadOnlyFileRange();
+    }
+    return torrent_node_lib::getBlockDumpRange(getReadOnlyFile(bh.filePos.fileName), bh.filePos.pos, fromByte, toByte).second;
+}
+
+std::string SyncImpl::getBlockDumps(const std::vector<std::shared_ptr<const BlockHeader>> &bhs) const {
+    CHECK(modules[MODULE_BLOCK] && modules[MODULE_BLOCK_RAW] && !modules[MODULE_USERS], "modules " + MODULE_BLOCK_STR + " " + MODULE_BLOCK_RAW_STR + " not set");
+    return getBlockDumpsFramed(bhs);
+}
+
+void SyncImpl::getBlockDumps(const std::vector<std::shared_ptr<const BlockHeader>> &bhs, size_t maxChunkSize, const std::function<void(std::string_view chunk)> &processChunk) const {
+    CHECK(modules[MODULE_BLOCK] && modules[MODULE_BLOCK_RAW] && !modules[MODULE_USERS], "modules " + MODULE_BLOCK_STR + " " + MODULE_BLOCK_RAW_STR + " not set");
+    getBlockDumpsFramed(bhs, maxChunkSize, processChunk);
+}
+
 std::string SyncImpl::getBlockDump(const BlockHeader &bh, size_t fromByte, size_t toByte, bool isHex, bool isSign) const {
     CHECK(modules[MODULE_BLOCK] && modules[MODULE_BLOCK_RAW] && !modules[MODULE_USERS], "modules " + MODULE_BLOCK_STR + " " + MODULE_BLOCK_RAW_STR + " not set");
+    if (isSign) {
+        CHECK(privateKey != nullptr, "Private key not set");
+    }
        
-    const std::optional<std::shared_ptr<std::string>> cache = caches.blockDumpCache.getValue(bh.hash);
-    std::string res;
+    const std::optional<std::shared_ptr<BlockDump>> cache = caches.blockDumpCache.getValue(bh.hash);
+    BlockDump fromFile;
+    std::string_view dump;
     size_t realSizeBlock;
-    std::string fullBlockDump;
+    std::string blockSign;
     if (!cache.has_value()) {
         CHECK(!bh.filePos.fileName.empty(), "Empty file name in block header");
-        std::ifstream file;
-        openFile(file, bh.filePos.fileName);
-        const auto &[size_block, dumpBlock] = torrent_node_lib::getBlockDump(file, bh.filePos.pos, fromByte, toByte);
-        res = dumpBlock;
-        realSizeBlock = size_block;
+        std::tie(realSizeBlock, fromFile) = readBlockDumpFromFile(bh, fromByte, toByte);
+        dump = fromFile.view();
         
-        if (isSign) {
-            if (toByte >= realSizeBlock) {
+        if (isSign && toByte >= realSizeBlock) {
+            blockSign = getSavedBlockSign(bh.hash);
+            if (blockSign.empty()) {
                 if (fromByte == 0) {
-                    fullBlockDump = res;
+                    blockSign = makeAndSaveBlockSign(bh.hash, dump);
                 } else {
-                    const auto &[size_block, dumpBlock] = torrent_node_lib::getBlockDump(file, bh.filePos.pos, 0, toByte);
-                    fullBlockDump = dumpBlock;
+                    const auto &[size_block, dumpBlock] = readBlockDumpFromFile(bh, 0, toByte);
+                    blockSign = makeAndSaveBlockSign(bh.hash, dumpBlock.view());
                 }
             }
         }
     } else {
-        std::shared_ptr<std::string> element = cache.value();
-        res = element->substr(fromByte, toByte - fromByte);
-        realSizeBlock = element->size();
-        if (isSign) {
-            if (toByte >= realSizeBlock) {
-                fullBlockDump = *element;
+        const std::string_view element = cache.value()->view();
+        realSizeBlock = element.size();
+        dump = element.substr(fromByte, toByte - fromByte);
+        if (isSign && toByte >= realSizeBlock) {
+            blockSign = getSavedBlockSign(bh.hash);
+            if (blockSign.empty()) {
+                blockSign = makeAndSaveBlockSign(bh.hash, element);
             }
         }
     }
     
-    if (isSign) {
-        CHECK(privateKey != nullptr, "Private key not set");
-        
-        if (fromByte == 0) {
-            res = makeFirstPartBlockSign(realSizeBlock) + res;
-        }
-        
-        if (toByte >= realSizeBlock) {
-            res += makeBlockSign(fullBlockDump, *privateKey);
-        }
+    std::string res;
+    if (isSign && fromByte == 0) {
+        res = makeFirstPartBlockSign(realSizeBlock);
+    }
+    res.append(dump.data(), dump.size());
+    if (isSign && toByte >= realSizeBlock) {
+        res += blockSign;
     }
     
     if (isHex) {
@@ -425,4 +604,8 @@ size_t SyncImpl::getKnownBlock() const {
     return knownLastBlock.load();
 }
 
+std::optional<AdvanceLoadStatistic> SyncImpl::getAdvanceLoadStatistic() const {
+    return getBlockAlgorithm->getAdvanceLoadStatistic();
+}
+
 }
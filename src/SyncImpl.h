@@ -3,13 +3,18 @@
 
 #include <atomic>
 #include <memory>
+#include <functional>
+#include <string_view>
 
 #include "Cache/Cache.h"
 #include "LevelDb.h"
 #include "BlockChain.h"
+#include "BlockPool.h"
 
 #include "TestP2PNodes.h"
 #include "ConfigOptions.h"
+#include "utils/ReadOnlyFile.h"
+#include "BlockSource/AdvanceLoadController.h"
 
 namespace torrent_node_lib {
 
@@ -56,7 +61,15 @@ public:
         
     std::string getBlockDump(const BlockHeader &bh, size_t fromByte, size_t toByte, bool isHex, bool isSign) const;
     
+    ReadOnlyFileRange getBlockDumpRange(const BlockHeader &bh, size_t fromByte, size_t toByte) const;
+    
+    std::string getBlockDumps(const std::vector<std::shared_ptr<const BlockHeader>> &bhs) const;
+    
+    void getBlockDumps(const std::vector<std::shared_ptr<const BlockHeader>> &bhs, size_t maxChunkSize, const std::function<void(std::string_view chunk)> &processChunk) const;
+    
     size_t getKnownBlock() const;
+    
+    std::optional<AdvanceLoadStatistic> getAdvanceLoadStatistic() const;
 
     size_t getLastBlockDay() const;
     
@@ -64,15 +77,33 @@ public:
 
 private:
    
-    void saveTransactions(BlockInfo &bi, const std::string &binaryDump, bool saveBlockToFile);
+    void saveTransactions(BlockInfo &bi, std::string_view binaryDump, bool saveBlockToFile);
     
     void filterTransactionsToSave(BlockInfo &bi);
     
-    void saveBlockToLeveldb(const BlockInfo &bi);
+    void saveBlockToLeveldb(const BlockInfo &bi, const std::string &blockSign);
+    
+    bool isSaveBlockSigns() const;
+    
+    void saveBlockSignToCache(const BlockInfo &bi, const std::string &blockSign);
+    
+    //c Подписи блоков, прочитанные из базы или посчитанные при запросе. Кэшируются поколениями, чтобы кэш не рос без ограничения
+    void saveReadBlockSignToCache(const std::string &blockHash, const std::string &blockSign) const;
+    
+    std::string getSavedBlockSign(const std::string &blockHash) const;
+    
+    std::string makeAndSaveBlockSign(const std::string &blockHash, std::string_view blockDump) const;
+    
+    void loadBlockchain(const BlocksMetadata &metadata);
+    
+    bool loadBlockchainTail(const BlocksMetadata &metadata);
+    
+    void saveBlockchainSnapshot();
 
 private:
     
-    LevelDb leveldb;
+    //c mutable, так как подписи блоков, посчитанные при первом запросе, сохраняются в getBlockDump
+    mutable LevelDb leveldb;
         
     LevelDbOptions leveldbOptScript;
     
@@ -80,7 +111,13 @@ private:
     
     mutable AllCaches caches;
     
+    mutable std::atomic<size_t> countReadBlockSigns = 0;
+    
     BlockChain blockchain;
+    
+    const std::string blockchainSnapshotFileName;
+    
+    size_t lastSnapshotBlock = 0;
         
     const std::string technicalAddress;
 
@@ -106,6 +143,8 @@ private:
         
     TestP2PNodes testNodes;
     
+    BlockPool blockPool;
+    
 };
 
 }
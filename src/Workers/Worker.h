@@ -9,13 +9,14 @@
 namespace torrent_node_lib {
 
 struct BlockInfo;
+struct BlockDump;
     
 class Worker: public common::no_copyable, common::no_moveable{
 public:
     
     virtual void start() = 0;
     
-    virtual void process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<std::string> dump) = 0;
+    virtual void process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<BlockDump> dump) = 0;
     
     virtual std::optional<size_t> getInitBlockNumber() const = 0;
     
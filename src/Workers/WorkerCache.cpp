@@ -16,14 +16,14 @@ WorkerCache::WorkerCache(AllCaches &caches)
 void WorkerCache::work() {
     while (true) {
         try {
-            std::pair<std::shared_ptr<BlockInfo>, std::shared_ptr<std::string>> element;
+            std::pair<std::shared_ptr<BlockInfo>, std::shared_ptr<BlockDump>> element;
             
             const bool isStopped = !queue.pop(element);
             if (isStopped) {
                 return;
             }
             BlockInfo &bi = *element.first;
-            std::shared_ptr<std::string> blockDump = element.second;
+            std::shared_ptr<BlockDump> blockDump = element.second;
             
             Timer tt;
             
@@ -74,7 +74,7 @@ void WorkerCache::start() {
     thread = Thread(&WorkerCache::work, this);
 }
     
-void WorkerCache::process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<std::string> dump) {
+void WorkerCache::process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<BlockDump> dump) {
     queue.push(std::make_pair(bi, dump));
 }
     
@@ -22,7 +22,7 @@ public:
     
     void start() override;
     
-    void process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<std::string> dump) override;
+    void process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<BlockDump> dump) override;
     
     std::optional<size_t> getInitBlockNumber() const override;
        
@@ -34,7 +34,7 @@ private:
     
 private:
     
-    common::BlockedQueue<std::pair<std::shared_ptr<BlockInfo>, std::shared_ptr<std::string>>, 3> queue;
+    common::BlockedQueue<std::pair<std::shared_ptr<BlockInfo>, std::shared_ptr<BlockDump>>, 3> queue;
        
     AllCaches &caches;
     
@@ -5,6 +5,7 @@
 #include "BlockChain.h"
 
 #include "BlockchainRead.h"
+#include "utils/ReadOnlyFile.h"
 
 #include "parallel_for.h"
 #include "stopProgram.h"
@@ -114,7 +115,7 @@ void WorkerMain::start() {
     workerThread = Thread(&WorkerMain::worker, this);
 }
 
-void WorkerMain::process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<std::string> dump) {   
+void WorkerMain::process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<BlockDump> dump) {   
     if (bi->header.blockNumber.value() > lastSavedBlock) {
         queue.push(bi);
     }
@@ -133,17 +134,22 @@ BlockInfo WorkerMain::getFullBlock(const BlockHeader &bh, size_t beginTx, size_t
         return bi;
     }
     
-    const std::optional<std::shared_ptr<std::string>> cache = caches.blockDumpCache.getValue(bh.hash);
+    const std::optional<std::shared_ptr<BlockDump>> cache = caches.blockDumpCache.getValue(bh.hash);
     if (!cache.has_value()) {
         CHECK(!bh.filePos.fileName.empty(), "Empty file name in block header");
-        std::ifstream file;
-        openFile(file, bh.filePos.fileName);
-        std::string tmp;
-        const size_t nextPos = readNextBlockInfo(file, bh.filePos.pos, bi, tmp, false, false, beginTx, countTx);
+        size_t nextPos;
+        if (isMappedBlockFiles()) {
+            MappedFileView tmp;
+            nextPos = readNextBlockInfo(bh.filePos.fileName, FileAccessPattern::Random, bh.filePos.pos, bi, tmp, false, false, beginTx, countTx);
+        } else {
+            const std::shared_ptr<const ReadOnlyFile> file = getReadOnlyFile(bh.filePos.fileName);
+            std::string tmp;
+            nextPos = readNextBlockInfo(*file, bh.filePos.pos, bi, tmp, false, false, beginTx, countTx);
+        }
         CHECK(nextPos != bh.filePos.pos, "Ups");
     } else {
-        std::shared_ptr<std::string> element = cache.value();
-        readNextBlockInfo(element->data(), element->data() + element->size(), bh.filePos.pos, bi, true, false, beginTx, countTx);
+        const std::string_view element = cache.value()->view();
+        readNextBlockInfo(element.data(), element.data() + element.size(), bh.filePos.pos, bi, true, false, beginTx, countTx);
     }
     
     for (TransactionInfo &tx: bi.txs) {
@@ -39,7 +39,7 @@ public:
     
     void start() override;
     
-    void process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<std::string> dump) override;
+    void process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<BlockDump> dump) override;
     
     std::optional<size_t> getInitBlockNumber() const override;
     
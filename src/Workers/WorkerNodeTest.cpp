@@ -11,8 +11,6 @@
 
 #include "NodeTestsBlockInfo.h"
 
-#include <rapidjson/document.h>
-
 using namespace common;
 
 namespace torrent_node_lib {
@@ -54,28 +52,15 @@ void WorkerNodeTest::work() {
             
             Batch batchStates(false);
             
-            for (const TransactionInfo &tx: bi.txs) {               
-                if (tx.data.size() > 0) {
-                    if (tx.data[0] == '{' && tx.data[tx.data.size() - 1] == '}') {
-                        rapidjson::Document doc;
-                        const rapidjson::ParseResult pr = doc.Parse((const char*)tx.data.data(), tx.data.size());
-                        if (pr) { // Здесь специально стоят if-ы вместо чеков, чтобы не крашится, если пользователь захочет послать какую-нибудь фигню
-                            if (doc.HasMember("method") && doc["method"].IsString()) {
-                                const std::string method = doc["method"].GetString();
-                                if (method == "mh-noderegistration") {
-                                    if (doc.HasMember("params") && doc["params"].IsObject()) {
-                                        const auto &params = doc["params"];
-                                        if (params.HasMember("host") && params["host"].IsString() && params.HasMember("name") && params["name"].IsString()) {
-                                            const std::string host = params["host"].GetString();
-                                            const std::string name = params["name"].GetString();
-                                            LOGINFO << "Node register found " << host;
-                                            allNodes.nodes[host] = name;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
+            for (const TransactionInfo &tx: bi.txs) {
+                if (!tx.dataMethod.has_value()) {
+                    continue;
+                }
+                const TransactionInfo::DataMethod &dataMethod = tx.dataMethod.value();
+                if (dataMethod.method == "mh-noderegistration" && dataMethod.host.has_value() && dataMethod.name.has_value()) {
+                    const std::string &host = dataMethod.host.value();
+                    LOGINFO << "Node register found " << host;
+                    allNodes.nodes[host] = dataMethod.name.value();
                 }
             }
                         
@@ -107,7 +92,7 @@ void WorkerNodeTest::start() {
     thread = Thread(&WorkerNodeTest::work, this);
 }
     
-void WorkerNodeTest::process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<std::string> dump) {
+void WorkerNodeTest::process(std::shared_ptr<BlockInfo> bi, std::shared_ptr<BlockDump> dump) {
     queue.push(bi);
 }
     
@@ -4,6 +4,7 @@
 
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
+#include <rapidjson/prettywriter.h>
 
 #include "BlockChainReadInterface.h"
 
@@ -14,6 +15,8 @@
 #include "utils/compress.h"
 
 #include "BlockInfo.h"
+#include "BlockchainUtils.h"
+#include "BlockSource/AdvanceLoadController.h"
 #include "Workers/NodeTestsBlockInfo.h"
 
 using namespace common;
@@ -76,7 +79,7 @@ std::string genInfoResponse(const RequestId &requestId, const std::string &versi
     return jsonToString(jsonDoc, false);
 }
 
-std::string genStatisticResponse(const RequestId &requestId, size_t statistic, double proc, unsigned long long int memory, int connections) {
+std::string genStatisticResponse(const RequestId &requestId, size_t statistic, double proc, unsigned long long int memory, int connections, const std::optional<AdvanceLoadStatistic> &advanceLoad, const PubkeyCacheStatistic &pubkeyCache) {
     rapidjson::Document jsonDoc(rapidjson::kObjectType);
     auto &allocator = jsonDoc.GetAllocator();
     addIdToResponse(requestId, jsonDoc, allocator);
@@ -86,6 +89,36 @@ std::string genStatisticResponse(const RequestId &requestId, size_t statistic, d
     resultJson.AddMember("proc", proc, allocator);
     resultJson.AddMember("memory", strToJson(std::to_string(memory), allocator), allocator);
     resultJson.AddMember("connections", connections, allocator);
+    if (advanceLoad.has_value()) {
+        rapidjson::Value advanceLoadJson(rapidjson::kObjectType);
+        advanceLoadJson.AddMember("window_blocks", advanceLoad->windowBlocks, allocator);
+        advanceLoadJson.AddMember("advance_blocks", advanceLoad->advanceBlocks, allocator);
+        advanceLoadJson.AddMember("batch_blocks", advanceLoad->batchBlocks, allocator);
+        advanceLoadJson.AddMember("max_block_size_without_advance", advanceLoad->maxBlockSizeWithoutAdvance, allocator);
+        advanceLoadJson.AddMember("bytes_per_second", advanceLoad->bytesPerSecond, allocator);
+        advanceLoadJson.AddMember("latency_ms", advanceLoad->latencyMs, allocator);
+        advanceLoadJson.AddMember("avg_block_size", advanceLoad->avgBlockSize, allocator);
+        rapidjson::Value peersJson(rapidjson::kArrayType);
+        for (const PeerStatistic &peer: advanceLoad->peers) {
+            rapidjson::Value peerJson(rapidjson::kObjectType);
+            peerJson.AddMember("server", strToJson(peer.server, allocator), allocator);
+            peerJson.AddMember("latency_ms", peer.latencyMs, allocator);
+            peerJson.AddMember("bytes_per_second", peer.bytesPerSecond, allocator);
+            peerJson.AddMember("error_rate", peer.errorRate, allocator);
+            peerJson.AddMember("score", peer.score, allocator);
+            peerJson.AddMember("count_requests", peer.countRequests, allocator);
+            peerJson.AddMember("count_errors", peer.countErrors, allocator);
+            peerJson.AddMember("is_ejected", peer.isEjected, allocator);
+            peersJson.PushBack(peerJson, allocator);
+        }
+        advanceLoadJson.AddMember("peers", peersJson, allocator);
+        resultJson.AddMember("advance_load", advanceLoadJson, allocator);
+    }
+    rapidjson::Value pubkeyCacheJson(rapidjson::kObjectType);
+    pubkeyCacheJson.AddMember("hits", pubkeyCache.hits, allocator);
+    pubkeyCacheJson.AddMember("misses", pubkeyCache.misses, allocator);
+    pubkeyCacheJson.AddMember("size", pubkeyCache.size, allocator);
+    resultJson.AddMember("pubkey_cache", pubkeyCacheJson, allocator);
     jsonDoc.AddMember("result", resultJson, allocator);
     return jsonToString(jsonDoc, false);
 }
@@ -213,24 +246,75 @@ std::vector<MinimumBlockHeader> parseBlocksHeader(const std::string &response) {
     return result;
 }
 
-std::string blockHeadersToJson(const RequestId &requestId, const std::vector<BlockHeader> &bh, BlockTypeInfo type, bool isFormat, const JsonVersion &version) {
-    rapidjson::Document doc(rapidjson::kObjectType);
-    auto &allocator = doc.GetAllocator();
-    addIdToResponse(requestId, doc, allocator);
-    rapidjson::Value vals(rapidjson::kArrayType);
-    for (size_t i = 0; i < bh.size(); i++) {
-        const BlockHeader &b  = bh[i];
+namespace {
+
+//c Выходной поток rapidjson, пишущий сразу в строку ответа без промежуточного StringBuffer
+struct StringOutputStream {
+    using Ch = char;
+    
+    explicit StringOutputStream(std::string &result)
+        : result(result)
+    {}
+    
+    void Put(Ch c) {
+        result.push_back(c);
+    }
+    
+    void Flush() {}
+    
+    std::string &result;
+};
+
+}
+
+template<class Writer>
+static void writeBlockHeadersJson(Writer &writer, const RequestId &requestId, const std::vector<std::shared_ptr<const BlockHeader>> &bh, BlockTypeInfo type, const JsonVersion &version) {
+    writer.StartObject();
+    if (requestId.isSet) {
+        writer.Key("id");
+        if (std::holds_alternative<std::string>(requestId.id)) {
+            const std::string &id = std::get<std::string>(requestId.id);
+            writer.String(id.data(), id.size());
+        } else {
+            writer.Uint64(std::get<size_t>(requestId.id));
+        }
+    }
+    writer.Key("result");
+    writer.StartArray();
+    //c Заголовки пишутся по одному. Память под json одного заголовка переиспользуется
+    char allocatorBuffer[16 * 1024];
+    rapidjson::Document::AllocatorType allocator(allocatorBuffer, sizeof(allocatorBuffer));
+    for (const std::shared_ptr<const BlockHeader> &b: bh) {
+        {
+            const rapidjson::Value json = blockHeaderToJson(*b, allocator, type, version);
+            json.Accept(writer);
+        }
+        allocator.Clear();
+    }
+    writer.EndArray();
+    writer.EndObject();
+}
 
-        if (b.blockNumber == 0) {
+std::string blockHeadersToJson(const RequestId &requestId, const std::vector<std::shared_ptr<const BlockHeader>> &bh, BlockTypeInfo type, bool isFormat, const JsonVersion &version) {
+    for (const std::shared_ptr<const BlockHeader> &b: bh) {
+        if (b->blockNumber == 0) {
             return genErrorResponse(requestId, -32603, "Incorrect block number: 0. Genesis block begin with number 1");
         }
-        vals.PushBack(blockHeaderToJson(b, allocator, type, version), allocator);
     }
-    doc.AddMember("result", vals, allocator);
-    return jsonToString(doc, isFormat);
+    
+    std::string result;
+    StringOutputStream stream(result);
+    if (isFormat) {
+        rapidjson::PrettyWriter<StringOutputStream> writer(stream);
+        writeBlockHeadersJson(writer, requestId, bh, type, version);
+    } else {
+        rapidjson::Writer<StringOutputStream> writer(stream);
+        writeBlockHeadersJson(writer, requestId, bh, type, version);
+    }
+    return result;
 }
 
-std::string genDumpBlockBinary(const std::string &block, bool isCompress) {
+std::string genDumpBlockBinary(std::string block, bool isCompress) {
     if (!isCompress) {
         return block;
     } else {
@@ -238,21 +322,39 @@ std::string genDumpBlockBinary(const std::string &block, bool isCompress) {
     }
 }
 
-std::string genDumpBlocksBinary(const std::vector<std::string> &blocks, bool isCompress) {
-    std::string res;
-    if (!blocks.empty()) {
-        res.reserve((8 + blocks[0].size() + 10) * blocks.size());
+DumpBlocksBinaryWriter::DumpBlocksBinaryWriter(bool isCompressStream) {
+    if (isCompressStream) {
+        compressStream = std::make_unique<CompressStream>(result);
     }
-    for (const std::string &block: blocks) {
-        res += serializeStringBigEndian(block);
+}
+
+DumpBlocksBinaryWriter::~DumpBlocksBinaryWriter() = default;
+
+void DumpBlocksBinaryWriter::addBlock(const std::string &block) {
+    if (compressStream == nullptr) {
+        result += serializeIntBigEndian<size_t>(block.size());
+        result += block;
+    } else {
+        compressStream->write(serializeIntBigEndian<size_t>(block.size()));
+        compressStream->write(block);
     }
-    if (!isCompress) {
-        return res;
+}
+
+void DumpBlocksBinaryWriter::addFramed(std::string_view framed) {
+    if (compressStream == nullptr) {
+        result += framed;
     } else {
-        return compress(res);
+        compressStream->write(framed);
     }
 }
 
+std::string DumpBlocksBinaryWriter::finish() {
+    if (compressStream != nullptr) {
+        compressStream->finish();
+    }
+    return std::move(result);
+}
+
 std::string parseDumpBlockBinary(const std::string &response, bool isCompress) {
     if (!isCompress) {
         return response;
@@ -263,6 +365,26 @@ std::string parseDumpBlockBinary(const std::string &response, bool isCompress) {
 
 std::vector<std::string> parseDumpBlocksBinary(const std::string &response, bool isCompress) {
     std::vector<std::string> res;
+    if (isCompress && isCompressedStream(response)) {
+        //c Блоки достаются из кусков по мере разжатия. Целиком держится только хвост, не дошедший до конца блока
+        std::string tail;
+        decompressStream(response, [&res, &tail](std::string_view piece) {
+            tail += piece;
+            size_t from = 0;
+            while (tail.size() - from >= sizeof(uint64_t)) {
+                size_t endPos;
+                const size_t blockSize = deserializeIntBigEndian<size_t>(tail, from, endPos);
+                if (tail.size() - endPos < blockSize) {
+                    break;
+                }
+                res.emplace_back(tail, endPos, blockSize);
+                from = endPos + blockSize;
+            }
+            tail.erase(0, from);
+        });
+        CHECK(tail.empty(), "Incorrect compressed dumps");
+        return res;
+    }
     const std::string r = isCompress ? decompress(response) : response;
     size_t from = 0;
     while (from < r.size()) {
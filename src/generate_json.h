@@ -2,10 +2,17 @@
 #define GENERATE_JSON_H_
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
 #include <variant>
 #include <functional>
 
 namespace torrent_node_lib {
+class CompressStream;
+struct AdvanceLoadStatistic;
+struct PubkeyCacheStatistic;
 class BlockChainReadInterface;
 struct BlockHeader;
 struct MinimumBlockHeader;
@@ -30,7 +37,7 @@ std::string genStatusResponse(const RequestId &requestId, const std::string &ver
 
 std::string genInfoResponse(const RequestId &requestId, const std::string &version, const std::string &privkey);
 
-std::string genStatisticResponse(const RequestId &requestId, size_t statistic, double proc, unsigned long long int memory, int connections);
+std::string genStatisticResponse(const RequestId &requestId, size_t statistic, double proc, unsigned long long int memory, int connections, const std::optional<torrent_node_lib::AdvanceLoadStatistic> &advanceLoad, const torrent_node_lib::PubkeyCacheStatistic &pubkeyCache);
 
 std::string genStatisticResponse(size_t statistic);
 
@@ -42,15 +49,42 @@ std::string genBlockDumpJson(const RequestId &requestId, const std::string &bloc
 
 std::string genTestSignStringJson(const RequestId &requestId, const std::string &responseHex);
 
-std::string genDumpBlockBinary(const std::string &block, bool isCompress);
-
-std::string genDumpBlocksBinary(const std::vector<std::string> &blocks, bool isCompress);
+std::string genDumpBlockBinary(std::string block, bool isCompress);
+
+/**
+ *c Собирает ответ get-dumps-blocks-by-* (размер блока big endian + дамп) по одному блоку, не держа все дампы в векторе.
+ *c При isCompressStream сжимает на лету через CompressStream, тогда в памяти лежит только сжатый результат
+ */
+class DumpBlocksBinaryWriter {
+public:
+    
+    explicit DumpBlocksBinaryWriter(bool isCompressStream);
+    
+    DumpBlocksBinaryWriter(const DumpBlocksBinaryWriter &) = delete;
+    DumpBlocksBinaryWriter& operator=(const DumpBlocksBinaryWriter &) = delete;
+    
+    ~DumpBlocksBinaryWriter();
+    
+    void addBlock(const std::string &block);
+    
+    //c Уже обрамленные блоки, например из Sync::getBlockDumps
+    void addFramed(std::string_view framed);
+    
+    std::string finish();
+    
+private:
+    
+    std::string result;
+    
+    std::unique_ptr<torrent_node_lib::CompressStream> compressStream;
+};
 
 std::string parseDumpBlockBinary(const std::string &response, bool isCompress);
 
+//c При isCompress понимает и ответ CompressStream, и ответ compress
 std::vector<std::string> parseDumpBlocksBinary(const std::string &response, bool isCompress);
 
-std::string blockHeadersToJson(const RequestId &requestId, const std::vector<torrent_node_lib::BlockHeader> &bh, BlockTypeInfo type, bool isFormat, const JsonVersion &version);
+std::string blockHeadersToJson(const RequestId &requestId, const std::vector<std::shared_ptr<const torrent_node_lib::BlockHeader>> &bh, BlockTypeInfo type, bool isFormat, const JsonVersion &version);
 
 torrent_node_lib::MinimumBlockHeader parseBlockHeader(const std::string &response);
 
@@ -16,6 +16,8 @@
 #include "utils/utils.h"
 #include "log.h"
 #include "utils/FileSystem.h"
+#include "utils/sha256.h"
+#include "utils/benchmarks.h"
 
 #include "duration.h"
 
@@ -28,6 +30,7 @@
 
 #include "P2P/P2P.h"
 #include "P2P/P2P_Ips.h"
+#include "P2P/P2P_Async.h"
 #include "P2P/P2P_Graph.h"
 #include "P2P/P2P_Simple.h"
 
@@ -50,9 +53,9 @@ void crash_handler(int sig) {
     exit(1);
 }
 
-static void serverThreadFunc(const Sync &sync, int port, const std::string &privkey) {
+static void serverThreadFunc(const Sync &sync, int port, const std::string &privkey, int countServerThreads, int maxWaitingRequests) {
     try {
-        Server server(sync, port, countRunningServerThreads, privkey);
+        Server server(sync, port, countRunningServerThreads, privkey, countServerThreads, maxWaitingRequests);
         std::this_thread::sleep_for(1s); // Небольшая задержка сервера перед запуском
         server.start("./");
     } catch (const exception &e) {
@@ -124,6 +127,12 @@ int main (int argc, char *const *argv) {
     LOGINFO << "Repository version " << g_GIT_SHA1 << " " << VERSION << " " << g_GIT_DATE;
     LOGINFO << "Is local changes " << g_GIT_IS_LOCAL_CHANGES;
     LOGINFO << "Branch " << g_GIT_REFSPEC;
+    
+    LOGINFO << "Sha256 batch implementation " << torrent_node_lib::getSha256BatchImplementationName();
+    if (!checkSha256Batch()) {
+        LOGERR << "Sha256 batch implementation " << torrent_node_lib::getSha256BatchImplementationName() << " returns incorrect hashes";
+        return -1;
+    }
    
     const std::string path_to_config(argv[1]);
     libconfig::Config config;
@@ -202,6 +211,28 @@ int main (int argc, char *const *argv) {
         if (allSettings.exists("compress_blocks")) {
             isCompress = static_cast<bool>(allSettings["compress_blocks"]);
         }
+        if (allSettings.exists("mmap_block_files")) {
+            setMappedBlockFiles(static_cast<bool>(allSettings["mmap_block_files"]));
+        }
+        bool isP2PAsync = false;
+        if (allSettings.exists("p2p_async")) {
+            isP2PAsync = static_cast<bool>(allSettings["p2p_async"]);
+        }
+        bool isHeadersFirst = false;
+        if (allSettings.exists("headers_first")) {
+            isHeadersFirst = static_cast<bool>(allSettings["headers_first"]);
+        }
+        int countServerThreads = 8;
+        if (allSettings.exists("server_threads")) {
+            countServerThreads = static_cast<int>(allSettings["server_threads"]);
+        }
+        //c Каждый нижестоящий узел держит на сервере по long poll, остальные потоки нужны для скачивания блоков
+        int maxWaitingRequests = countServerThreads / 2;
+        if (allSettings.exists("max_waiting_requests")) {
+            maxWaitingRequests = static_cast<int>(allSettings["max_waiting_requests"]);
+        }
+        CHECK(countServerThreads > 0, "Incorrect server_threads");
+        CHECK(0 <= maxWaitingRequests && maxWaitingRequests < countServerThreads, "max_waiting_requests must be less than server_threads");
 
         std::string technicalAddress;
         if (allSettings.exists("technical_address")) {
@@ -217,6 +248,13 @@ int main (int argc, char *const *argv) {
         LOGINFO << "Modules " << modules;
         
         std::unique_ptr<P2P> p2p = nullptr;
+        const auto makeP2P = [countConnections, isP2PAsync](const std::vector<std::string> &serversStr) -> std::unique_ptr<P2P> {
+            if (isP2PAsync) {
+                return std::make_unique<P2P_Async>(serversStr, countConnections);
+            } else {
+                return std::make_unique<P2P_Ips>(serversStr, countConnections);
+            }
+        };
         
         size_t otherPortTorrent = port;
         if (allSettings.exists("other_torrent_port")) {
@@ -230,13 +268,13 @@ int main (int argc, char *const *argv) {
             for (const std::string &serverStr: allSettings["servers"]) {
                 serversStr.push_back(serverStr);
             }
-            p2p = std::make_unique<P2P_Ips>(serversStr, countConnections);
+            p2p = makeP2P(serversStr);
         } else {
             const std::string &serverName = allSettings["servers"];
             const NsResult bestIp = getBestIp(serverName);
             std::vector<std::string> serversStr{bestIp.server};
 
-            p2p = std::make_unique<P2P_Ips>(serversStr, countConnections);
+            p2p = makeP2P(serversStr);
         }
 
         Sync sync(
@@ -244,7 +282,7 @@ int main (int argc, char *const *argv) {
             technicalAddress,
             LevelDbOptions(settingsDb.writeBufSizeMb, settingsDb.isBloomFilter, settingsDb.isChecks, getFullPath("simple", pathToBd), settingsDb.lruCacheMb),
             CachesOptions(maxCountElementsBlockCache, maxCountElementsTxsCache, maxLocalCacheElements),
-            GetterBlockOptions(maxAdvancedLoadBlocks, countBlocksInBatch, p2p.get(), getBlocksFromFile, isValidate, isValidateSign, isCompress),
+            GetterBlockOptions(maxAdvancedLoadBlocks, countBlocksInBatch, p2p.get(), getBlocksFromFile, isValidate, isValidateSign, isCompress, isHeadersFirst),
             signKey,
             TestNodesOptions(otherPortTorrent, myIp, testNodesServer)
         );
@@ -257,7 +295,7 @@ int main (int argc, char *const *argv) {
         
         //LOGINFO << "Is virtual machine: " << sync.isVirtualMachine();
         
-        std::thread serverThread(serverThreadFunc, std::cref(sync), port, signKey);
+        std::thread serverThread(serverThreadFunc, std::cref(sync), port, signKey, countServerThreads, maxWaitingRequests);
         serverThread.detach();
         
         //sync.addUsers({Address("0x0049704639387c1ae22283184e7bc52d38362ade0f977030e6"), Address("0x0034d209107371745c6f5634d6ed87199bac872c310091ca56")});
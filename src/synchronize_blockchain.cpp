@@ -37,6 +37,18 @@ std::string Sync::getBlockDump(const BlockHeader& bh, size_t fromByte, size_t to
     return impl->getBlockDump(bh, fromByte, toByte, isHex, isSign);
 }
 
+ReadOnlyFileRange Sync::getBlockDumpRange(const BlockHeader& bh, size_t fromByte, size_t toByte) const {
+    return impl->getBlockDumpRange(bh, fromByte, toByte);
+}
+
+std::string Sync::getBlockDumps(const std::vector<std::shared_ptr<const BlockHeader>> &bhs) const {
+    return impl->getBlockDumps(bhs);
+}
+
+void Sync::getBlockDumps(const std::vector<std::shared_ptr<const BlockHeader>> &bhs, size_t maxChunkSize, const std::function<void(std::string_view chunk)> &processChunk) const {
+    impl->getBlockDumps(bhs, maxChunkSize, processChunk);
+}
+
 bool Sync::isVirtualMachine() const {
     return torrent_node_lib::isVirtualMachine();
 }
@@ -45,6 +57,10 @@ size_t Sync::getKnownBlock() const {
     return impl->getKnownBlock();
 }
 
+std::optional<AdvanceLoadStatistic> Sync::getAdvanceLoadStatistic() const {
+    return impl->getAdvanceLoadStatistic();
+}
+
 void Sync::synchronize(int countThreads) {
     impl->synchronize(countThreads);
 }
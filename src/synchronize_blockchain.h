@@ -6,10 +6,15 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <optional>
 #include <set>
 #include <unordered_map>
+#include <functional>
+#include <string_view>
 
 #include "ConfigOptions.h"
+#include "utils/ReadOnlyFile.h"
+#include "BlockSource/AdvanceLoadController.h"
 
 namespace torrent_node_lib {
 
@@ -58,9 +63,23 @@ public:
     
     std::string getBlockDump(const BlockHeader &bh, size_t fromByte, size_t toByte, bool isHex, bool isSign) const;
 
+    /**
+     *c Место сырого дампа блока в файле для отдачи без копирования.
+     *c Пустой кусок, если блок еще не записан в файл или fromByte за концом блока
+     */
+    ReadOnlyFileRange getBlockDumpRange(const BlockHeader &bh, size_t fromByte, size_t toByte) const;
+
+    //c Сырые дампы блоков в формате ответа get-dumps-blocks-by-*. Соседние в файле блоки читаются одним куском
+    std::string getBlockDumps(const std::vector<std::shared_ptr<const BlockHeader>> &bhs) const;
+
+    //c То же, но результат отдается кусками не больше maxChunkSize
+    void getBlockDumps(const std::vector<std::shared_ptr<const BlockHeader>> &bhs, size_t maxChunkSize, const std::function<void(std::string_view chunk)> &processChunk) const;
+
     std::vector<TransactionInfo> getLastTxs() const;
 
     size_t getKnownBlock() const;
+    
+    std::optional<AdvanceLoadStatistic> getAdvanceLoadStatistic() const;
 
     std::string signTestString(const std::string &str, bool isHex) const;
     
@@ -72,6 +91,9 @@ private:
 
 void initBlockchainUtils();
 
+//c Читать файлы блоков через отображение в память вместо pread
+void setMappedBlockFiles(bool isMapped);
+
 }
 
 #endif // SYNCHRONIZE_BLOCKCHAIN_H_
@@ -0,0 +1,134 @@
+#include "Epoch.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+
+#include "check.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+const static size_t MAX_READER_THREADS = 1024;
+
+struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> used{false};
+};
+
+static std::array<ReaderSlot, MAX_READER_THREADS> readerSlots;
+
+static std::atomic<uint64_t> globalEpoch{1};
+
+struct RetiredObject {
+    uint64_t epoch;
+    std::function<void()> deleter;
+};
+
+static std::mutex retiredMut;
+static std::vector<RetiredObject> retiredObjects;
+
+//c Эпоха самого нового из ждущих удаления объектов, 0 если список пуст.
+//c Читатель с эпохой не больше нее мог их держать и при выходе сам запускает удаление
+static std::atomic<uint64_t> newestRetiredEpoch{0};
+
+//c Ячейка закрепляется за потоком при первом чтении и освобождается при завершении потока
+struct ThreadReaderSlot {
+
+    ThreadReaderSlot() {
+        for (ReaderSlot &s: readerSlots) {
+            bool expected = false;
+            if (!s.used.load(std::memory_order_relaxed) && s.used.compare_exchange_strong(expected, true)) {
+                slot = &s;
+                return;
+            }
+        }
+        throwErr("Too many reader threads");
+    }
+
+    ~ThreadReaderSlot() {
+        slot->epoch.store(0, std::memory_order_release);
+        slot->used.store(false, std::memory_order_release);
+    }
+
+    ReaderSlot *slot = nullptr;
+    size_t depth = 0;
+};
+
+static ThreadReaderSlot& getThreadReaderSlot() {
+    thread_local ThreadReaderSlot threadSlot;
+    return threadSlot;
+}
+
+EpochGuard::EpochGuard() {
+    ThreadReaderSlot &threadSlot = getThreadReaderSlot();
+    if (threadSlot.depth++ == 0) {
+        threadSlot.slot->epoch.store(globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        //c Объявление эпохи должно быть видно писателю раньше, чем мы прочитаем опубликованные указатели
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+EpochGuard::~EpochGuard() {
+    ThreadReaderSlot &threadSlot = getThreadReaderSlot();
+    if (--threadSlot.depth == 0) {
+        const uint64_t epoch = threadSlot.slot->epoch.load(std::memory_order_relaxed);
+        //c seq_cst в паре с retireObject: либо писатель увидит освобожденную ячейку, либо читатель увидит новый объект
+        threadSlot.slot->epoch.store(0, std::memory_order_seq_cst);
+        if (epoch <= newestRetiredEpoch.load(std::memory_order_seq_cst)) {
+            reclaimRetiredObjects();
+        }
+    }
+}
+
+void retireObject(std::function<void()> deleter) {
+    const uint64_t epoch = globalEpoch.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(retiredMut);
+        retiredObjects.push_back(RetiredObject{epoch, std::move(deleter)});
+        newestRetiredEpoch.store(std::max(newestRetiredEpoch.load(std::memory_order_relaxed), epoch), std::memory_order_seq_cst);
+    }
+    reclaimRetiredObjects();
+}
+
+void reclaimRetiredObjects() {
+    std::vector<RetiredObject> toDelete;
+    {
+        std::lock_guard<std::mutex> lock(retiredMut);
+        if (retiredObjects.empty()) {
+            return;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t minEpoch = std::numeric_limits<uint64_t>::max();
+        for (const ReaderSlot &s: readerSlots) {
+            const uint64_t epoch = s.epoch.load(std::memory_order_acquire);
+            if (epoch != 0) {
+                minEpoch = std::min(minEpoch, epoch);
+            }
+        }
+
+        auto iter = retiredObjects.begin();
+        while (iter != retiredObjects.end()) {
+            if (iter->epoch < minEpoch) {
+                toDelete.emplace_back(std::move(*iter));
+                iter = retiredObjects.erase(iter);
+            } else {
+                iter++;
+            }
+        }
+        if (retiredObjects.empty()) {
+            newestRetiredEpoch.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    for (RetiredObject &object: toDelete) {
+        object.deleter();
+    }
+}
+
+}
@@ -0,0 +1,38 @@
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+#include <functional>
+
+namespace torrent_node_lib {
+
+//c Защита чтения по эпохам (epoch based reclamation).
+//c Читатель на время чтения объявляет текущую эпоху в своей ячейке потока и не берет никаких блокировок.
+//c Писатель после снятия объекта с публикации передает его в retireObject,
+//c а удаление происходит только тогда, когда ни один читатель уже не может его видеть.
+class EpochGuard {
+public:
+
+    EpochGuard();
+
+    EpochGuard(const EpochGuard &) = delete;
+    EpochGuard& operator=(const EpochGuard &) = delete;
+
+    ~EpochGuard();
+};
+
+void retireObject(std::function<void()> deleter);
+
+//c Удаляет объекты, которые уже не видит ни один читатель.
+//c Вызывается из retireObject и при выходе последнего читателя, который мог видеть снятые объекты
+void reclaimRetiredObjects();
+
+template<typename T>
+void retireObject(T *object) {
+    retireObject([object]() {
+        delete object;
+    });
+}
+
+}
+
+#endif // EPOCH_H_
@@ -0,0 +1,108 @@
+#include "MappedFile.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#include "check.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+MappedFile::MappedFile(const std::string &fileName, FileAccessPattern pattern, size_t reserveSize) {
+    const int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    CHECK(fd != -1, "Dont open file " + fileName + ": " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        const int err = errno;
+        ::close(fd);
+        throwErr("Dont stat file " + fileName + ": " + std::strerror(err));
+    }
+    length = st.st_size;
+    mappedLength = st.st_size + reserveSize;
+
+    if (mappedLength != 0) {
+        //c MAP_SHARED, чтобы дописанные после отображения байты гарантированно были видны
+        void *p = ::mmap(nullptr, mappedLength, PROT_READ, MAP_SHARED, fd, 0);
+        const int err = errno;
+        ::close(fd);
+        CHECK(p != MAP_FAILED, "Dont mmap file " + fileName + ": " + std::strerror(err));
+        ptr = static_cast<const char*>(p);
+        if (pattern == FileAccessPattern::Sequential) {
+            ::madvise(p, mappedLength, MADV_SEQUENTIAL);
+        } else if (pattern == FileAccessPattern::Random) {
+            ::madvise(p, mappedLength, MADV_RANDOM);
+        }
+    } else {
+        ::close(fd);
+    }
+    isOpened = true;
+}
+
+MappedFile::MappedFile(MappedFile &&second) noexcept
+    : ptr(std::exchange(second.ptr, nullptr))
+    , length(second.length.exchange(0))
+    , mappedLength(std::exchange(second.mappedLength, 0))
+    , isOpened(std::exchange(second.isOpened, false))
+{}
+
+MappedFile& MappedFile::operator=(MappedFile &&second) noexcept {
+    if (this != &second) {
+        close();
+        ptr = std::exchange(second.ptr, nullptr);
+        length = second.length.exchange(0);
+        mappedLength = std::exchange(second.mappedLength, 0);
+        isOpened = std::exchange(second.isOpened, false);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+void MappedFile::close() {
+    if (ptr != nullptr) {
+        ::munmap(const_cast<char*>(ptr), mappedLength);
+    }
+    ptr = nullptr;
+    length = 0;
+    mappedLength = 0;
+    isOpened = false;
+}
+
+bool MappedFile::isOpen() const {
+    return isOpened;
+}
+
+const char* MappedFile::data() const {
+    return ptr;
+}
+
+size_t MappedFile::size() const {
+    return length.load(std::memory_order_acquire);
+}
+
+size_t MappedFile::capacity() const {
+    return mappedLength;
+}
+
+void MappedFile::grow(size_t newSize) const {
+    newSize = std::min(newSize, mappedLength);
+    size_t current = length.load(std::memory_order_relaxed);
+    while (current < newSize && !length.compare_exchange_weak(current, newSize, std::memory_order_release)) {
+    }
+}
+
+std::string_view MappedFile::view() const {
+    return std::string_view(ptr, size());
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <string>
+#include <string_view>
+#include <atomic>
+
+namespace torrent_node_lib {
+
+enum class FileAccessPattern {
+    Default, Sequential, Random
+};
+
+//c Файл, отображенный в память только для чтения.
+//c Отображение может быть длиннее файла на reserveSize: когда файл дописывается, новые байты видны без повторного отображения
+class MappedFile {
+public:
+
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string &fileName, FileAccessPattern pattern = FileAccessPattern::Default, size_t reserveSize = 0);
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile& operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&second) noexcept;
+    MappedFile& operator=(MappedFile &&second) noexcept;
+
+    ~MappedFile();
+
+    bool isOpen() const;
+
+    const char* data() const;
+
+    //c Сколько байт файла можно читать
+    size_t size() const;
+    
+    //c Длина отображения. size() может дорасти до нее
+    size_t capacity() const;
+    
+    //c Файл дописан до newSize. Байты за size() до capacity() становятся доступны
+    void grow(size_t newSize) const;
+
+    std::string_view view() const;
+
+private:
+
+    void close();
+
+private:
+
+    const char *ptr = nullptr;
+    mutable std::atomic<size_t> length{0};
+    size_t mappedLength = 0;
+    bool isOpened = false;
+};
+
+}
+
+#endif // MAPPED_FILE_H_
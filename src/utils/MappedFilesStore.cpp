@@ -0,0 +1,110 @@
+#include "MappedFilesStore.h"
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include "check.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+const static size_t MAX_MAPPED_FILES = 256;
+
+//c Запас отображения под дописывание файла. Пока блоки у вершины цепочки помещаются в запас, файл не отображается заново
+const static size_t MAPPED_FILE_RESERVE = 64 * 1024 * 1024;
+
+static std::atomic<bool> isMappedBlockFilesFlag(false);
+
+void setMappedBlockFiles(bool isMapped) {
+    isMappedBlockFilesFlag = isMapped;
+}
+
+bool isMappedBlockFiles() {
+    return isMappedBlockFilesFlag.load(std::memory_order_relaxed);
+}
+
+namespace {
+
+size_t getFileSize(const std::string &fileName) {
+    struct stat st;
+    CHECK(::stat(fileName.c_str(), &st) == 0, "Dont stat file " + fileName + ": " + std::strerror(errno));
+    return st.st_size;
+}
+
+class MappedFilesStore {
+public:
+
+    std::shared_ptr<const MappedFile> get(const std::string &fileName, size_t minSize, FileAccessPattern pattern) {
+        const std::string key = std::to_string(static_cast<int>(pattern)) + fileName;
+        std::shared_ptr<const MappedFile> mapped;
+        {
+            std::lock_guard<std::mutex> lock(mut);
+            const auto found = files.find(key);
+            if (found != files.end()) {
+                lru.splice(lru.begin(), lru, found->second);
+                if (found->second->second->size() >= minSize) {
+                    return found->second->second;
+                }
+                mapped = found->second->second;
+            }
+        }
+        
+        if (mapped != nullptr && minSize <= mapped->capacity()) {
+            //c Файл дописывается, но новые байты еще внутри отображения: достаточно узнать текущий размер
+            mapped->grow(getFileSize(fileName));
+            return mapped;
+        }
+
+        //c Файл вырос за отображение, отображаем его заново с запасом. Старое отображение держат его читатели
+        std::shared_ptr<const MappedFile> file = std::make_shared<const MappedFile>(fileName, pattern, MAPPED_FILE_RESERVE);
+
+        std::lock_guard<std::mutex> lock(mut);
+        const auto found = files.find(key);
+        if (found != files.end()) {
+            if (found->second->second->capacity() >= file->capacity()) {
+                found->second->second->grow(file->size());
+                return found->second->second;
+            }
+            found->second->second = file;
+            return file;
+        }
+        lru.emplace_front(key, file);
+        files.emplace(key, lru.begin());
+        if (lru.size() > MAX_MAPPED_FILES) {
+            files.erase(lru.back().first);
+            lru.pop_back();
+        }
+        return file;
+    }
+
+private:
+
+    using Element = std::pair<std::string, std::shared_ptr<const MappedFile>>;
+
+    std::list<Element> lru;
+    std::unordered_map<std::string, std::list<Element>::iterator> files;
+
+    std::mutex mut;
+};
+
+}
+
+MappedFileView getMappedFileView(const std::string &fileName, size_t pos, size_t size, FileAccessPattern pattern) {
+    CHECK(!fileName.empty(), "Empty file name");
+    static MappedFilesStore store;
+
+    MappedFileView result;
+    result.file = store.get(fileName, pos + size, pattern);
+    if (pos < result.file->size()) {
+        result.data = result.file->view().substr(pos, size);
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILES_STORE_H_
+#define MAPPED_FILES_STORE_H_
+
+#include <string>
+#include <string_view>
+#include <memory>
+
+#include "MappedFile.h"
+
+namespace torrent_node_lib {
+
+//c Кусок отображенного файла. Отображение живет, пока жив view
+struct MappedFileView {
+    std::shared_ptr<const MappedFile> file;
+    std::string_view data;
+};
+
+/**
+ *c Возвращает кусок [pos, pos + size) файла прямо из отображения.
+ *c Файл отображается с запасом под дописывание и отображается заново, только когда вырос за запас. Если файл короче, возвращается столько, сколько есть.
+ *c Для каждого способа доступа держится свое отображение со своим madvise
+ */
+MappedFileView getMappedFileView(const std::string &fileName, size_t pos, size_t size, FileAccessPattern pattern);
+
+void setMappedBlockFiles(bool isMapped);
+
+//c Читать ли файлы блоков через отображение в память вместо pread
+bool isMappedBlockFiles();
+
+}
+
+#endif // MAPPED_FILES_STORE_H_
@@ -0,0 +1,112 @@
+#include "ReadOnlyFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "check.h"
+
+using namespace common;
+
+namespace torrent_node_lib {
+
+const static size_t MAX_OPENED_FILES = 256;
+
+ReadOnlyFile::ReadOnlyFile(const std::string &fileName)
+    : fileName(fileName)
+{
+    CHECK(!fileName.empty(), "Empty file name");
+    fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    CHECK(fd != -1, "File " + fileName + " not opened: " + std::strerror(errno));
+}
+
+ReadOnlyFile::~ReadOnlyFile() {
+    if (fd != -1) {
+        ::close(fd);
+    }
+}
+
+size_t ReadOnlyFile::read(size_t pos, char *buffer, size_t size) const {
+    size_t readed = 0;
+    while (readed < size) {
+        const ssize_t res = ::pread(fd, buffer + readed, size - readed, pos + readed);
+        if (res == 0) {
+            break;
+        } else if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throwErr("Error read file " + fileName + ": " + std::strerror(errno));
+        }
+        readed += res;
+    }
+    return readed;
+}
+
+const std::string& ReadOnlyFile::getFileName() const {
+    return fileName;
+}
+
+void readFileRange(const ReadOnlyFileRange &range, std::string &result) {
+    CHECK(range.file != nullptr, "File not set");
+    result.resize(range.length);
+    const size_t readed = range.file->read(range.offset, result.data(), range.length);
+    CHECK(readed == range.length, "File " + range.file->getFileName() + " truncated");
+}
+
+namespace {
+
+class ReadOnlyFilesCache {
+public:
+
+    std::shared_ptr<const ReadOnlyFile> get(const std::string &fileName) {
+        {
+            std::lock_guard<std::mutex> lock(mut);
+            const auto found = files.find(fileName);
+            if (found != files.end()) {
+                lru.splice(lru.begin(), lru, found->second);
+                return found->second->second;
+            }
+        }
+
+        //c Файл открываем без блокировки, open может быть долгим
+        std::shared_ptr<const ReadOnlyFile> file = std::make_shared<const ReadOnlyFile>(fileName);
+
+        std::lock_guard<std::mutex> lock(mut);
+        const auto found = files.find(fileName);
+        if (found != files.end()) {
+            lru.splice(lru.begin(), lru, found->second);
+            return found->second->second;
+        }
+        lru.emplace_front(fileName, file);
+        files.emplace(fileName, lru.begin());
+        if (lru.size() > MAX_OPENED_FILES) {
+            files.erase(lru.back().first);
+            lru.pop_back();
+        }
+        return file;
+    }
+
+private:
+
+    using Element = std::pair<std::string, std::shared_ptr<const ReadOnlyFile>>;
+
+    std::list<Element> lru;
+    std::unordered_map<std::string, std::list<Element>::iterator> files;
+
+    std::mutex mut;
+};
+
+}
+
+std::shared_ptr<const ReadOnlyFile> getReadOnlyFile(const std::string &fileName) {
+    static ReadOnlyFilesCache cache;
+    return cache.get(fileName);
+}
+
+}
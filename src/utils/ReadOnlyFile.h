@@ -0,0 +1,51 @@
+#ifndef READ_ONLY_FILE_H_
+#define READ_ONLY_FILE_H_
+
+#include <string>
+#include <memory>
+
+namespace torrent_node_lib {
+
+//c Файл, открытый только на чтение. Чтение позиционное (pread), поэтому один дескриптор можно читать из нескольких потоков без seek
+class ReadOnlyFile {
+public:
+
+    explicit ReadOnlyFile(const std::string &fileName);
+
+    ReadOnlyFile(const ReadOnlyFile &) = delete;
+    ReadOnlyFile& operator=(const ReadOnlyFile &) = delete;
+
+    ~ReadOnlyFile();
+
+    /**
+     *c Читает не больше size байт с позиции pos. Меньше size возвращает только если достигнут конец файла
+     */
+    size_t read(size_t pos, char *buffer, size_t size) const;
+
+    const std::string& getFileName() const;
+
+private:
+
+    int fd = -1;
+    const std::string fileName;
+};
+
+//c Непрерывный кусок файла. Его можно отдать клиенту как есть (sendfile по fd) или прочитать одним pread
+struct ReadOnlyFileRange {
+    std::shared_ptr<const ReadOnlyFile> file;
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+//c Читает кусок одним pread прямо в result, без промежуточных буферов
+void readFileRange(const ReadOnlyFileRange &range, std::string &result);
+
+/**
+ *c Общий на весь процесс LRU кэш открытых файлов блоков.
+ *c Файл, вытесненный из кэша, закрывается, когда его отпустит последний читатель
+ */
+std::shared_ptr<const ReadOnlyFile> getReadOnlyFile(const std::string &fileName);
+
+}
+
+#endif // READ_ONLY_FILE_H_
@@ -13,11 +13,14 @@
 #include <iostream>
 #include <array>
 #include <vector>
+#include <algorithm>
 
 #include <openssl/sha.h>
 
 #include "duration.h"
 
+#include "sha256.h"
+
 static long get_openssl_test() {
     std::array<unsigned char, SHA256_DIGEST_LENGTH> sha_1;
     common::Timer tt;
@@ -29,6 +32,80 @@ static long get_openssl_test() {
     return tt.countMs();
 }
 
+//c Сообщения размером с обычную транзакцию
+static std::vector<std::string> getTxLikeMessages() {
+    std::vector<std::string> messages;
+    for (size_t i = 0; i < 100000; i++) {
+        messages.emplace_back(150 + i % 200, char(i));
+    }
+    return messages;
+}
+
+static long get_double_sha256_test() {
+    const std::vector<std::string> messages = getTxLikeMessages();
+    std::array<unsigned char, SHA256_DIGEST_LENGTH> sha_1;
+    std::array<unsigned char, SHA256_DIGEST_LENGTH> sha_2;
+    common::Timer tt;
+    for (const std::string &message: messages) {
+        SHA256((const unsigned char*)message.data(), message.size(), sha_1.data());
+        SHA256(sha_1.data(), sha_1.size(), sha_2.data());
+    }
+    tt.stop();
+    return tt.countMs();
+}
+
+//c Сравнивает выбранную реализацию sha256Batch с openssl. Длины идут через границы дополнения (55, 56, 64 байта и кратные),
+//c размеры пачек некратны числу сообщений, которые avx2 считает за раз
+bool checkSha256Batch() {
+    std::string data(300, 0);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = char(i * 131 + 7);
+    }
+    
+    for (size_t countMessages = 1; countMessages <= 19; countMessages++) {
+        for (size_t baseSize = 0; baseSize <= 260; baseSize++) {
+            std::vector<torrent_node_lib::Sha256Message> batch;
+            for (size_t i = 0; i < countMessages; i++) {
+                //c Длины в пачке разные, чтобы сообщения заканчивались на разных блоках
+                const size_t size = (baseSize + i * 37) % (data.size() - i);
+                batch.push_back(torrent_node_lib::Sha256Message{(const unsigned char*)data.data() + i, size});
+            }
+            
+            const std::vector<torrent_node_lib::Sha256Hash> hashes = torrent_node_lib::sha256Batch(batch);
+            const std::vector<torrent_node_lib::Sha256Hash> doubleHashes = torrent_node_lib::doubleSha256Batch(batch);
+            if (hashes.size() != batch.size() || doubleHashes.size() != batch.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < batch.size(); i++) {
+                std::array<unsigned char, SHA256_DIGEST_LENGTH> sha_1;
+                std::array<unsigned char, SHA256_DIGEST_LENGTH> sha_2;
+                SHA256(batch[i].data, batch[i].size, sha_1.data());
+                SHA256(sha_1.data(), sha_1.size(), sha_2.data());
+                if (!std::equal(sha_1.begin(), sha_1.end(), hashes[i].begin()) || !std::equal(sha_2.begin(), sha_2.end(), doubleHashes[i].begin())) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static long get_double_sha256_batch_test() {
+    if (!checkSha256Batch()) {
+        return 0;
+    }
+
+    const std::vector<std::string> messages = getTxLikeMessages();
+    std::vector<torrent_node_lib::Sha256Message> batch;
+    for (const std::string &message: messages) {
+        batch.push_back(torrent_node_lib::Sha256Message{(const unsigned char*)message.data(), message.size()});
+    }
+    common::Timer tt;
+    const std::vector<torrent_node_lib::Sha256Hash> hashes = torrent_node_lib::doubleSha256Batch(batch);
+    tt.stop();
+    return hashes.size() == messages.size() ? tt.countMs() : 0;
+}
+
 static long get_mem_total() {
     struct sysinfo info;
     const int res = sysinfo(&info);
@@ -115,6 +192,8 @@ static BenchmarkInfo getBenchImpl() {
     info.opensslTest = get_openssl_test();
     info.ioTest = checkIO();
     info.ioTest2 = checkIO2();
+    info.doubleSha256Test = get_double_sha256_test();
+    info.doubleSha256BatchTest = get_double_sha256_batch_test();
     return info;
 }
 
@@ -6,8 +6,13 @@ struct BenchmarkInfo {
     long memory;
     long ioTest;
     long ioTest2;
+    long doubleSha256Test;
+    long doubleSha256BatchTest;
 };
 
 BenchmarkInfo getBench();
 
+//c Проверяет, что выбранная реализация sha256Batch считает так же, как openssl
+bool checkSha256Batch();
+
 #endif // BENCHMARKS_H_
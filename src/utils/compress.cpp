@@ -1,11 +1,14 @@
 #include "compress.h" 
 
 #include <limits>
+#include <algorithm>
 
 #include <lz4.h>
 
 #include <string.h>
 
+#include "check.h"
+
 namespace torrent_node_lib {
     
 inline bool compress_raw_block(std::string_view src, std::string& dst)
@@ -114,5 +117,85 @@ std::string decompress(const std::string &value) {
     decompress_uint32_block(value, result, std::numeric_limits<uint32_t>::max());
     return result;
 }
+
+const static size_t COMPRESS_STREAM_PIECE_SIZE = 256 * 1024;
+
+const static uint32_t COMPRESS_STREAM_MAGIC = std::numeric_limits<uint32_t>::max();
+
+CompressStream::CompressStream(std::string &result)
+    : result(result)
+{
+    const uint32_t magic = COMPRESS_STREAM_MAGIC;
+    result.append(reinterpret_cast<const char*>(&magic), sizeof(magic));
+}
+
+void CompressStream::compressPiece(std::string_view piece) {
+    const size_t boundSize = LZ4_compressBound(piece.size());
+    CHECK(boundSize != 0, "Incorrect piece size");
+    const size_t oldSize = result.size();
+    result.resize(oldSize + 2 * sizeof(uint32_t) + boundSize);
+    char *pieceBegin = result.data() + oldSize;
+    
+    const int lz4Size = LZ4_compress_default(piece.data(), pieceBegin + 2 * sizeof(uint32_t), piece.size(), boundSize);
+    CHECK(lz4Size > 0, "lz4 compress error");
+    
+    const uint32_t compressedSize = lz4Size + sizeof(uint32_t);
+    const uint32_t pieceSize = piece.size();
+    memcpy(pieceBegin, &compressedSize, sizeof(compressedSize));
+    memcpy(pieceBegin + sizeof(uint32_t), &pieceSize, sizeof(pieceSize));
+    result.resize(oldSize + sizeof(uint32_t) + compressedSize);
+}
+
+void CompressStream::write(std::string_view data) {
+    CHECK(!isFinished, "Compress stream already finished");
+    while (!data.empty()) {
+        if (pending.empty() && data.size() >= COMPRESS_STREAM_PIECE_SIZE) {
+            compressPiece(data.substr(0, COMPRESS_STREAM_PIECE_SIZE));
+            data.remove_prefix(COMPRESS_STREAM_PIECE_SIZE);
+        } else {
+            const size_t count = std::min(COMPRESS_STREAM_PIECE_SIZE - pending.size(), data.size());
+            pending.append(data.data(), count);
+            data.remove_prefix(count);
+            if (pending.size() == COMPRESS_STREAM_PIECE_SIZE) {
+                compressPiece(pending);
+                pending.clear();
+            }
+        }
+    }
+}
+
+void CompressStream::finish() {
+    CHECK(!isFinished, "Compress stream already finished");
+    if (!pending.empty()) {
+        compressPiece(pending);
+        pending.clear();
+    }
+    isFinished = true;
+}
+
+bool isCompressedStream(std::string_view value) {
+    if (value.size() < sizeof(uint32_t)) {
+        return false;
+    }
+    uint32_t magic = 0;
+    memcpy(&magic, value.data(), sizeof(magic));
+    return magic == COMPRESS_STREAM_MAGIC;
+}
+
+void decompressStream(std::string_view value, const std::function<void(std::string_view piece)> &processPiece) {
+    CHECK(isCompressedStream(value), "Incorrect compressed stream");
+    std::string piece;
+    size_t pos = sizeof(uint32_t);
+    while (pos < value.size()) {
+        CHECK(pos + sizeof(uint32_t) <= value.size(), "Incorrect compressed stream");
+        uint32_t compressedSize = 0;
+        memcpy(&compressedSize, value.data() + pos, sizeof(compressedSize));
+        pos += sizeof(uint32_t);
+        CHECK(pos + compressedSize <= value.size(), "Incorrect compressed stream");
+        CHECK(decompress_uint32_block(value.substr(pos, compressedSize), piece, COMPRESS_STREAM_PIECE_SIZE), "Incorrect compressed piece");
+        processPiece(piece);
+        pos += compressedSize;
+    }
+}
     
 } // namespace torrent_node_lib
@@ -2,12 +2,54 @@
 #define COMPRESS_H_
 
 #include <string>
+#include <string_view>
+#include <functional>
 
 namespace torrent_node_lib {
     
 std::string compress(const std::string &value);
 
 std::string decompress(const std::string &value);
+
+/**
+ *c Потоковое сжатие. Результат начинается с метки isCompressedStream, затем идут куски по 256 Кб, каждый кусок сжимается независимо в формате compress
+ *c и пишется в result как [uint32 размер сжатого куска][кусок]. Сжатые данные дописываются по мере поступления,
+ *c поэтому несжатые данные целиком держать в памяти не нужно, а читатель может разжимать кусками
+ */
+class CompressStream {
+public:
+    
+    explicit CompressStream(std::string &result);
+    
+    CompressStream(const CompressStream &) = delete;
+    CompressStream& operator=(const CompressStream &) = delete;
+    
+    void write(std::string_view data);
+    
+    //c Дожимает последний неполный кусок. После этого писать нельзя
+    void finish();
+    
+private:
+    
+    void compressPiece(std::string_view piece);
+    
+private:
+    
+    std::string &result;
+    
+    std::string pending;
+    
+    bool isFinished = false;
+};
+
+/**
+ *c Проверяет метку потокового формата. В формате compress на этом месте размер несжатых данных, который меткой быть не может,
+ *c поэтому по ответу можно понять, сжал ли его сервер потоково или старым compress
+ */
+bool isCompressedStream(std::string_view value);
+
+//c Разжимает данные CompressStream и отдает их по кускам
+void decompressStream(std::string_view value, const std::function<void(std::string_view piece)> &processPiece);
     
 } // namespace torrent_node_lib
 
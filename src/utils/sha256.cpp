@@ -0,0 +1,319 @@
+#include "sha256.h"
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+
+#include <openssl/sha.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_BATCH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace torrent_node_lib {
+
+namespace {
+
+const static uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const static uint32_t INITIAL_STATE[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const static size_t BLOCK_SIZE = 64;
+
+inline uint32_t loadBe32(const unsigned char *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void storeBe32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+//c Количество блоков сообщения вместе с дополнением: 0x80 и 8 байт длины
+inline size_t countBlocks(size_t size) {
+    return (size + 9 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+//c Возвращает blockIndex-й блок сообщения. Целые блоки берутся прямо из сообщения, хвост с дополнением собирается в buffer
+const unsigned char* getBlock(const Sha256Message &message, size_t blockIndex, unsigned char *buffer) {
+    const size_t offset = blockIndex * BLOCK_SIZE;
+    if (offset + BLOCK_SIZE <= message.size) {
+        return message.data + offset;
+    }
+    std::memset(buffer, 0, BLOCK_SIZE);
+    if (offset <= message.size) {
+        std::memcpy(buffer, message.data + offset, message.size - offset);
+        buffer[message.size - offset] = 0x80;
+    }
+    if (blockIndex + 1 == countBlocks(message.size)) {
+        const uint64_t bitSize = uint64_t(message.size) * 8;
+        storeBe32(buffer + 56, uint32_t(bitSize >> 32));
+        storeBe32(buffer + 60, uint32_t(bitSize));
+    }
+    return buffer;
+}
+
+void storeState(const uint32_t state[8], Sha256Hash &hash) {
+    for (size_t i = 0; i < 8; i++) {
+        storeBe32(hash.data() + 4 * i, state[i]);
+    }
+}
+
+void sha256Openssl(const std::vector<Sha256Message> &messages, std::vector<Sha256Hash> &result) {
+    for (size_t i = 0; i < messages.size(); i++) {
+        SHA256(messages[i].data, messages[i].size, result[i].data());
+    }
+}
+
+#ifdef SHA256_BATCH_X86
+
+#define TARGET_SHA __attribute__((target("sha,sse4.1,ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+TARGET_SHA void compressShaNi(__m128i &state0, __m128i &state1, const unsigned char *block) {
+    const __m128i byteSwapMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i w[16];
+    for (size_t j = 0; j < 4; j++) {
+        w[j] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * j)), byteSwapMask);
+    }
+    for (size_t j = 4; j < 16; j++) {
+        const __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(w[j - 4], w[j - 3]), _mm_alignr_epi8(w[j - 1], w[j - 2], 4));
+        w[j] = _mm_sha256msg2_epu32(t, w[j - 1]);
+    }
+
+    const __m128i saveState0 = state0;
+    const __m128i saveState1 = state1;
+    for (size_t j = 0; j < 16; j++) {
+        __m128i msg = _mm_add_epi32(w[j], _mm_loadu_si128(reinterpret_cast<const __m128i*>(K + 4 * j)));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+    }
+    state0 = _mm_add_epi32(state0, saveState0);
+    state1 = _mm_add_epi32(state1, saveState1);
+}
+
+//c Sha-инструкции считают одно сообщение за раз, но без накладных расходов openssl на вызов
+TARGET_SHA void sha256ShaNi(const std::vector<Sha256Message> &messages, std::vector<Sha256Hash> &result) {
+    alignas(16) unsigned char buffer[BLOCK_SIZE];
+    for (size_t i = 0; i < messages.size(); i++) {
+        //c Инструкции хотят состояние в порядке ABEF и CDGH
+        const __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(INITIAL_STATE)), 0xB1);
+        const __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(INITIAL_STATE + 4)), 0x1B);
+        __m128i state0 = _mm_alignr_epi8(abcd, efgh, 8);
+        __m128i state1 = _mm_blend_epi16(efgh, abcd, 0xF0);
+
+        const size_t blocks = countBlocks(messages[i].size);
+        for (size_t b = 0; b < blocks; b++) {
+            compressShaNi(state0, state1, getBlock(messages[i], b, buffer));
+        }
+
+        const __m128i feba = _mm_shuffle_epi32(state0, 0x1B);
+        const __m128i dchg = _mm_shuffle_epi32(state1, 0xB1);
+        uint32_t state[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+        storeState(state, result[i]);
+    }
+}
+
+const static size_t LANES = 8;
+
+TARGET_AVX2 inline __m256i rotr(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+//c Один блок для 8 сообщений сразу, каждое сообщение в своей 32-битной дорожке
+TARGET_AVX2 void compressAvx2(__m256i state[8], const unsigned char *blocks[LANES]) {
+    __m256i w[64];
+    for (size_t t = 0; t < 16; t++) {
+        w[t] = _mm256_setr_epi32(
+            loadBe32(blocks[0] + 4 * t), loadBe32(blocks[1] + 4 * t), loadBe32(blocks[2] + 4 * t), loadBe32(blocks[3] + 4 * t),
+            loadBe32(blocks[4] + 4 * t), loadBe32(blocks[5] + 4 * t), loadBe32(blocks[6] + 4 * t), loadBe32(blocks[7] + 4 * t)
+        );
+    }
+    for (size_t t = 16; t < 64; t++) {
+        const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(w[t - 15], 7), rotr(w[t - 15], 18)), _mm256_srli_epi32(w[t - 15], 3));
+        const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(w[t - 2], 17), rotr(w[t - 2], 19)), _mm256_srli_epi32(w[t - 2], 10));
+        w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+    }
+
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for (size_t t = 0; t < 64; t++) {
+        const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(e, 6), rotr(e, 11)), rotr(e, 25));
+        const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        const __m256i temp1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, _mm256_set1_epi32(K[t]))), w[t]);
+        const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(a, 2), rotr(a, 13)), rotr(a, 22));
+        const __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        const __m256i temp2 = _mm256_add_epi32(s0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(temp1, temp2);
+    }
+    state[0] = _mm256_add_epi32(state[0], a);
+    state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c);
+    state[3] = _mm256_add_epi32(state[3], d);
+    state[4] = _mm256_add_epi32(state[4], e);
+    state[5] = _mm256_add_epi32(state[5], f);
+    state[6] = _mm256_add_epi32(state[6], g);
+    state[7] = _mm256_add_epi32(state[7], h);
+}
+
+/**
+ *c Сообщения сортируются по числу блоков и считаются группами по 8.
+ *c Дорожки коротких сообщений группы после их последнего блока крутятся вхолостую и их состояние не меняется
+ */
+TARGET_AVX2 void sha256Avx2(const std::vector<Sha256Message> &messages, std::vector<Sha256Hash> &result) {
+    std::vector<size_t> order(messages.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&messages](size_t first, size_t second) {
+        return countBlocks(messages[first].size) < countBlocks(messages[second].size);
+    });
+
+    alignas(32) unsigned char buffers[LANES][BLOCK_SIZE];
+    for (size_t groupBegin = 0; groupBegin < order.size(); groupBegin += LANES) {
+        const size_t countLanes = std::min(LANES, order.size() - groupBegin);
+
+        //c Пустые дорожки неполной группы повторяют первое сообщение, результат их не нужен
+        size_t messageIndexes[LANES];
+        size_t laneBlocks[LANES];
+        for (size_t lane = 0; lane < LANES; lane++) {
+            messageIndexes[lane] = order[groupBegin + (lane < countLanes ? lane : 0)];
+            laneBlocks[lane] = countBlocks(messages[messageIndexes[lane]].size);
+        }
+        const size_t minBlocks = *std::min_element(laneBlocks, laneBlocks + LANES);
+        const size_t maxBlocks = *std::max_element(laneBlocks, laneBlocks + LANES);
+
+        __m256i state[8];
+        for (size_t i = 0; i < 8; i++) {
+            state[i] = _mm256_set1_epi32(INITIAL_STATE[i]);
+        }
+
+        for (size_t block = 0; block < maxBlocks; block++) {
+            const unsigned char *blocks[LANES];
+            alignas(32) int32_t activeMask[LANES];
+            for (size_t lane = 0; lane < LANES; lane++) {
+                const bool isActive = block < laneBlocks[lane];
+                activeMask[lane] = isActive ? -1 : 0;
+                blocks[lane] = getBlock(messages[messageIndexes[lane]], isActive ? block : laneBlocks[lane] - 1, buffers[lane]);
+            }
+            if (block < minBlocks) {
+                compressAvx2(state, blocks);
+            } else {
+                __m256i newState[8];
+                std::copy(state, state + 8, newState);
+                compressAvx2(newState, blocks);
+                const __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(activeMask));
+                for (size_t i = 0; i < 8; i++) {
+                    state[i] = _mm256_blendv_epi8(state[i], newState[i], mask);
+                }
+            }
+        }
+
+        alignas(32) uint32_t lanesState[8][LANES];
+        for (size_t i = 0; i < 8; i++) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanesState[i]), state[i]);
+        }
+        for (size_t lane = 0; lane < countLanes; lane++) {
+            uint32_t laneState[8];
+            for (size_t i = 0; i < 8; i++) {
+                laneState[i] = lanesState[i][lane];
+            }
+            storeState(laneState, result[messageIndexes[lane]]);
+        }
+    }
+}
+
+#endif // SHA256_BATCH_X86
+
+enum class Sha256Implementation {
+    Openssl, ShaNi, Avx2
+};
+
+Sha256Implementation detectImplementation() {
+#ifdef SHA256_BATCH_X86
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        const bool isSse41 = (ecx & bit_SSE4_1) != 0;
+        unsigned int eax7 = 0, ebx7 = 0, ecx7 = 0, edx7 = 0;
+        if (isSse41 && __get_cpuid_count(7, 0, &eax7, &ebx7, &ecx7, &edx7) && (ebx7 & bit_SHA) != 0) {
+            return Sha256Implementation::ShaNi;
+        }
+    }
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Sha256Implementation::Avx2;
+    }
+#endif
+    return Sha256Implementation::Openssl;
+}
+
+Sha256Implementation getImplementation() {
+    const static Sha256Implementation implementation = detectImplementation();
+    return implementation;
+}
+
+}
+
+std::vector<Sha256Hash> sha256Batch(const std::vector<Sha256Message> &messages) {
+    std::vector<Sha256Hash> result(messages.size());
+    switch (getImplementation()) {
+#ifdef SHA256_BATCH_X86
+    case Sha256Implementation::ShaNi:
+        sha256ShaNi(messages, result);
+        break;
+    case Sha256Implementation::Avx2:
+        sha256Avx2(messages, result);
+        break;
+#endif
+    default:
+        sha256Openssl(messages, result);
+    }
+    return result;
+}
+
+std::vector<Sha256Hash> doubleSha256Batch(const std::vector<Sha256Message> &messages) {
+    const std::vector<Sha256Hash> first = sha256Batch(messages);
+    std::vector<Sha256Message> second;
+    second.reserve(first.size());
+    for (const Sha256Hash &hash: first) {
+        second.push_back(Sha256Message{hash.data(), hash.size()});
+    }
+    return sha256Batch(second);
+}
+
+const char* getSha256BatchImplementationName() {
+    switch (getImplementation()) {
+    case Sha256Implementation::ShaNi:
+        return "sha";
+    case Sha256Implementation::Avx2:
+        return "avx2";
+    default:
+        return "openssl";
+    }
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef SHA256_BATCH_H_
+#define SHA256_BATCH_H_
+
+#include <vector>
+#include <array>
+#include <cstddef>
+
+namespace torrent_node_lib {
+
+struct Sha256Message {
+    const unsigned char *data;
+    size_t size;
+};
+
+using Sha256Hash = std::array<unsigned char, 32>;
+
+/**
+ *c Считает sha256 сразу от многих независимых сообщений.
+ *c Реализация выбирается при первом вызове по процессору: sha-расширения, avx2 по 8 сообщений за раз или openssl
+ */
+std::vector<Sha256Hash> sha256Batch(const std::vector<Sha256Message> &messages);
+
+//c sha256(sha256(message)) для каждого сообщения, то же, что get_double_sha256
+std::vector<Sha256Hash> doubleSha256Batch(const std::vector<Sha256Message> &messages);
+
+//c Имя выбранной реализации, для логов и бенчмарков
+const char* getSha256BatchImplementationName();
+
+}
+
+#endif // SHA256_BATCH_H_